@@ -36,7 +36,7 @@ Buffer::Buffer(size_t limit) :
 }
 
 Buffer::Buffer(std::vector<uint8_t> data) :
-	data(data), write_head(data.size()) {
+	data(std::move(data)), write_head(this->data.size()) {
 }
 
 Buffer::~Buffer() {
@@ -79,7 +79,7 @@ bool Buffer::Read(uint8_t *io, size_t size) {
 		return false;
 	}
 	std::copy_n(data.begin() + read_head, size, io);
-	read_head+= size;
+	MarkRead(size);
 	return true;
 }
 
@@ -98,6 +98,11 @@ uint8_t *Buffer::Read() {
 
 void Buffer::MarkRead(size_t size) {
 	read_head+= size;
+	if(read_head == write_head) {
+		// rewinding a drained buffer is free, and means streaming through
+		// it usually never has to compact
+		Clear();
+	}
 }
 
 void Buffer::Clear() {
@@ -114,33 +119,57 @@ size_t Buffer::WriteAvailableHint() {
 }
 
 bool Buffer::EnsureSpace(size_t size) {
-	if(write_head + size > data.size()) {
+	if(write_head + size <= data.size()) {
+		return true;
+	}
+
+	size_t live = ReadAvailable();
+	if(limit && live + size > *limit) {
+		return false;
+	}
+
+	// Only compact if we've already read at least as many bytes as we'd
+	// have to move, so a byte is moved at most once for every byte read.
+	if(live + size <= data.size() && read_head >= live) {
 		Compact();
+		return true;
 	}
-	if(write_head + size > data.size()) {
-		if(limit && write_head + size > *limit) {
-			return false;
-		}
-		data.resize(write_head + size);
+
+	size_t new_size = std::max(live + size, data.size() * 2);
+	if(limit) {
+		new_size = std::min(new_size, *limit);
+	}
+	if(new_size <= data.size()) {
+		// can't grow any further, so compacting is all that's left
+		Compact();
+	} else {
+		Reallocate(new_size);
 	}
 	return true;
 }
 
 void Buffer::TryEnsureSpace(size_t size) {
-	if(write_head + size > data.size()) {
-		Compact();
-	}
-	if(write_head + size > data.size()) {
-		if(limit && write_head + size > *limit) {
-			data.resize(*limit);
-		} else {
-			data.resize(write_head + size);
-		}
+	size_t live = ReadAvailable();
+	if(limit && live + size > *limit) {
+		size = *limit - live;
 	}
+	EnsureSpace(size);
+}
+
+void Buffer::Reallocate(size_t size) {
+	// only carry over what hasn't been read yet
+	std::vector<uint8_t> new_data(size, 0);
+	std::copy(data.begin() + read_head, data.begin() + write_head, new_data.begin());
+	data = std::move(new_data);
+	write_head-= read_head;
+	read_head = 0;
 }
 
 void Buffer::Compact() {
-	std::copy(data.begin() + read_head, data.end(), data.begin());
+	if(read_head == 0) {
+		return;
+	}
+	std::copy(data.begin() + read_head, data.begin() + write_head, data.begin());
 	write_head-= read_head;
 	read_head = 0;
 }
@@ -149,6 +178,19 @@ std::vector<uint8_t> Buffer::GetData() {
 	return std::vector<uint8_t>(data.begin() + read_head, data.begin() + write_head);
 }
 
+std::vector<uint8_t> Buffer::TakeData() {
+	std::vector<uint8_t> taken;
+	if(read_head == 0) {
+		data.resize(write_head);
+		taken = std::move(data);
+		data.clear();
+	} else {
+		taken = GetData();
+	}
+	Clear();
+	return taken;
+}
+
 std::string Buffer::GetString() {
 	return std::string(data.begin() + read_head, data.begin() + write_head);
 }
@@ -55,7 +55,7 @@ class Buffer {
 	bool Write(const char *data);
 	
 	template<typename T>
-	bool Write(std::vector<T> data) {
+	bool Write(const std::vector<T> &data) {
 		static_assert(std::is_standard_layout<T>::value, "T must be standard layout");
 		return Write((uint8_t*) data.data(), sizeof(T) * data.size());
 	}
@@ -105,6 +105,9 @@ class Buffer {
 	size_t WriteAvailableHint();
 
 	std::vector<uint8_t> GetData();
+	// Like GetData, but moves the storage out instead of copying it if
+	// nothing has been read yet. Leaves the buffer empty.
+	std::vector<uint8_t> TakeData();
 
 	void Compact(); // guarantees that data pending read won't be moved around
 
@@ -120,6 +123,8 @@ class Buffer {
 	bool EnsureSpace(size_t size);
 	// tries to expand vector, up to limit if necessary.
 	void TryEnsureSpace(size_t size);
+	// moves unread data into a fresh vector of `size` bytes
+	void Reallocate(size_t size);
 };
 
 } // namespace util
@@ -0,0 +1,248 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Compression.hpp"
+
+#include<string.h>
+
+namespace twili {
+namespace compression {
+
+namespace {
+
+const size_t MinMatch = 4;
+const size_t LastLiterals = 5; // the block has to end with at least this many literals
+const size_t MatchFindLimit = 12; // and the last match has to start this far from the end
+const size_t MaxOffset = 0xffff;
+const int HashBits = 12;
+
+// payloads smaller than this aren't worth the trouble
+const size_t MinPayloadSize = 256;
+
+uint32_t Read32(const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+uint32_t Hash(uint32_t sequence) {
+	return (sequence * 2654435761u) >> (32 - HashBits);
+}
+
+// writes the 255-byte continuation of a length that didn't fit in its nibble
+bool WriteLength(uint8_t *&op, uint8_t *oend, size_t length) {
+	while(length >= 255) {
+		if(op >= oend) { return false; }
+		*op++ = 255;
+		length-= 255;
+	}
+	if(op >= oend) { return false; }
+	*op++ = length;
+	return true;
+}
+
+bool ReadLength(const uint8_t *&ip, const uint8_t *iend, size_t &length) {
+	uint8_t b;
+	do {
+		if(ip >= iend) { return false; }
+		b = *ip++;
+		length+= b;
+	} while(b == 255);
+	return true;
+}
+
+bool WriteSequence(uint8_t *&op, uint8_t *oend, const uint8_t *literals, size_t literal_length, size_t offset, size_t match_length) {
+	if(op >= oend) { return false; }
+	uint8_t *token = op++;
+	*token = (literal_length < 15 ? literal_length : 15) << 4;
+	if(literal_length >= 15 && !WriteLength(op, oend, literal_length - 15)) {
+		return false;
+	}
+	if((size_t) (oend - op) < literal_length) {
+		return false;
+	}
+	if(literal_length > 0) { // literals is null for empty blocks
+		memcpy(op, literals, literal_length);
+		op+= literal_length;
+	}
+
+	if(match_length == 0) { // last sequence
+		return true;
+	}
+
+	if(oend - op < 2) { return false; }
+	*op++ = offset & 0xff;
+	*op++ = offset >> 8;
+
+	match_length-= MinMatch;
+	*token|= match_length < 15 ? match_length : 15;
+	if(match_length >= 15 && !WriteLength(op, oend, match_length - 15)) {
+		return false;
+	}
+	return true;
+}
+
+} // anonymous namespace
+
+size_t CompressBlock(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity) {
+	const uint8_t *ip = src;
+	const uint8_t *anchor = src;
+	const uint8_t *iend = src + size;
+	uint8_t *op = dst;
+	uint8_t *oend = dst + capacity;
+
+	if(size > MatchFindLimit) {
+		const uint8_t *mflimit = iend - MatchFindLimit;
+		const uint8_t *matchlimit = iend - LastLiterals;
+		std::vector<uint32_t> table(1 << HashBits, 0);
+		size_t misses = 0;
+
+		while(ip < mflimit) {
+			uint32_t sequence = Read32(ip);
+			uint32_t &slot = table[Hash(sequence)];
+			const uint8_t *ref = src + slot;
+			slot = ip - src;
+
+			if(ref >= ip || (size_t) (ip - ref) > MaxOffset || Read32(ref) != sequence) {
+				// skip faster through data that doesn't compress
+				ip+= 1 + (misses++ >> 6);
+				continue;
+			}
+			misses = 0;
+
+			const uint8_t *match_end = ip + MinMatch;
+			const uint8_t *ref_end = ref + MinMatch;
+			while(match_end < matchlimit && *match_end == *ref_end) {
+				match_end++;
+				ref_end++;
+			}
+
+			if(!WriteSequence(op, oend, anchor, ip - anchor, ip - ref, match_end - ip)) {
+				return 0;
+			}
+			ip = match_end;
+			anchor = ip;
+		}
+	}
+
+	if(!WriteSequence(op, oend, anchor, iend - anchor, 0, 0)) {
+		return 0;
+	}
+	return op - dst;
+}
+
+bool DecompressBlock(const uint8_t *src, size_t size, uint8_t *dst, size_t dst_size) {
+	const uint8_t *ip = src;
+	const uint8_t *iend = src + size;
+	uint8_t *op = dst;
+	uint8_t *oend = dst + dst_size;
+
+	while(ip < iend) {
+		uint8_t token = *ip++;
+
+		size_t literal_length = token >> 4;
+		if(literal_length == 15 && !ReadLength(ip, iend, literal_length)) {
+			return false;
+		}
+		if((size_t) (iend - ip) < literal_length || (size_t) (oend - op) < literal_length) {
+			return false;
+		}
+		if(literal_length > 0) {
+			memcpy(op, ip, literal_length);
+			ip+= literal_length;
+			op+= literal_length;
+		}
+
+		if(ip == iend) { // last sequence has no match
+			break;
+		}
+
+		if(iend - ip < 2) {
+			return false;
+		}
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip+= 2;
+		if(offset == 0 || offset > (size_t) (op - dst)) {
+			return false;
+		}
+
+		size_t match_length = token & 15;
+		if(match_length == 15 && !ReadLength(ip, iend, match_length)) {
+			return false;
+		}
+		match_length+= MinMatch;
+		if((size_t) (oend - op) < match_length) {
+			return false;
+		}
+
+		// matches may overlap their own output
+		const uint8_t *match = op - offset;
+		for(size_t i = 0; i < match_length; i++) {
+			op[i] = match[i];
+		}
+		op+= match_length;
+	}
+
+	return op == oend;
+}
+
+bool CompressPayload(const uint8_t *data, size_t size, std::vector<uint8_t> &out) {
+	if(size < MinPayloadSize) {
+		return false;
+	}
+
+	// not worth it unless we save at least 1/16
+	uint64_t raw_size = size;
+	std::vector<uint8_t> compressed(size - size / 16);
+	memcpy(compressed.data(), &raw_size, sizeof(raw_size));
+	size_t block_size = CompressBlock(data, size, compressed.data() + sizeof(raw_size), compressed.size() - sizeof(raw_size));
+	if(block_size == 0) {
+		return false;
+	}
+	compressed.resize(sizeof(raw_size) + block_size);
+	out = std::move(compressed);
+	return true;
+}
+
+bool DecompressPayload(const uint8_t *data, size_t size, std::vector<uint8_t> &out) {
+	uint64_t raw_size;
+	if(size < sizeof(raw_size)) {
+		return false;
+	}
+	memcpy(&raw_size, data, sizeof(raw_size));
+	data+= sizeof(raw_size);
+	size-= sizeof(raw_size);
+
+	// LZ4 can't do better than about 255:1, so don't let a bad header make
+	// us allocate something huge
+	if(raw_size > (uint64_t) size * 255) {
+		return false;
+	}
+
+	std::vector<uint8_t> decompressed(raw_size);
+	if(!DecompressBlock(data, size, decompressed.data(), decompressed.size())) {
+		return false;
+	}
+	out = std::move(decompressed);
+	return true;
+}
+
+} // namespace compression
+} // namespace twili
@@ -0,0 +1,45 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<vector>
+
+#include<stdint.h>
+#include<stddef.h>
+
+namespace twili {
+namespace compression {
+
+// Raw LZ4 blocks. CompressBlock returns the compressed size, or 0 if
+// the output didn't fit in `capacity`. DecompressBlock only succeeds if
+// the block decodes to exactly `dst_size` bytes.
+size_t CompressBlock(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity);
+bool DecompressBlock(const uint8_t *src, size_t size, uint8_t *dst, size_t dst_size);
+
+// Payloads sent with protocol::PAYLOAD_COMPRESSED are a u64 uncompressed
+// size followed by an LZ4 block. CompressPayload returns false without
+// touching `out` if the payload is too small or wouldn't shrink enough to
+// be worth it.
+bool CompressPayload(const uint8_t *data, size_t size, std::vector<uint8_t> &out);
+bool DecompressPayload(const uint8_t *data, size_t size, std::vector<uint8_t> &out);
+
+} // namespace compression
+} // namespace twili
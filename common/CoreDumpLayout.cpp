@@ -0,0 +1,225 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "CoreDumpLayout.hpp"
+
+#include<algorithm>
+
+#include<string.h>
+
+#include "Elf.hpp"
+#include "err.hpp"
+
+namespace twili {
+namespace coredump {
+
+std::vector<VMA> ElideZeroPages(const std::vector<VMA> &vmas, const MemoryReader &read) {
+	const size_t page_size = 0x1000;
+	const size_t min_split_pages = 16;
+	const size_t max_vmas = 0xff00; // e_phnum is only 16 bits
+
+	std::vector<VMA> split;
+	std::vector<uint8_t> buffer(0x40000);
+
+	for(auto i = vmas.begin(); i != vmas.end(); i++) {
+		// scan the VMA page by page, recording [start, end) of data runs
+		std::vector<std::pair<size_t, size_t>> runs;
+		bool failed = false;
+		for(size_t offset = 0; offset < i->size && !failed; offset+= buffer.size()) {
+			size_t size = std::min(buffer.size(), i->size - offset);
+			if(read(i->virtual_addr + offset, buffer.data(), size) != 0) {
+				failed = true;
+				break;
+			}
+			for(size_t page = 0; page < size; page+= page_size) {
+				size_t page_end = std::min(page + page_size, size);
+				bool zero = std::all_of(
+					buffer.begin() + page, buffer.begin() + page_end,
+					[](uint8_t b) { return b == 0; });
+				if(zero) {
+					continue;
+				}
+				if(!runs.empty() && runs.back().second == offset + page) {
+					runs.back().second = offset + page_end;
+				} else {
+					runs.push_back({offset + page, offset + page_end});
+				}
+			}
+		}
+
+		if(failed) {
+			// fall back to dumping the whole thing and let Read report the error
+			split.push_back(*i);
+			continue;
+		}
+
+		// merge runs separated by short zero gaps
+		std::vector<std::pair<size_t, size_t>> merged;
+		for(auto &run : runs) {
+			if(!merged.empty() && run.first - merged.back().second < min_split_pages * page_size) {
+				merged.back().second = run.second;
+			} else {
+				merged.push_back(run);
+			}
+		}
+
+		// the VMA's leading zeroes get a header with no file data
+		std::vector<VMA> pieces;
+		if(merged.empty() || merged.front().first > 0) {
+			size_t end = merged.empty() ? i->size : merged.front().first;
+			pieces.push_back({0, i->virtual_addr, end, i->flags, 0});
+		}
+		for(auto j = merged.begin(); j != merged.end(); j++) {
+			size_t end = (j + 1 == merged.end()) ? i->size : (j + 1)->first;
+			pieces.push_back({0, i->virtual_addr + j->first, end - j->first, i->flags, j->second - j->first});
+		}
+
+		if(split.size() + pieces.size() + (vmas.end() - i - 1) > max_vmas) {
+			split.push_back(*i);
+		} else {
+			split.insert(split.end(), pieces.begin(), pieces.end());
+		}
+	}
+
+	return split;
+}
+
+CoreDumpLayout::CoreDumpLayout() {
+}
+
+void CoreDumpLayout::Build(std::vector<VMA> &&vmas, std::vector<uint8_t> &&notes) {
+	this->vmas = std::move(vmas);
+	notes_bytes = std::move(notes);
+	segments.clear();
+
+	total_size = 0;
+	total_size+= sizeof(ELF::Elf64_Ehdr);
+	for(auto i = this->vmas.begin(); i != this->vmas.end(); i++) {
+		i->file_offset = total_size;
+		total_size+= i->file_size;
+	}
+
+	size_t notes_offset = total_size;
+	total_size+= notes_bytes.size();
+
+	size_t ph_offset = total_size;
+	total_size+= sizeof(ELF::Elf64_Phdr) * (1 + this->vmas.size());
+
+	ELF::Elf64_Ehdr ehdr = {
+		.e_ident = {
+			.ei_class = ELF::ELFCLASS64,
+			.ei_data = ELF::ELFDATALSB,
+			.ei_version = 1,
+			.ei_osabi = 3 // pretend to be a Linux core dump
+		},
+		.e_type = ELF::ET_CORE,
+		.e_machine = ELF::EM_AARCH64,
+		.e_version = 1,
+		.e_entry = 0,
+		.e_phoff = ph_offset,
+		.e_shoff = 0,
+		.e_flags = 0,
+		.e_phnum = static_cast<uint16_t>(1 + this->vmas.size()),
+		.e_shnum = 0,
+		.e_shstrndx = 0,
+	};
+	header_bytes.resize(sizeof(ehdr));
+	memcpy(header_bytes.data(), &ehdr, sizeof(ehdr));
+
+	std::vector<ELF::Elf64_Phdr> phdrs;
+	phdrs.push_back({
+			.p_type = ELF::PT_NOTE,
+			.p_flags = ELF::PF_R,
+			.p_offset = notes_offset,
+			.p_vaddr = 0,
+			.p_paddr = 0,
+			.p_filesz = notes_bytes.size(),
+			.p_memsz = 0,
+			.p_align = 4
+		});
+	for(auto i = this->vmas.begin(); i != this->vmas.end(); i++) {
+		phdrs.push_back({
+				.p_type = ELF::PT_LOAD,
+				.p_flags = i->flags,
+				.p_offset = i->file_offset,
+				.p_vaddr = i->virtual_addr,
+				.p_paddr = 0,
+				.p_filesz = i->file_size,
+				.p_memsz = i->size,
+				.p_align = 0x1000
+			});
+	}
+	phdrs_bytes.resize(phdrs.size() * sizeof(ELF::Elf64_Phdr));
+	memcpy(phdrs_bytes.data(), phdrs.data(), phdrs_bytes.size());
+
+	segments.push_back({0, header_bytes.size(), header_bytes.data(), 0});
+	for(auto i = this->vmas.begin(); i != this->vmas.end(); i++) {
+		if(i->file_size > 0) {
+			segments.push_back({i->file_offset, i->file_size, nullptr, i->virtual_addr});
+		}
+	}
+	if(notes_bytes.size() > 0) {
+		segments.push_back({notes_offset, notes_bytes.size(), notes_bytes.data(), 0});
+	}
+	segments.push_back({ph_offset, phdrs_bytes.size(), phdrs_bytes.data(), 0});
+}
+
+size_t CoreDumpLayout::GetSize() const {
+	return total_size;
+}
+
+const std::vector<VMA> &CoreDumpLayout::GetVMAs() const {
+	return vmas;
+}
+
+uint32_t CoreDumpLayout::Read(uint64_t offset, uint8_t *buffer, size_t size, const MemoryReader &read) const {
+	if(offset + size > total_size || offset + size < offset) {
+		return TWILI_ERR_EOF;
+	}
+
+	// find the last segment that starts at or before offset
+	auto i = std::upper_bound(
+		segments.begin(), segments.end(), offset,
+		[](uint64_t offset, const Segment &seg) {
+			return offset < seg.file_offset;
+		}) - 1;
+
+	while(size > 0) {
+		size_t segment_offset = offset - i->file_offset;
+		size_t chunk = std::min(size, i->size - segment_offset);
+		if(i->data) {
+			memcpy(buffer, i->data + segment_offset, chunk);
+		} else {
+			uint32_t r = read(i->virtual_addr + segment_offset, buffer, chunk);
+			if(r != 0) {
+				return r;
+			}
+		}
+		buffer+= chunk;
+		offset+= chunk;
+		size-= chunk;
+		i++;
+	}
+
+	return 0;
+}
+
+} // namespace coredump
+} // namespace twili
@@ -0,0 +1,85 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<functional>
+#include<vector>
+
+#include<stdint.h>
+#include<stddef.h>
+
+namespace twili {
+namespace coredump {
+
+struct VMA {
+	uint64_t file_offset;
+	uint64_t virtual_addr;
+	size_t size;
+	uint32_t flags;
+	size_t file_size; // bytes past this are known to be zero and aren't stored
+};
+
+// Reads process memory, returning a result code (0 on success).
+using MemoryReader = std::function<uint32_t(uint64_t virtual_addr, uint8_t *buffer, size_t size)>;
+
+// Splits VMAs around runs of all-zero pages so that those pages don't have
+// to be stored in the core. Each resulting PT_LOAD is some data followed
+// by zeroes, which are described by p_memsz > p_filesz. Short runs in the
+// middle of a VMA aren't worth another program header, so those are kept.
+std::vector<VMA> ElideZeroPages(const std::vector<VMA> &vmas, const MemoryReader &read);
+
+// Lays out an ELF core file: the ELF header, then the data for each VMA,
+// then the notes, then the program headers. Process memory isn't read
+// until Read() asks for it.
+class CoreDumpLayout {
+ public:
+	CoreDumpLayout();
+	CoreDumpLayout(const CoreDumpLayout &other) = delete;
+	CoreDumpLayout &operator=(const CoreDumpLayout &other) = delete;
+
+	// assigns file offsets to the VMAs and builds the headers around them
+	void Build(std::vector<VMA> &&vmas, std::vector<uint8_t> &&notes);
+	size_t GetSize() const;
+	const std::vector<VMA> &GetVMAs() const;
+	// returns TWILI_ERR_EOF if the range runs past the end of the file, or
+	// whatever `read` returned if process memory couldn't be read
+	uint32_t Read(uint64_t offset, uint8_t *buffer, size_t size, const MemoryReader &read) const;
+
+ private:
+	// a contiguous piece of the core file, either backed by one of our
+	// own buffers or by process memory
+	struct Segment {
+		uint64_t file_offset;
+		size_t size;
+		const uint8_t *data; // nullptr if backed by process memory
+		uint64_t virtual_addr;
+	};
+
+	std::vector<VMA> vmas;
+	std::vector<uint8_t> header_bytes;
+	std::vector<uint8_t> notes_bytes;
+	std::vector<uint8_t> phdrs_bytes;
+	std::vector<Segment> segments; // sorted by file offset
+	size_t total_size = 0;
+};
+
+} // namespace coredump
+} // namespace twili
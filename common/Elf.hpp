@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include<stdint.h>
+
 namespace ELF {
 
 enum {
@@ -0,0 +1,40 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Hello.hpp"
+
+namespace twili {
+namespace hello {
+
+Agreement Negotiate(uint32_t proposed_features, size_t proposed_max_transfer_size, size_t transfer_size_limit) {
+	Agreement agreement;
+	agreement.features = proposed_features & SupportedFeatures;
+	if(proposed_max_transfer_size < MinTransferSize) { // missing or silly
+		agreement.max_transfer_size = 0;
+	} else if(proposed_max_transfer_size > transfer_size_limit) {
+		agreement.max_transfer_size = transfer_size_limit;
+	} else {
+		agreement.max_transfer_size = proposed_max_transfer_size;
+	}
+	return agreement;
+}
+
+} // namespace hello
+} // namespace twili
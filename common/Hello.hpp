@@ -0,0 +1,48 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<stdint.h>
+#include<stddef.h>
+
+#include "Protocol.hpp"
+
+namespace twili {
+namespace hello {
+
+// Everything this build can use, on either end of the link.
+const uint32_t SupportedFeatures = protocol::FEATURE_COMPRESSION;
+
+// Proposals smaller than this are treated as missing.
+const size_t MinTransferSize = 0x1000;
+
+// What the device agrees to in response to the host's HELLO.
+struct Agreement {
+	uint32_t features;
+	size_t max_transfer_size; // 0 to stay on the bridge's default
+};
+
+// Keeps the proposed features that this build supports, and cuts the
+// proposed transfer size down to what the bridge can handle.
+Agreement Negotiate(uint32_t proposed_features, size_t proposed_max_transfer_size, size_t transfer_size_limit);
+
+} // namespace hello
+} // namespace twili
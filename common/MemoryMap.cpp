@@ -0,0 +1,60 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "MemoryMap.hpp"
+
+namespace twili {
+namespace memory_map {
+
+namespace {
+
+template<typename T>
+bool DecodeVector(util::Buffer &in, std::vector<T> &vec) {
+	uint64_t count;
+	if(!in.Read(count)) {
+		return false;
+	}
+	// don't trust the count until we know the data is all there
+	if(count > in.ReadAvailable() / sizeof(T)) {
+		return false;
+	}
+	vec.resize(count);
+	return in.Read(vec);
+}
+
+} // anonymous namespace
+
+void Encode(const std::vector<Region> &regions, const std::vector<uint32_t> &page_infos, util::Buffer &out) {
+	out.Write<uint64_t>(regions.size());
+	out.Write(regions);
+	out.Write<uint64_t>(page_infos.size());
+	out.Write(page_infos);
+}
+
+bool Decode(util::Buffer &in, std::vector<Region> &regions, std::vector<uint32_t> &page_infos) {
+	return
+		DecodeVector(in, regions) &&
+		DecodeVector(in, page_infos) &&
+		regions.size() == page_infos.size() &&
+		in.ReadAvailable() == 0;
+}
+
+} // namespace memory_map
+} // namespace twili
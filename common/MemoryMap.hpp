@@ -0,0 +1,56 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<vector>
+
+#include<stdint.h>
+#include<stddef.h>
+
+#include "Buffer.hpp"
+
+namespace twili {
+namespace memory_map {
+
+// One region of a process's address space, as svcQueryDebugProcessMemory
+// reports it. Same layout as the kernel's MemoryInfo.
+struct Region {
+	uint64_t base_addr;
+	uint64_t size;
+	uint32_t memory_type;
+	uint32_t memory_attribute;
+	uint32_t permission;
+	uint32_t device_ref_count;
+	uint32_t ipc_ref_count;
+	uint32_t padding;
+};
+
+static_assert(sizeof(Region) == 0x28, "Region must match MemoryInfo");
+
+// QUERY_MEMORY_MAP responses are a vector of Regions followed by a vector
+// with the page info for each region.
+void Encode(const std::vector<Region> &regions, const std::vector<uint32_t> &page_infos, util::Buffer &out);
+// returns false if the response is truncated, has anything after it, or
+// doesn't have a page info for every region
+bool Decode(util::Buffer &in, std::vector<Region> &regions, std::vector<uint32_t> &page_infos);
+
+} // namespace memory_map
+} // namespace twili
@@ -42,6 +42,33 @@ struct MessageHeader {
 
 const int VERSION = 2;
 
+// Set in MessageHeader::payload_size when the payload is compressed (see
+// common/Compression.hpp). The rest of payload_size is the size on the wire.
+// Nobody sends these until the other end has agreed to FEATURE_COMPRESSION
+// in a HELLO exchange.
+const uint64_t PAYLOAD_COMPRESSED = 1ull << 63;
+
+// Exchanged once per connection through ITwibDeviceInterface HELLO, before
+// anything else. Both the request and the response are a msgpack map:
+//   "version": HELLO_VERSION of the sender
+//   "features": FEATURE_* bits. the host sends what it supports, and the
+//     device responds with the ones that will be used.
+//   "max_transfer_size": the largest chunk the sender wants to handle at
+//     once. the device responds with what it will actually use.
+//   "max_outstanding_requests": (device only) how many requests may be
+//     waiting for responses at once, or 0 for no limit.
+// Unknown keys are ignored, and missing ones mean the feature isn't there,
+// so either side can grow new fields. Devices that don't know HELLO reject
+// it, which means defaults for everything.
+// twibd starts every session with HELLO followed by an IDENTIFY from
+// META_CLIENT_ID. A link can outlive twibd (USB stays up when it restarts),
+// so an IDENTIFY from META_CLIENT_ID without a HELLO before it puts the
+// device back on defaults.
+const uint32_t HELLO_VERSION = 2;
+const uint32_t META_CLIENT_ID = 0xffffffff;
+
+const uint32_t FEATURE_COMPRESSION = 1 << 0; // LZ4
+
 class ITwibMetaInterface {
  public:
 	enum class Command : uint32_t {
@@ -70,6 +97,8 @@ class ITwibDeviceInterface {
 		WAIT_TO_DEBUG_APPLICATION = 24,
 		WAIT_TO_DEBUG_TITLE = 25,
 		REBOOT_UNSAFE = 26,
+		OPEN_COREDUMP = 27,
+		HELLO = 28,
 	};
 };
 
@@ -105,6 +134,11 @@ class ITwibDebugger {
 		GET_TARGET_ENTRY = 21,
 		LAUNCH_DEBUG_PROCESS = 22,
 		GET_NRO_INFOS = 24,
+		QUERY_MEMORY_MAP = 25,
+		READ_MEMORY_MULTI = 26,
+		GET_DEBUG_EVENTS = 27,
+		STEP_THREAD = 28,
+		WRITE_MEMORY_MULTI = 29,
 	};
 };
 
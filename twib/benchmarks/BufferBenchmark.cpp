@@ -0,0 +1,189 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Streams messages through a connection's input buffer the way
+// SocketMessageConnection and MessageConnection::Process use it: socket reads
+// land in Reserve(8192), and a message is only consumed once all of it is
+// there, with Reserve(payload_size) while waiting for the rest. Counts the
+// bytes the buffer moves around on its own (compaction and growth), not the
+// ones written into it or read out of it.
+//
+// The "old" rows replay util::Buffer from before compaction was bounded,
+// which counts its own copies. The "current" rows watch util::Buffer from
+// outside: when a write moves the unread bytes, those bytes were copied.
+// The old buffer is inlined into the loop here and util::Buffer isn't, which
+// is most of the difference in throughput with tiny payloads.
+//
+// usage: bench-buffer [MiB per run]
+
+#include "Buffer.hpp"
+
+#include<algorithm>
+#include<chrono>
+#include<tuple>
+#include<vector>
+
+#include<stdio.h>
+#include<stdlib.h>
+
+using namespace twili;
+
+namespace {
+
+// util::Buffer's Reserve/MarkWritten/Read/MarkRead as they used to be
+class OldBuffer {
+ public:
+	std::tuple<uint8_t*, size_t> Reserve(size_t size) {
+		if(write_head + size > data.size()) {
+			Compact();
+		}
+		if(write_head + size > data.size()) {
+			if(write_head + size > data.capacity()) {
+				copied+= data.size();
+			}
+			data.resize(write_head + size);
+		}
+		return std::make_tuple(data.data() + write_head, data.size() - write_head);
+	}
+
+	void MarkWritten(size_t size) {
+		write_head+= size;
+	}
+
+	uint8_t *Read() {
+		return data.data() + read_head;
+	}
+
+	void MarkRead(size_t size) {
+		read_head+= size;
+	}
+
+	size_t ReadAvailable() {
+		return write_head - read_head;
+	}
+
+	size_t copied = 0;
+ private:
+	void Compact() {
+		copied+= data.size() - read_head;
+		std::copy(data.begin() + read_head, data.end(), data.begin());
+		write_head-= read_head;
+		read_head = 0;
+	}
+
+	std::vector<uint8_t> data = std::vector<uint8_t>(2048, 0);
+	size_t read_head = 0;
+	size_t write_head = 0;
+};
+
+class WatchedBuffer {
+ public:
+	std::tuple<uint8_t*, size_t> Reserve(size_t size) {
+		uint8_t *before = buffer.Read();
+		size_t live = buffer.ReadAvailable();
+		std::tuple<uint8_t*, size_t> r = buffer.Reserve(size);
+		if(live > 0 && buffer.Read() != before) {
+			copied+= live;
+		}
+		return r;
+	}
+
+	void MarkWritten(size_t size) {
+		buffer.MarkWritten(size);
+	}
+
+	uint8_t *Read() {
+		return buffer.Read();
+	}
+
+	void MarkRead(size_t size) {
+		buffer.MarkRead(size);
+	}
+
+	size_t ReadAvailable() {
+		return buffer.ReadAvailable();
+	}
+
+	size_t copied = 0;
+ private:
+	util::Buffer buffer;
+};
+
+const size_t HeaderSize = 32; // sizeof(protocol::MessageHeader)
+const size_t RecvSize = 0x10000; // most one recv() hands back
+
+template<typename B>
+void Run(const char *name, size_t payload_size, size_t total) {
+	B buffer;
+	size_t message_size = HeaderSize + payload_size;
+	size_t messages = std::max<size_t>(total / message_size, 1);
+	size_t stream_size = messages * message_size;
+
+	size_t received = 0;
+	size_t consumed = 0;
+	bool has_header = false;
+	auto start = std::chrono::steady_clock::now();
+	while(consumed < messages) {
+		// SocketMessageConnection::ConnectionMember::SignalRead
+		std::tuple<uint8_t*, size_t> target = buffer.Reserve(8192);
+		size_t size = std::min({std::get<1>(target), RecvSize, stream_size - received});
+		std::fill_n(std::get<0>(target), size, (uint8_t) received);
+		buffer.MarkWritten(size);
+		received+= size;
+
+		// MessageConnection::Process
+		while(true) {
+			if(!has_header) {
+				if(buffer.ReadAvailable() < HeaderSize) {
+					buffer.Reserve(HeaderSize);
+					break;
+				}
+				buffer.MarkRead(HeaderSize);
+				has_header = true;
+			}
+			if(buffer.ReadAvailable() < payload_size) {
+				buffer.Reserve(payload_size);
+				break;
+			}
+			buffer.MarkRead(payload_size);
+			has_header = false;
+			consumed++;
+		}
+	}
+	auto elapsed = std::chrono::steady_clock::now() - start;
+
+	double mib = (double) stream_size / (1024 * 1024);
+	double seconds = std::chrono::duration<double>(elapsed).count();
+	printf("%-7s %8zu byte payloads: %12.0f bytes copied per MiB, %8.1f MiB/s\n",
+				 name, payload_size, buffer.copied / mib, mib / seconds);
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[]) {
+	size_t total = (argc > 1 ? strtoul(argv[1], nullptr, 0) : 1024) * 1024 * 1024;
+
+	for(size_t payload_size : {0x40, 0x1000, 0x10000, 0x100000, 0x1000000}) {
+		Run<OldBuffer>("old", payload_size, total);
+		Run<WatchedBuffer>("current", payload_size, total);
+	}
+
+	return 0;
+}
@@ -0,0 +1,137 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Measures payload compression the way the bridges use it: how fast
+// CompressPayload and DecompressPayload go and how much they save, for a few
+// kinds of payload at the sizes twili sends. Incompressible payloads show
+// what it costs to try and give up.
+//
+// usage: bench-compression [MiB per row]
+
+#include "Compression.hpp"
+
+#include<chrono>
+#include<random>
+#include<string>
+#include<vector>
+
+#include<stdio.h>
+#include<stdlib.h>
+
+using namespace twili;
+
+namespace {
+
+std::vector<uint8_t> Zeroes(size_t size) {
+	return std::vector<uint8_t>(size, 0);
+}
+
+std::vector<uint8_t> Random(size_t size) {
+	std::mt19937 rng(size);
+	std::vector<uint8_t> data(size);
+	for(uint8_t &b : data) {
+		b = (uint8_t) rng();
+	}
+	return data;
+}
+
+std::vector<uint8_t> Text(size_t size) {
+	std::vector<uint8_t> data;
+	for(size_t i = 0; data.size() < size; i++) {
+		std::string line = "[twili] request " + std::to_string(i) + " for object " + std::to_string(i % 7) + " finished\n";
+		data.insert(data.end(), line.begin(), line.end());
+	}
+	data.resize(size);
+	return data;
+}
+
+// stretches of zeroes, instructions, text and noise, like process memory
+std::vector<uint8_t> Memory(size_t size) {
+	std::vector<uint8_t> data;
+	std::vector<uint8_t> noise = Random(0x800);
+	std::vector<uint8_t> text = Text(0x1000);
+	for(size_t i = 0; data.size() < size; i++) {
+		switch(i % 4) {
+		case 0: data.insert(data.end(), 0x1800, 0); break;
+		case 1: data.insert(data.end(), noise.begin(), noise.end()); break;
+		case 2: data.insert(data.end(), text.begin(), text.end()); break;
+		case 3:
+			for(uint32_t j = 0; j < 0x400; j++) {
+				uint32_t word = 0x94000000 | (j * 37);
+				data.insert(data.end(), (uint8_t*) &word, (uint8_t*) &word + 4);
+			}
+			break;
+		}
+	}
+	data.resize(size);
+	return data;
+}
+
+double MiBPerSecond(size_t bytes, std::chrono::steady_clock::duration elapsed) {
+	return bytes / std::chrono::duration<double>(elapsed).count() / (1024 * 1024);
+}
+
+void Run(const char *name, const std::vector<uint8_t> &data, size_t total) {
+	size_t iterations = std::max<size_t>(total / data.size(), 1);
+	std::vector<uint8_t> compressed;
+	std::vector<uint8_t> decompressed;
+	bool worth_it = false;
+
+	auto start = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < iterations; i++) {
+		worth_it = compression::CompressPayload(data.data(), data.size(), compressed);
+	}
+	auto compress_time = std::chrono::steady_clock::now() - start;
+
+	if(!worth_it) {
+		printf("%-8s %7zu bytes: not compressed, gave up at %8.1f MiB/s\n",
+					 name, data.size(), MiBPerSecond(iterations * data.size(), compress_time));
+		return;
+	}
+
+	start = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < iterations; i++) {
+		if(!compression::DecompressPayload(compressed.data(), compressed.size(), decompressed)) {
+			fprintf(stderr, "failed to decompress %s payload\n", name);
+			exit(1);
+		}
+	}
+	auto decompress_time = std::chrono::steady_clock::now() - start;
+
+	printf("%-8s %7zu bytes: %5.1f%% of original, compress %8.1f MiB/s, decompress %8.1f MiB/s\n",
+				 name, data.size(), 100.0 * compressed.size() / data.size(),
+				 MiBPerSecond(iterations * data.size(), compress_time),
+				 MiBPerSecond(iterations * data.size(), decompress_time));
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[]) {
+	size_t total = (argc > 1 ? strtoul(argv[1], nullptr, 0) : 64) * 1024 * 1024;
+
+	for(size_t size : {0x1000, 0x10000, 0x40000}) {
+		Run("zeroes", Zeroes(size), total);
+		Run("text", Text(size), total);
+		Run("memory", Memory(size), total);
+		Run("random", Random(size), total);
+	}
+
+	return 0;
+}
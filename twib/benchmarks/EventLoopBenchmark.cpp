@@ -0,0 +1,148 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Measures the cost of one event loop wakeup while some number of idle
+// clients sit registered with the loop. Each round trip writes a byte to
+// the one active socket and waits for the event thread to echo it back.
+
+#include "platform/platform.hpp"
+#include "platform/EventLoop.hpp"
+
+#include<algorithm>
+#include<chrono>
+#include<memory>
+#include<vector>
+
+#include<sys/resource.h>
+#include<stdio.h>
+#include<stdlib.h>
+
+using namespace twili;
+
+namespace {
+
+class IdleMember : public platform::EventLoop::SocketMember {
+ public:
+	IdleMember(platform::Socket &&socket) : platform::EventLoop::SocketMember(std::move(socket)) {
+	}
+
+	virtual bool WantsRead() override {
+		return true;
+	}
+};
+
+class EchoMember : public platform::EventLoop::SocketMember {
+ public:
+	EchoMember(platform::Socket &&socket) : platform::EventLoop::SocketMember(std::move(socket)) {
+	}
+
+	virtual bool WantsRead() override {
+		return true;
+	}
+
+	virtual void SignalRead() override {
+		char c;
+		if(socket.Recv(&c, 1, 0) == 1) {
+			socket.Send(&c, 1, 0);
+		}
+	}
+};
+
+class NullLogic : public platform::EventLoop::Logic {
+ public:
+	virtual void Prepare(platform::EventLoop &) override {
+	}
+};
+
+std::pair<platform::Socket, platform::Socket> MakePair() {
+	int fds[2];
+	if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+		fprintf(stderr, "socketpair failed: %s\n", strerror(errno));
+		exit(1);
+	}
+	return std::make_pair(
+		platform::Socket(platform::File(fds[0])),
+		platform::Socket(platform::File(fds[1])));
+}
+
+void RaiseFileLimit(size_t needed) {
+	struct rlimit lim;
+	if(getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < needed) {
+		lim.rlim_cur = std::min<rlim_t>(needed, lim.rlim_max);
+		setrlimit(RLIMIT_NOFILE, &lim);
+	}
+}
+
+void Run(size_t idle_count, size_t round_trips) {
+#if TWIB_EPOLL_EVENT_LOOP_ENABLED == 0
+	if(2 * idle_count + 16 > FD_SETSIZE) {
+		printf("%5zu idle clients: skipped, too many descriptors for select()\n", idle_count);
+		return;
+	}
+#endif
+	
+	NullLogic logic;
+	platform::EventLoop loop(logic);
+
+	// keep the far ends open so the idle members never see a hangup
+	std::vector<platform::Socket> far_ends;
+	std::vector<std::unique_ptr<IdleMember>> idle;
+	for(size_t i = 0; i < idle_count; i++) {
+		auto pair = MakePair();
+		idle.emplace_back(std::make_unique<IdleMember>(std::move(pair.first)));
+		far_ends.emplace_back(std::move(pair.second));
+		loop.AddMember(*idle.back());
+	}
+
+	auto pair = MakePair();
+	EchoMember echo(std::move(pair.first));
+	platform::Socket driver(std::move(pair.second));
+	loop.AddMember(echo);
+	loop.Begin();
+
+	auto start = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < round_trips; i++) {
+		char c = 'x';
+		if(driver.Send(&c, 1, 0) != 1 || driver.Recv(&c, 1, 0) != 1) {
+			fprintf(stderr, "echo failed: %s\n", strerror(errno));
+			exit(1);
+		}
+	}
+	auto elapsed = std::chrono::steady_clock::now() - start;
+
+	loop.Destroy();
+
+	double us = std::chrono::duration<double, std::micro>(elapsed).count();
+	printf("%5zu idle clients: %8.2f us per wakeup (%zu round trips)\n",
+				 idle_count, us / round_trips, round_trips);
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[]) {
+	size_t round_trips = argc > 1 ? strtoul(argv[1], nullptr, 0) : 20000;
+
+	RaiseFileLimit(2 * 1000 + 64);
+	for(size_t idle_count : {10, 100, 1000}) {
+		Run(idle_count, round_trips);
+	}
+
+	return 0;
+}
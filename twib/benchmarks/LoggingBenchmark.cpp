@@ -0,0 +1,125 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Measures what logging costs per request, by pushing pipelined requests
+// through an in-process twibd and a loopback device and timing them with
+// different loggers registered:
+//  - none at all
+//  - twibd's default, which drops Debug and Info
+//  - a logger that wants Debug but throws it away, so every debug message
+//    is formatted for nothing, as all of them used to be
+// Loggers can't be removed once added, so each run adds to the last.
+
+#include "LoopbackDaemon.hpp"
+
+#include "common/Logger.hpp"
+
+#include<chrono>
+#include<condition_variable>
+#include<memory>
+#include<mutex>
+#include<vector>
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<time.h>
+
+#include "SocketClient.hpp"
+#include "RemoteObject.hpp"
+#include "Protocol.hpp"
+
+using namespace twili;
+using namespace twili::twib;
+
+#define STRINGIFY(x) #x
+#define STRINGIFY_VALUE(x) STRINGIFY(x)
+
+namespace {
+
+class DiscardingLogger : public log::Logger {
+ public:
+	virtual void do_log(log::Level, const char *, int, const char *) override {
+	}
+	virtual log::Level get_min_level() override {
+		return log::Level::Debug;
+	}
+};
+
+double CpuSeconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void Run(const char *name, tool::RemoteObject &device, size_t count) {
+	const uint32_t command = (uint32_t) protocol::ITwibDeviceInterface::Command::LIST_PROCESSES;
+	const size_t depth = 32;
+	std::mutex mutex;
+	std::condition_variable condvar;
+	size_t in_flight = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	double cpu_start = CpuSeconds();
+	for(size_t i = 0; i < count; i++) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condvar.wait(lock, [&]() { return in_flight < depth; });
+			in_flight++;
+		}
+		device.SendRequest(
+			command, std::vector<uint8_t>(),
+			[&](tool::Response) {
+				std::lock_guard<std::mutex> lock(mutex);
+				in_flight--;
+				condvar.notify_all();
+			});
+	}
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		condvar.wait(lock, [&]() { return in_flight == 0; });
+	}
+	double cpu = CpuSeconds() - cpu_start;
+	double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("%-24s %8.2f us per request, %8.2f us cpu per request\n",
+				 name, wall * 1e6 / count, cpu * 1e6 / count);
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[]) {
+	size_t count = argc > 1 ? strtoul(argv[1], nullptr, 0) : 50000;
+
+	test::LoopbackDaemon daemon(test::LoopbackDaemon::Options {});
+	tool::client::SocketClient client(daemon.Connect());
+	tool::RemoteObject device(client, daemon.GetDeviceIds()[0], 0);
+
+	printf("built with TWIB_LOG_MIN_LEVEL %s\n", STRINGIFY_VALUE(TWIB_LOG_MIN_LEVEL));
+	Run("no loggers", device, count);
+
+	FILE *null = fopen("/dev/null", "w");
+	log::add_log(std::make_shared<log::PrettyFileLogger>(null, log::Level::Message));
+	Run("default logger", device, count);
+
+	log::add_log(std::make_shared<DiscardingLogger>());
+	Run("format and discard debug", device, count);
+
+	return 0;
+}
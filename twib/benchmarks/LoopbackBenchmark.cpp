@@ -0,0 +1,197 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Measures twibd end to end: the twib client talks to an in-process twibd
+// through its UNIX socket frontend, and twibd talks to a loopback device.
+// Covers request latency, pipelined request rate, file push and pull, and
+// named pipe reads.
+//
+// usage: bench-loopback [MiB to transfer] [device latency in us] [device bandwidth in bytes/s]
+
+#include "LoopbackDaemon.hpp"
+
+#include<algorithm>
+#include<chrono>
+#include<condition_variable>
+#include<functional>
+#include<mutex>
+#include<vector>
+
+#include<stdio.h>
+#include<stdlib.h>
+
+#include "SocketClient.hpp"
+#include "RemoteObject.hpp"
+#include "Protocol.hpp"
+#include "interfaces/ITwibDeviceInterface.hpp"
+#include "interfaces/ITwibFilesystemAccessor.hpp"
+#include "interfaces/ITwibFileAccessor.hpp"
+#include "interfaces/ITwibPipeReader.hpp"
+
+using namespace twili;
+using namespace twili::twib;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double Seconds(Clock::duration d) {
+	return std::chrono::duration<double>(d).count();
+}
+
+// limits how many asynchronous requests are in flight at once
+class Window {
+ public:
+	Window(size_t depth) : depth(depth) {
+	}
+
+	void Acquire() {
+		std::unique_lock<std::mutex> lock(mutex);
+		condvar.wait(lock, [this]() { return in_flight < depth; });
+		in_flight++;
+	}
+
+	void Release(uint32_t r) {
+		if(r != 0) {
+			fprintf(stderr, "request failed: 0x%x\n", r);
+			exit(1);
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		in_flight--;
+		condvar.notify_all();
+	}
+
+	void Drain() {
+		std::unique_lock<std::mutex> lock(mutex);
+		condvar.wait(lock, [this]() { return in_flight == 0; });
+	}
+ private:
+	size_t depth;
+	size_t in_flight = 0;
+	std::mutex mutex;
+	std::condition_variable condvar;
+};
+
+void BenchLatency(tool::RemoteObject &device) {
+	const uint32_t command = (uint32_t) protocol::ITwibDeviceInterface::Command::LIST_PROCESSES;
+	std::vector<double> latencies;
+	for(size_t i = 0; i < 2000; i++) {
+		auto start = Clock::now();
+		device.SendSyncRequest(command);
+		latencies.push_back(Seconds(Clock::now() - start) * 1000000);
+	}
+	std::sort(latencies.begin(), latencies.end());
+	printf("request latency:   %8.1f us median, %8.1f us p99\n",
+				 latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100]);
+}
+
+void BenchRequestRate(tool::RemoteObject &device) {
+	const uint32_t command = (uint32_t) protocol::ITwibDeviceInterface::Command::LIST_PROCESSES;
+	const size_t count = 20000;
+	Window window(32);
+	auto start = Clock::now();
+	for(size_t i = 0; i < count; i++) {
+		window.Acquire();
+		device.SendRequest(
+			command, std::vector<uint8_t>(),
+			[&window](tool::Response r) {
+				window.Release(r.result_code);
+			});
+	}
+	window.Drain();
+	printf("pipelined requests: %8.0f requests/s (32 in flight)\n", count / Seconds(Clock::now() - start));
+}
+
+void BenchFile(tool::ITwibDeviceInterface &itdi, size_t total) {
+	const size_t chunk_size = 0x10000;
+	tool::ITwibFilesystemAccessor fs = itdi.OpenFilesystemAccessor("sd");
+	fs.CreateFile(0, 0, "/bench");
+	tool::ITwibFileAccessor file = fs.OpenFile(6, "/bench");
+
+	std::vector<uint8_t> chunk(chunk_size);
+	for(size_t i = 0; i < chunk.size(); i++) {
+		chunk[i] = (uint8_t) i;
+	}
+
+	Window window(8);
+	auto start = Clock::now();
+	for(size_t offset = 0; offset < total; offset+= chunk_size) {
+		window.Acquire();
+		file.WriteAsync(offset, chunk, [&window](uint32_t r) { window.Release(r); });
+	}
+	window.Drain();
+	printf("file push:         %8.1f MiB/s\n", total / Seconds(Clock::now() - start) / (1024 * 1024));
+
+	size_t received = 0;
+	std::mutex received_mutex;
+	start = Clock::now();
+	for(size_t offset = 0; offset < total; offset+= chunk_size) {
+		window.Acquire();
+		file.ReadAsync(
+			offset, chunk_size,
+			[&](uint32_t r, std::vector<uint8_t> data) {
+				{
+					std::lock_guard<std::mutex> lock(received_mutex);
+					received+= data.size();
+				}
+				window.Release(r);
+			});
+	}
+	window.Drain();
+	printf("file pull:         %8.1f MiB/s\n", total / Seconds(Clock::now() - start) / (1024 * 1024));
+	if(received != total) {
+		fprintf(stderr, "pulled %zu bytes, expected %zu\n", received, total);
+		exit(1);
+	}
+
+	fs.DeleteFile("/bench");
+}
+
+void BenchPipe(tool::ITwibDeviceInterface &itdi, size_t total) {
+	tool::ITwibPipeReader pipe = itdi.OpenNamedPipe("zero");
+	size_t received = 0;
+	auto start = Clock::now();
+	while(received < total) {
+		received+= pipe.ReadSync().size();
+	}
+	printf("named pipe read:   %8.1f MiB/s\n", received / Seconds(Clock::now() - start) / (1024 * 1024));
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[]) {
+	size_t total = (argc > 1 ? strtoul(argv[1], nullptr, 0) : 64) * 1024 * 1024;
+	test::LoopbackDaemon::Options options;
+	options.latency_us = argc > 2 ? strtoull(argv[2], nullptr, 0) : 0;
+	options.bandwidth = argc > 3 ? strtoull(argv[3], nullptr, 0) : 0;
+
+	test::LoopbackDaemon daemon(options);
+	tool::client::SocketClient client(daemon.Connect());
+	std::shared_ptr<tool::RemoteObject> device = std::make_shared<tool::RemoteObject>(client, daemon.GetDeviceIds()[0], 0);
+	tool::ITwibDeviceInterface itdi(device);
+
+	printf("device latency %lu us, bandwidth %lu B/s\n", options.latency_us, options.bandwidth);
+	BenchLatency(*device);
+	BenchRequestRate(*device);
+	BenchFile(itdi, total);
+	BenchPipe(itdi, total);
+
+	return 0;
+}
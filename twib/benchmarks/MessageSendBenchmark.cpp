@@ -0,0 +1,230 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Sends messages over a UNIX socketpair from one or more threads at once,
+// with an event loop pumping the sending end and a plain thread reading the
+// other. The "copy" rows replay how SendMessage used to copy every message
+// into a single out_buffer and write from there; the "gather" rows use
+// SocketMessageConnection, which sends large payloads straight out of their
+// SharedBuffer. The reader checks that each sender's messages arrive whole
+// and in the order they were sent.
+//
+// usage: bench-message-send [MiB per run]
+
+#include "platform/platform.hpp"
+#include "platform/EventLoop.hpp"
+
+#include "common/SocketMessageConnection.hpp"
+#include "common/Semaphore.hpp"
+#include "Buffer.hpp"
+#include "Protocol.hpp"
+
+#include<chrono>
+#include<memory>
+#include<mutex>
+#include<thread>
+#include<type_traits>
+#include<vector>
+
+#include<string.h>
+#include<stdio.h>
+#include<stdlib.h>
+#include<time.h>
+
+using namespace twili;
+using namespace twili::twib;
+
+namespace {
+
+// how MessageConnection and SocketMessageConnection sent messages before
+// they learned to gather
+class CopyingConnection : public platform::EventLoop::SocketMember {
+ public:
+	CopyingConnection(platform::Socket &&socket, const platform::EventLoop::Notifier &notifier) :
+		platform::EventLoop::SocketMember(std::move(socket)),
+		notifier(notifier) {
+	}
+
+	void SendMessage(const protocol::MessageHeader &mh, const common::SharedBuffer &payload) {
+		{
+			std::lock_guard<common::Semaphore> lock(out_buffer_sema);
+			out_buffer.Write(mh);
+			out_buffer.Write(payload.GetVector());
+		}
+		InterestChanged();
+		notifier.Notify();
+	}
+
+	virtual bool WantsWrite() override {
+		std::lock_guard<common::Semaphore> lock(out_buffer_sema);
+		return out_buffer.ReadAvailable() > 0;
+	}
+
+	virtual void SignalWrite() override {
+		std::lock_guard<common::Semaphore> lock(out_buffer_sema);
+		if(out_buffer.ReadAvailable() > 0) {
+			ssize_t r = socket.Send(out_buffer.Read(), out_buffer.ReadAvailable(), 0);
+			if(r > 0) {
+				out_buffer.MarkRead(r);
+			}
+		}
+	}
+ private:
+	const platform::EventLoop::Notifier &notifier;
+	common::Semaphore out_buffer_sema = common::Semaphore(1);
+	util::Buffer out_buffer;
+};
+
+class GatheringConnection {
+ public:
+	GatheringConnection(platform::Socket &&socket, const platform::EventLoop::Notifier &notifier) :
+		connection(std::move(socket), notifier),
+		member(connection.member) {
+	}
+
+	void SendMessage(const protocol::MessageHeader &mh, const common::SharedBuffer &payload) {
+		connection.SendMessage(mh, payload, std::vector<uint32_t>());
+	}
+
+	common::SocketMessageConnection connection;
+	platform::EventLoop::SocketMember &member;
+};
+
+class NullLogic : public platform::EventLoop::Logic {
+ public:
+	virtual void Prepare(platform::EventLoop &) override {
+	}
+};
+
+std::pair<platform::Socket, platform::Socket> MakePair() {
+	int fds[2];
+	if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+		fprintf(stderr, "socketpair failed: %s\n", strerror(errno));
+		exit(1);
+	}
+	return std::make_pair(
+		platform::Socket(platform::File(fds[0])),
+		platform::Socket(platform::File(fds[1])));
+}
+
+void RecvExactly(platform::Socket &socket, uint8_t *data, size_t size) {
+	while(size > 0) {
+		ssize_t r = socket.Recv(data, size, 0);
+		if(r <= 0) {
+			fprintf(stderr, "recv failed: %s\n", strerror(errno));
+			exit(1);
+		}
+		data+= r;
+		size-= r;
+	}
+}
+
+common::SharedBuffer MakePayload(size_t size, uint32_t sender) {
+	std::vector<uint8_t> payload(size);
+	for(size_t i = 0; i < size; i++) {
+		payload[i] = (uint8_t) (i * 7 + sender);
+	}
+	return common::SharedBuffer(std::move(payload));
+}
+
+double CpuSeconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+template<typename Connection>
+void Run(const char *name, size_t senders, size_t payload_size, size_t total) {
+	size_t messages = std::max<size_t>(total / senders / payload_size, 1);
+	std::vector<common::SharedBuffer> payloads;
+	for(size_t i = 0; i < senders; i++) {
+		payloads.push_back(MakePayload(payload_size, i));
+	}
+
+	NullLogic logic;
+	platform::EventLoop loop(logic);
+	auto pair = MakePair();
+	Connection connection(std::move(pair.first), loop.GetNotifier());
+	platform::Socket reader(std::move(pair.second));
+	if constexpr(std::is_same<Connection, GatheringConnection>::value) {
+		loop.AddMember(connection.member);
+	} else {
+		loop.AddMember(connection);
+	}
+	loop.Begin();
+
+	auto start = std::chrono::steady_clock::now();
+	double cpu_start = CpuSeconds();
+	std::vector<std::thread> threads;
+	for(size_t i = 0; i < senders; i++) {
+		threads.emplace_back([&connection, &payloads, i, messages]() {
+				for(size_t tag = 0; tag < messages; tag++) {
+					protocol::MessageHeader mh = {};
+					mh.client_id = i;
+					mh.tag = tag;
+					mh.payload_size = payloads[i].size();
+					connection.SendMessage(mh, payloads[i]);
+				}
+			});
+	}
+
+	std::vector<uint32_t> next_tag(senders, 0);
+	std::vector<uint8_t> payload(payload_size);
+	for(size_t received = 0; received < senders * messages; received++) {
+		protocol::MessageHeader mh;
+		RecvExactly(reader, (uint8_t*) &mh, sizeof(mh));
+		if(mh.client_id >= senders || mh.tag != next_tag[mh.client_id] || mh.payload_size != payload_size) {
+			fprintf(stderr, "bad message from sender %u (tag %u)\n", mh.client_id, mh.tag);
+			exit(1);
+		}
+		RecvExactly(reader, payload.data(), payload.size());
+		if(memcmp(payload.data(), payloads[mh.client_id].data(), payload.size()) != 0) {
+			fprintf(stderr, "bad payload from sender %u (tag %u)\n", mh.client_id, mh.tag);
+			exit(1);
+		}
+		next_tag[mh.client_id]++;
+	}
+	double cpu = CpuSeconds() - cpu_start;
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	for(std::thread &thread : threads) {
+		thread.join();
+	}
+	loop.Destroy();
+
+	double mib = (double) (senders * messages * payload_size) / (1024 * 1024);
+	printf("%-6s %zu sender(s) %8zu byte payloads: %8.1f MiB/s, %6.3f cpu seconds per GiB\n",
+				 name, senders, payload_size, mib / seconds, cpu * 1024 / mib);
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[]) {
+	size_t total = (argc > 1 ? strtoul(argv[1], nullptr, 0) : 256) * 1024 * 1024;
+
+	for(size_t senders : {1, 4}) {
+		for(size_t payload_size : {0x1000, 0x10000, 0x100000, 0x4000000}) {
+			Run<CopyingConnection>("copy", senders, payload_size, total);
+			Run<GatheringConnection>("gather", senders, payload_size, total);
+		}
+	}
+
+	return 0;
+}
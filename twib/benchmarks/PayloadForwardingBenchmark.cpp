@@ -0,0 +1,235 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Forwards payloads through the hops a request and its response take inside
+// twibd (frontend, dispatch queue, backend pending table, and back out to the
+// client) and counts the payload bytes copied on the way. The "vector" rows
+// replay how those hops passed std::vector payloads around by value; the
+// "shared" rows use the real daemon messages. Reads from and writes to the
+// socket buffers happen in both and aren't counted.
+//
+// Every payload copy is a fresh allocation of the whole payload, so copies
+// are counted by watching operator new for payload-sized allocations.
+
+#include "Messages.hpp"
+
+#include "Buffer.hpp"
+
+#include<chrono>
+#include<deque>
+#include<memory>
+#include<new>
+#include<unordered_map>
+#include<vector>
+
+#include<stdio.h>
+#include<stdlib.h>
+
+using namespace twili;
+using namespace twili::twib;
+
+namespace {
+
+size_t count_threshold = SIZE_MAX;
+size_t counted_bytes = 0;
+
+} // anonymous namespace
+
+void *operator new(size_t size) {
+	if(size >= count_threshold) {
+		counted_bytes+= size;
+	}
+	void *ptr = malloc(size ? size : 1);
+	if(!ptr) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+	free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+	free(ptr);
+}
+
+namespace {
+
+// how the messages looked when they held their payloads by value
+struct VectorResponse {
+	VectorResponse() {
+	}
+	VectorResponse(uint32_t client_id, uint32_t tag, std::vector<uint8_t> payload) :
+		client_id(client_id), tag(tag), payload(payload) {
+	}
+	uint32_t client_id;
+	uint32_t tag;
+	std::vector<uint8_t> payload;
+};
+
+struct VectorWeakRequest {
+	VectorWeakRequest(uint32_t client_id, uint32_t tag, std::vector<uint8_t> payload) :
+		client_id(client_id), tag(tag), payload(payload) {
+	}
+	uint32_t client_id;
+	uint32_t tag;
+	std::vector<uint8_t> payload;
+};
+
+struct VectorRequest {
+	VectorRequest(uint32_t client_id, uint32_t tag, std::vector<uint8_t> payload) :
+		client_id(client_id), tag(tag), payload(payload) {
+	}
+	VectorWeakRequest Weak() const {
+		return VectorWeakRequest(client_id, tag, payload);
+	}
+	uint32_t client_id;
+	uint32_t tag;
+	std::vector<uint8_t> payload;
+};
+
+class BenchClient : public daemon::Client {
+ public:
+	virtual void PostResponse(daemon::Response &r) override {
+		out.Write(r.payload.GetVector());
+	}
+	util::Buffer out;
+};
+
+uint64_t PendingKey(uint32_t client_id, uint32_t tag) {
+	return ((uint64_t) client_id << 32) | tag;
+}
+
+// stands in for a socket read landing in a connection's receive buffer
+void Receive(util::Buffer &buffer, const std::vector<uint8_t> &wire) {
+	buffer.Clear();
+	buffer.Write(wire);
+}
+
+void WriteByValue(util::Buffer &buffer, std::vector<uint8_t> payload) {
+	buffer.Write(payload);
+}
+
+void ForwardVector(const std::vector<uint8_t> &wire, uint32_t tag) {
+	static util::Buffer in, out;
+	static std::deque<VectorRequest> request_queue;
+	static std::deque<VectorResponse> response_queue;
+	static std::unordered_map<uint64_t, VectorWeakRequest> pending;
+
+	// frontend reads a request
+	Receive(in, wire);
+	count_threshold = wire.size();
+	request_queue.push_back(VectorRequest(1, tag, std::vector<uint8_t>(in.Read(), in.Read() + in.ReadAvailable())));
+	in.Clear();
+
+	// daemon hands it to the backend
+	VectorRequest rq = request_queue.front();
+	request_queue.pop_front();
+	pending.emplace(PendingKey(rq.client_id, rq.tag), rq.Weak());
+	out.Clear();
+	WriteByValue(out, rq.payload);
+	count_threshold = SIZE_MAX;
+
+	// backend reads the response
+	Receive(in, wire);
+	count_threshold = wire.size();
+	VectorResponse r;
+	r.client_id = 1;
+	r.tag = tag;
+	r.payload = std::vector<uint8_t>(in.Read(), in.Read() + in.ReadAvailable());
+	in.Clear();
+	pending.erase(PendingKey(r.client_id, r.tag));
+	response_queue.push_back(r);
+
+	// daemon hands it to the client
+	VectorResponse rs = response_queue.front();
+	response_queue.pop_front();
+	out.Clear();
+	WriteByValue(out, rs.payload);
+	count_threshold = SIZE_MAX;
+}
+
+void ForwardShared(const std::vector<uint8_t> &wire, uint32_t tag) {
+	static std::shared_ptr<BenchClient> client = std::make_shared<BenchClient>();
+	static util::Buffer in;
+	static std::deque<daemon::Request> request_queue;
+	static std::deque<daemon::Response> response_queue;
+	static std::unordered_map<uint64_t, daemon::WeakRequest> pending;
+	client->client_id = 1;
+
+	Receive(in, wire);
+	count_threshold = wire.size();
+	request_queue.push_back(daemon::Request(client, 0, 0, 0, tag, in.TakeData()));
+
+	daemon::Request rq = std::move(request_queue.front());
+	request_queue.pop_front();
+	pending.emplace(PendingKey(rq.client->client_id, rq.tag), rq.Weak());
+	client->out.Clear();
+	client->out.Write(rq.payload.GetVector());
+	count_threshold = SIZE_MAX;
+
+	Receive(in, wire);
+	count_threshold = wire.size();
+	daemon::Response r;
+	r.client_id = 1;
+	r.tag = tag;
+	r.payload = in.TakeData();
+	pending.erase(PendingKey(r.client_id, r.tag));
+	response_queue.push_back(std::move(r));
+
+	daemon::Response rs = std::move(response_queue.front());
+	response_queue.pop_front();
+	client->out.Clear();
+	client->PostResponse(rs);
+	count_threshold = SIZE_MAX;
+}
+
+void Run(const char *name, void (*forward)(const std::vector<uint8_t>&, uint32_t), size_t payload_size, size_t total) {
+	std::vector<uint8_t> wire(payload_size, 0x5a);
+	size_t iterations = std::max<size_t>(total / (2 * payload_size), 1);
+
+	forward(wire, 0); // warm up the buffers
+	counted_bytes = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < iterations; i++) {
+		forward(wire, (uint32_t) i + 1);
+	}
+	auto elapsed = std::chrono::steady_clock::now() - start;
+
+	double forwarded_mib = (double) (2 * payload_size * iterations) / (1024 * 1024);
+	double seconds = std::chrono::duration<double>(elapsed).count();
+	printf("%-6s %8zu byte payloads: %10.0f bytes copied per forwarded MiB, %8.1f MiB/s\n",
+				 name, payload_size, counted_bytes / forwarded_mib, forwarded_mib / seconds);
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[]) {
+	size_t total = (argc > 1 ? strtoul(argv[1], nullptr, 0) : 1024) * 1024 * 1024;
+
+	for(size_t payload_size : {0x1000, 0x10000, 0x100000, 0x800000}) {
+		Run("vector", ForwardVector, payload_size, total);
+		Run("shared", ForwardShared, payload_size, total);
+	}
+
+	return 0;
+}
@@ -0,0 +1,133 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Measures what it costs the TCP backend to match a response up with its
+// pending request, with some number of requests outstanding. The "list"
+// rows do what TCPBackend::Device::IncomingMessage used to (remove_if over
+// a list of WeakRequests), the "map" rows do what it does now (look up the
+// (client_id, tag) key in an unordered_map). Every response is followed by
+// a new request, so the number outstanding stays fixed.
+
+#include "Messages.hpp"
+
+#include<algorithm>
+#include<chrono>
+#include<list>
+#include<random>
+#include<unordered_map>
+#include<vector>
+
+#include<stdio.h>
+#include<stdlib.h>
+
+using namespace twili::twib::daemon;
+
+namespace {
+
+struct Key {
+	uint32_t client_id;
+	uint32_t tag;
+};
+
+class ListTable {
+ public:
+	void Add(const Key &k) {
+		pending.push_back(WeakRequest(k.client_id, 1, 0, 0, k.tag));
+	}
+
+	void Complete(const Key &k) {
+		pending.remove_if([&k](WeakRequest &r) {
+				return r.tag == k.tag;
+			});
+	}
+ private:
+	std::list<WeakRequest> pending;
+};
+
+class MapTable {
+ public:
+	void Add(const Key &k) {
+		pending[PendingKey(k.client_id, k.tag)] = PendingRequest {
+			WeakRequest(k.client_id, 1, 0, 0, k.tag),
+			std::chrono::steady_clock::now()};
+	}
+
+	void Complete(const Key &k) {
+		auto i = pending.find(PendingKey(k.client_id, k.tag));
+		if(i != pending.end()) {
+			pending.erase(i);
+		}
+	}
+ private:
+	struct PendingRequest {
+		WeakRequest request;
+		std::chrono::steady_clock::time_point sent;
+	};
+
+	static uint64_t PendingKey(uint32_t client_id, uint32_t tag) {
+		return ((uint64_t) client_id << 32) | tag;
+	}
+
+	std::unordered_map<uint64_t, PendingRequest> pending;
+};
+
+template<typename Table>
+void Run(const char *name, size_t outstanding, size_t responses) {
+	std::mt19937 rng(outstanding);
+	Table table;
+	std::vector<Key> keys;
+	for(size_t i = 0; i < outstanding; i++) {
+		keys.push_back({(uint32_t) rng() % 8, (uint32_t) rng()});
+		table.Add(keys.back());
+	}
+
+	// decide the response order up front so the rng isn't timed
+	std::vector<size_t> order(responses);
+	std::vector<Key> replacements(responses);
+	for(size_t i = 0; i < responses; i++) {
+		order[i] = rng() % outstanding;
+		replacements[i] = {(uint32_t) rng() % 8, (uint32_t) rng()};
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < responses; i++) {
+		Key &k = keys[order[i]];
+		table.Complete(k);
+		k = replacements[i];
+		table.Add(k);
+	}
+	auto elapsed = std::chrono::steady_clock::now() - start;
+
+	double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+	printf("%-4s %6zu outstanding: %10.1f ns per response\n", name, outstanding, ns / responses);
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[]) {
+	size_t responses = argc > 1 ? strtoul(argv[1], nullptr, 0) : 20000;
+
+	for(size_t outstanding : {1, 100, 10000}) {
+		Run<ListTable>("list", outstanding, responses);
+		Run<MapTable>("map", outstanding, responses);
+	}
+
+	return 0;
+}
@@ -48,6 +48,7 @@ namespace log {
 const size_t BUFFER_SIZE = 2048;
 
 std::forward_list<std::shared_ptr<Logger>> logs;
+std::atomic<Level> min_enabled_level(Level::Max);
 
 void init_color() {
 #ifdef _WIN32
@@ -138,6 +139,10 @@ char *Logger::format(char *buf, int size, bool color, Level lvl, const char *fna
 Logger::~Logger() {
 }
 
+Level Logger::get_min_level() {
+  return Level::Debug;
+}
+
 FileLogger::FileLogger(FILE *fp, Level minlvl, Level maxlvl) {
   this->file = fp;
   this->minlevel = minlvl;
@@ -148,6 +153,10 @@ FileLogger::~FileLogger() {
   fclose(this->file);
 }
 
+Level FileLogger::get_min_level() {
+  return this->minlevel;
+}
+
 void FileLogger::do_log(Level lvl, const char *fname, int line, const char *msg) {
   if(lvl >= this->minlevel && lvl < this->maxlevel) {
     char buf[BUFFER_SIZE + 256];
@@ -166,6 +175,9 @@ void PrettyFileLogger::do_log(Level lvl, const char *fname, int line, const char
 
 #if WITH_SYSTEMD == 1
 void SystemdLogger::do_log(Level lvl, const char *fname, int line, const char *msg) {
+	if(lvl < this->minlevel || lvl >= this->maxlevel) {
+		return;
+	}
 	const char *lvl_str;
 	switch(lvl) {
 	case Level::Debug:   lvl_str = SD_DEBUG; break;
@@ -183,6 +195,9 @@ void SystemdLogger::do_log(Level lvl, const char *fname, int line, const char *m
 
 void add_log(std::shared_ptr<Logger> l) {
   logs.push_front(l);
+  if(l->get_min_level() < min_enabled_level) {
+    min_enabled_level = l->get_min_level();
+  }
 }
 
 } // namespace log
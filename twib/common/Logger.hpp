@@ -20,6 +20,7 @@
 
 #pragma once
 
+#include<atomic>
 #include<memory>
 #include<ostream>
 
@@ -82,14 +83,24 @@ enum class Level {
 	Max
 };
 
+// Messages below TWIB_LOG_MIN_LEVEL are compiled out entirely, and messages
+// that no logger would accept are dropped before their arguments are
+// evaluated or formatted.
 #define LogMessage(lvl, format, ...) \
-	_log(::twili::log::Level::lvl, __FILE__, __LINE__,	\
-			 format, ##__VA_ARGS__);
+	do { \
+		if(::twili::log::Level::lvl >= ::twili::log::Level::TWIB_LOG_MIN_LEVEL && \
+			 ::twili::log::is_enabled(::twili::log::Level::lvl)) { \
+			::twili::log::_log(::twili::log::Level::lvl, __FILE__, __LINE__,	\
+												 format, ##__VA_ARGS__); \
+		} \
+	} while(0)
 
 class Logger {
  public:
 	virtual ~Logger();
 	virtual void do_log(Level lvl, const char *fname, int line, const char *msg) = 0;
+	// lowest level this logger will ever output
+	virtual Level get_min_level();
  protected:
 	char *format(char *buf, int size, bool use_color, Level lvl, const char *fname, int line, const char *msg);
 };
@@ -100,6 +111,7 @@ class FileLogger : public Logger {
 	virtual ~FileLogger();
 
 	virtual void do_log(Level lvl, const char *fname, int line, const char *msg);
+	virtual Level get_min_level();
  protected:
 	FILE *file;
 	Level minlevel;
@@ -123,6 +135,13 @@ class SystemdLogger : public FileLogger {
 };
 #endif // WITH_SYSTEMD == 1
 
+// lowest level accepted by any registered logger
+extern std::atomic<Level> min_enabled_level;
+
+inline bool is_enabled(Level lvl) {
+	return lvl >= min_enabled_level.load(std::memory_order_relaxed);
+}
+
 void _log(Level lvl, const char *fname, int line, const char *format, ...);
 void add_log(std::shared_ptr<Logger> l);
 void init_color();
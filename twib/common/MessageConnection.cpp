@@ -20,6 +20,10 @@
 
 #include "MessageConnection.hpp"
 
+#include<algorithm>
+
+#include "Compression.hpp"
+
 namespace twili {
 namespace twib {
 namespace common {
@@ -37,6 +41,8 @@ MessageConnection::Request *MessageConnection::Process() {
 				has_current_mh = true;
 				current_rq.payload.Clear();
 				has_current_payload = false;
+				payload_compressed = current_rq.mh.payload_size & protocol::PAYLOAD_COMPRESSED;
+				current_rq.mh.payload_size&= ~protocol::PAYLOAD_COMPRESSED;
 			} else {
 				in_buffer.Reserve(sizeof(protocol::MessageHeader));
 				if(RequestInput()) { continue; }
@@ -48,6 +54,10 @@ MessageConnection::Request *MessageConnection::Process() {
 			if(in_buffer.Read(current_rq.payload, current_rq.mh.payload_size)) {
 				has_current_payload = true;
 				current_rq.object_ids.Clear();
+				if(payload_compressed && !DecompressPayload()) {
+					error_flag = true;
+					return nullptr;
+				}
 			} else {
 				in_buffer.Reserve(current_rq.mh.payload_size);
 				if(RequestInput()) { continue; }
@@ -68,16 +78,108 @@ MessageConnection::Request *MessageConnection::Process() {
 	return nullptr;
 }
 
+bool MessageConnection::DecompressPayload() {
+	std::vector<uint8_t> decompressed;
+	if(!compression::DecompressPayload(current_rq.payload.Read(), current_rq.payload.ReadAvailable(), decompressed)) {
+		LogMessage(Error, "bad compressed payload");
+		return false;
+	}
+	current_rq.mh.payload_size = decompressed.size();
+	current_rq.payload = util::Buffer(std::move(decompressed));
+	return true;
+}
+
 void MessageConnection::SendMessage(const protocol::MessageHeader &mh, const std::vector<uint8_t> &payload, const std::vector<uint32_t> &object_ids) {
+	QueueMessage(mh, payload.data(), payload.size(), SharedBuffer(), object_ids);
+}
+
+void MessageConnection::SendMessage(const protocol::MessageHeader &mh, const SharedBuffer &payload, const std::vector<uint32_t> &object_ids) {
+	QueueMessage(mh, payload.data(), payload.size(), payload, object_ids);
+}
+
+void MessageConnection::QueueMessage(protocol::MessageHeader mh, const uint8_t *payload, size_t size, SharedBuffer storage, const std::vector<uint32_t> &object_ids) {
+	std::vector<uint8_t> compressed;
+	if(compression_enabled && compression::CompressPayload(payload, size, compressed)) {
+		storage = SharedBuffer(std::move(compressed));
+		payload = storage.data();
+		size = storage.size();
+		mh.payload_size = size | protocol::PAYLOAD_COMPRESSED;
+	}
+
+	bool vectored = size >= VectoredPayloadThreshold;
+	if(vectored && storage.size() == 0) {
+		// the caller's storage won't outlive this call, so this is the one
+		// copy we can't avoid. at least make it outside the lock.
+		storage = SharedBuffer(std::vector<uint8_t>(payload, payload + size));
+	}
+	
 	{
 		std::lock_guard<Semaphore> lock(out_buffer_sema);
-		out_buffer.Write(mh);
-		out_buffer.Write(payload);
-		out_buffer.Write(object_ids);
+		BatchBuffer().Write(mh);
+		if(vectored) {
+			OutputSegment &segment = out_queue.emplace_back();
+			segment.payload = storage;
+			segment.is_payload = true;
+		} else {
+			BatchBuffer().Write(payload, size);
+		}
+		if(!object_ids.empty()) {
+			BatchBuffer().Write(object_ids);
+		}
 	}
 	RequestOutput();
 }
 
+util::Buffer &MessageConnection::BatchBuffer() {
+	if(out_queue.empty() || out_queue.back().is_payload) {
+		out_queue.emplace_back();
+	}
+	return out_queue.back().buffer;
+}
+
+bool MessageConnection::HasOutput() {
+	for(OutputSegment &segment : out_queue) {
+		if(segment.is_payload || segment.buffer.ReadAvailable() > 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+size_t MessageConnection::GatherOutput(std::tuple<const uint8_t*, size_t> *segments, size_t max) {
+	size_t count = 0;
+	for(auto i = out_queue.begin(); i != out_queue.end() && count < max; i++) {
+		if(i->is_payload) {
+			segments[count++] = std::make_tuple(i->payload.data() + i->payload_offset, i->payload.size() - i->payload_offset);
+		} else if(i->buffer.ReadAvailable() > 0) {
+			segments[count++] = std::make_tuple((const uint8_t*) i->buffer.Read(), i->buffer.ReadAvailable());
+		}
+	}
+	return count;
+}
+
+void MessageConnection::MarkOutputSent(size_t size) {
+	while(!out_queue.empty()) {
+		OutputSegment &segment = out_queue.front();
+		if(segment.is_payload) {
+			size_t amount = std::min(size, segment.payload.size() - segment.payload_offset);
+			segment.payload_offset+= amount;
+			size-= amount;
+			if(segment.payload_offset < segment.payload.size()) {
+				break;
+			}
+		} else {
+			size_t amount = std::min(size, segment.buffer.ReadAvailable());
+			segment.buffer.MarkRead(amount);
+			size-= amount;
+			if(segment.buffer.ReadAvailable() > 0 || out_queue.size() == 1) {
+				break; // keep the last batch buffer around to reuse it
+			}
+		}
+		out_queue.pop_front();
+	}
+}
+
 } // namespace common
 } // namespace twib
 } // namespace twili
@@ -20,13 +20,17 @@
 
 #pragma once
 
+#include<atomic>
+#include<deque>
 #include<mutex>
 #include<memory>
 #include<optional>
+#include<tuple>
 
 #include "Semaphore.hpp"
 #include "Protocol.hpp"
 #include "Buffer.hpp"
+#include "SharedBuffer.hpp"
 #include "Logger.hpp"
 
 namespace twili {
@@ -49,22 +53,52 @@ class MessageConnection {
 	Request *Process(); // NULL pointer means no message
 
 	void SendMessage(const protocol::MessageHeader &mh, const std::vector<uint8_t> &payload, const std::vector<uint32_t> &object_ids);
+	// large payloads are sent straight out of the shared storage instead of
+	// being copied into the output queue
+	void SendMessage(const protocol::MessageHeader &mh, const SharedBuffer &payload, const std::vector<uint32_t> &object_ids);
 
 	bool error_flag = false;
+	// whether we may compress outgoing payloads. incoming compressed payloads
+	// are always accepted.
+	std::atomic<bool> compression_enabled = false;
  protected:
 	util::Buffer in_buffer;
 
+	// guards the output queue. the output functions below expect it to be held.
 	Semaphore out_buffer_sema;
-	util::Buffer out_buffer;
+	bool HasOutput();
+	// fills `segments` with up to `max` pointers into queued output, in
+	// order, and returns how many it filled.
+	size_t GatherOutput(std::tuple<const uint8_t*, size_t> *segments, size_t max);
+	void MarkOutputSent(size_t size);
 
 	// these turn true if more data was obtained
 	virtual bool RequestInput() = 0;
 	virtual bool RequestOutput() = 0;
 
  private:
+	static const size_t VectoredPayloadThreshold = 16 * 1024;
+	
+	// Outgoing data, in order. Small messages are batched together into
+	// buffer segments, while large payloads get segments of their own that
+	// point into their shared storage.
+	struct OutputSegment {
+		util::Buffer buffer;
+		SharedBuffer payload;
+		size_t payload_offset = 0;
+		bool is_payload = false;
+	};
+	std::deque<OutputSegment> out_queue;
+	
+	void QueueMessage(protocol::MessageHeader mh, const uint8_t *payload, size_t size, SharedBuffer storage, const std::vector<uint32_t> &object_ids);
+	util::Buffer &BatchBuffer();
+	
+	bool DecompressPayload();
+	
 	Request current_rq;
 	bool has_current_mh = false;
 	bool has_current_payload = false;
+	bool payload_compressed = false;
 };
 
 } // namespace common
@@ -107,7 +107,7 @@ void NamedPipeMessageConnection::OutputMember::Signal() {
 	}
 
 	LogMessage(Debug, "wrote 0x%x bytes", bytes_transferred);
-	connection.out_buffer.MarkRead(bytes_transferred);
+	connection.MarkOutputSent(bytes_transferred);
 	connection.out_buffer_sema.notify();
 	connection.is_writing = false;
 }
@@ -153,10 +153,12 @@ bool NamedPipeMessageConnection::RequestOutput() {
 	if(!is_writing) {
 		out_buffer_sema.wait();
 		LogMessage(Debug, "locked out_buffer_lock");
-		if(out_buffer.ReadAvailable() > 0) {
+		// named pipes can't gather, so write one segment at a time
+		std::tuple<const uint8_t*, size_t> segment;
+		if(GatherOutput(&segment, 1) > 0) {
 			DWORD bytes_written;
-			if(WriteFile(pipe.handle, (void*)out_buffer.Read(), out_buffer.ReadAvailable(), &bytes_written, &output_member.overlap)) {
-				out_buffer.MarkRead(bytes_written);
+			if(WriteFile(pipe.handle, (void*) std::get<0>(segment), std::get<1>(segment), &bytes_written, &output_member.overlap)) {
+				MarkOutputSent(bytes_written);
 				out_buffer_sema.notify();
 				LogMessage(Debug, "completed synchronously");
 				return true;
@@ -0,0 +1,71 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<vector>
+#include<memory>
+
+#include<stdint.h>
+
+namespace twili {
+namespace twib {
+namespace common {
+
+// Immutable, reference-counted byte buffer. Copies share the same storage,
+// so a message payload can be handed between frontends, the daemon, and
+// backends without the bytes themselves ever being copied.
+class SharedBuffer {
+ public:
+	SharedBuffer() {
+	}
+	
+	SharedBuffer(std::vector<uint8_t> &&data) :
+		storage(std::make_shared<const std::vector<uint8_t>>(std::move(data))) {
+	}
+
+	const std::vector<uint8_t> &GetVector() const {
+		static const std::vector<uint8_t> empty;
+		return storage ? *storage : empty;
+	}
+
+	const uint8_t *data() const {
+		return GetVector().data();
+	}
+	
+	size_t size() const {
+		return GetVector().size();
+	}
+
+	std::vector<uint8_t>::const_iterator begin() const {
+		return GetVector().begin();
+	}
+
+	std::vector<uint8_t>::const_iterator end() const {
+		return GetVector().end();
+	}
+	
+ private:
+	std::shared_ptr<const std::vector<uint8_t>> storage;
+};
+
+} // namespace common
+} // namespace twib
+} // namespace twili
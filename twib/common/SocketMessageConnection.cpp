@@ -38,8 +38,8 @@ bool SocketMessageConnection::ConnectionMember::WantsRead() {
 }
 
 bool SocketMessageConnection::ConnectionMember::WantsWrite() {
-	std::lock_guard<Semaphore> lock(connection.out_buffer_sema); // ReadAvailable() might not be atomic
-	return connection.out_buffer.ReadAvailable() > 0;
+	std::lock_guard<Semaphore> lock(connection.out_buffer_sema);
+	return connection.HasOutput();
 }
 
 void SocketMessageConnection::ConnectionMember::SignalRead() {
@@ -53,16 +53,18 @@ void SocketMessageConnection::ConnectionMember::SignalRead() {
 }
 
 void SocketMessageConnection::ConnectionMember::SignalWrite() {
-	LogMessage(Debug, "pumping out 0x%lx bytes", connection.out_buffer.ReadAvailable());
 	std::lock_guard<Semaphore> lock(connection.out_buffer_sema);
-	if(connection.out_buffer.ReadAvailable() > 0) {
-		ssize_t r = socket.Send(connection.out_buffer.Read(), connection.out_buffer.ReadAvailable(), 0);
+	std::tuple<const uint8_t*, size_t> segments[MaxSendSegments];
+	size_t count = connection.GatherOutput(segments, MaxSendSegments);
+	if(count > 0) {
+		LogMessage(Debug, "pumping out %zu segments", count);
+		ssize_t r = socket.Send(segments, count, 0);
 		if(r < 0) {
 			connection.error_flag = true;
 			return;
 		}
 		if(r > 0) {
-			connection.out_buffer.MarkRead(r);
+			connection.MarkOutputSent(r);
 		}
 	}
 }
@@ -78,6 +80,7 @@ bool SocketMessageConnection::RequestInput() {
 }
 
 bool SocketMessageConnection::RequestOutput() {
+	member.InterestChanged();
 	notifier.Notify();
 	return false;
 }
@@ -44,6 +44,7 @@ class SocketMessageConnection : public MessageConnection {
 		virtual void SignalWrite() override;
 		virtual void SignalError() override;
 	 private:
+		static const size_t MaxSendSegments = 16;
 		SocketMessageConnection &connection;
 	} member;
 
@@ -27,36 +27,22 @@
 #include<stdlib.h>
 #include<string.h>
 
-#if WITH_SYSTEMD == 1
-#include<systemd/sd-daemon.h>
-#endif
-
-#if WITH_LAUNCHD == 1
-#include<launch.h>
-#endif
-
 #include<msgpack11.hpp>
-#include<CLI/CLI.hpp>
-
-#if TWIB_NAMED_PIPE_FRONTEND_ENABLED == 1
-#include "NamedPipeFrontend.hpp"
-#endif
 
-#include "SocketFrontend.hpp"
 #include "Protocol.hpp"
 #include "err.hpp"
 
 #include <iostream>
 #include <ostream>
 #include <string>
-#include <csignal>
 
 namespace twili {
 namespace twib {
 namespace daemon {
 
-Daemon::Daemon() :
-	local_client(std::make_shared<LocalClient>(*this))
+Daemon::Daemon(size_t dispatch_threads) :
+	local_client(std::make_shared<LocalClient>(*this)),
+	dispatch_running(true)
 // this comma placement is really gross, but for some reason C++ doesn't seem to allow commas at the end of member initializer lists
 #if TWIBD_TCP_BACKEND_ENABLED
 	, tcp(*this)
@@ -66,8 +52,27 @@ Daemon::Daemon() :
 #endif
 #if TWIBD_LIBUSBK_BACKEND_ENABLED
 	, usbk(*this)
+#endif
+#if TWIBD_LOOPBACK_BACKEND_ENABLED
+	, loopback(*this)
 #endif
 	{
+	dispatch_queues.resize(std::max(dispatch_threads, (size_t) 1));
+	for(auto &queue : dispatch_queues) {
+		queue = std::make_unique<JobQueue>();
+	}
+	for(size_t i = 1; i < dispatch_queues.size(); i++) {
+		JobQueue &queue = *dispatch_queues[i];
+		this->dispatch_threads.emplace_back(
+			[this, &queue]() {
+				while(dispatch_running) {
+					Job job;
+					queue.wait_dequeue(job);
+					Dispatch(job);
+				}
+			});
+	}
+	
 	AddClient(local_client);
 #if TWIBD_LIBUSB_BACKEND_ENABLED
 	usb.Probe();
@@ -75,10 +80,20 @@ Daemon::Daemon() :
 #if TWIBD_LIBUSBK_BACKEND_ENABLED
 	usbk.Probe();
 #endif
+#if TWIBD_LOOPBACK_BACKEND_ENABLED
+	loopback.Probe();
+#endif
 }
 
 Daemon::~Daemon() {
 	LogMessage(Debug, "destroying twibd");
+	dispatch_running = false;
+	for(size_t i = 1; i < dispatch_queues.size(); i++) {
+		dispatch_queues[i]->enqueue(std::monostate {});
+	}
+	for(auto &thread : dispatch_threads) {
+		thread.join();
+	}
 }
 
 void Daemon::AddDevice(std::shared_ptr<Device> device) {
@@ -110,21 +125,29 @@ void Daemon::AddClient(std::shared_ptr<Client> client) {
 }
 
 void Daemon::Awaken() {
-	dispatch_queue.enqueue(std::monostate {});
+	dispatch_queues[0]->enqueue(std::monostate {});
 }
 
 void Daemon::PostRequest(Request &&request) {
-	dispatch_queue.enqueue(request);
+	QueueForDevice(request.device_id).enqueue(std::move(request));
 }
 
 void Daemon::PostResponse(Response &&response) {
-	dispatch_queue.enqueue(response);
+	QueueForDevice(response.device_id).enqueue(std::move(response));
+}
+
+Daemon::JobQueue &Daemon::QueueForDevice(uint32_t device_id) {
+	return *dispatch_queues[device_id % dispatch_queues.size()];
 }
 
 void Daemon::RemoveClient(std::shared_ptr<Client> client) {
-	std::lock_guard<std::mutex> lock(client_map_mutex);
-	clients.erase(clients.find(client->client_id));
-	LogMessage(Info, "removing client %08x", client->client_id);
+	{
+		std::lock_guard<std::mutex> lock(client_map_mutex);
+		clients.erase(clients.find(client->client_id));
+		LogMessage(Info, "removing client %08x", client->client_id);
+	}
+	// don't wait for the last reference to the client to close its objects
+	client->ReleaseObjects();
 }
 
 void Daemon::RemoveDevice(std::shared_ptr<Device> device) {
@@ -141,11 +164,14 @@ template<class... Ts> struct overloaded : Ts... { using Ts::operator()...; };
 template<class... Ts> overloaded(Ts...) -> overloaded<Ts...>;
 
 void Daemon::Process() {
-	std::variant<std::monostate, Request, Response> v;
+	Job job;
 	LogMessage(Debug, "Process: dequeueing job...");
-	dispatch_queue.wait_dequeue(v);
-	LogMessage(Debug, "Process: dequeued job: %d", v.index());
+	dispatch_queues[0]->wait_dequeue(job);
+	LogMessage(Debug, "Process: dequeued job: %d", job.index());
+	Dispatch(job);
+}
 
+void Daemon::Dispatch(Job &job) {
 	std::visit(overloaded {
 			[&](std::monostate &ms) {
 				// just a wake-up signal
@@ -180,15 +206,8 @@ void Daemon::Process() {
 						std::shared_ptr<Client> client = rq.client;
 						if(client) {
 							// disown the object that's being closed
-							for(auto i = client->owned_objects.begin(); i != client->owned_objects.end(); ){
-								if((*i)->object_id == rq.object_id) {
-									// need to mark this so that it doesn't send another close request
-									(*i)->valid = false;
-									i = client->owned_objects.erase(i);
-									LogMessage(Debug, "  disowned from client");
-								} else {
-									i++;
-								}
+							if(client->DisownObject(rq.device_id, rq.object_id)) {
+								LogMessage(Debug, "  disowned from client");
 							}
 						} else {
 							LogMessage(Warning, "failed to locate client for disownership");
@@ -217,13 +236,10 @@ void Daemon::Process() {
 				}
 				// add any objects this response included to the client's
 				// owned object list, to keep the BridgeObject object alive
-				client->owned_objects.insert(
-					client->owned_objects.end(),
-					rs.objects.begin(),
-					rs.objects.end());
+				client->AdoptObjects(rs.objects);
 				client->PostResponse(rs);
 			}
-		}, v);
+		}, job);
 
 	LogMessage(Debug, "finished process loop");
 }
@@ -266,7 +282,7 @@ Response Daemon::HandleRequest(Request &rq) {
 		case protocol::ITwibMetaInterface::Command::CONNECT_TCP: {
 			LogMessage(Debug, "command 1 issued to twibd meta object: CONNECT_TCP");
 
-			util::Buffer buffer(rq.payload);
+			util::Buffer buffer(rq.payload.GetVector());
 			uint64_t hostname_len, port_len;
 			std::string hostname, port;
 			if(!buffer.Read<uint64_t>(hostname_len) ||
@@ -314,216 +330,12 @@ std::shared_ptr<Client> Daemon::GetClient(uint32_t client_id) {
 	return client;
 }
 
-#if TWIB_TCP_FRONTEND_ENABLED == 1
-static std::shared_ptr<frontend::SocketFrontend> CreateTCPFrontend(Daemon &daemon, uint16_t port) {
-	struct sockaddr_in6 addr;
-	memset(&addr, 0, sizeof(addr));
-	addr.sin6_family = AF_INET6;
-	addr.sin6_port = htons(port);
-	addr.sin6_addr = in6addr_any;
-	return std::make_shared<frontend::SocketFrontend>(daemon, AF_INET6, SOCK_STREAM, (struct sockaddr*) &addr, sizeof(addr));
-}
-#endif
-
-#if TWIB_UNIX_FRONTEND_ENABLED == 1
-static std::shared_ptr<frontend::SocketFrontend> CreateUNIXFrontend(Daemon &daemon, std::string path) {
-	struct sockaddr_un addr;
-	memset(&addr, 0, sizeof(addr));
-	addr.sun_family = AF_UNIX;
-	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path)-1);
-	return std::make_shared<frontend::SocketFrontend>(daemon, AF_UNIX, SOCK_STREAM, (struct sockaddr*) &addr, sizeof(addr));
-}
-#endif
-
-#if TWIB_NAMED_PIPE_FRONTEND_ENABLED == 1
-static std::shared_ptr<frontend::NamedPipeFrontend> CreateNamedPipeFrontend(Daemon &daemon) {
-	return std::make_shared<frontend::NamedPipeFrontend>(daemon, "foo");
+#if TWIBD_LOOPBACK_BACKEND_ENABLED
+backend::LoopbackBackend &Daemon::GetLoopbackBackend() {
+	return loopback;
 }
 #endif
 
 } // namespace daemon
 } // namespace twib
 } // namespace twili
-
-using namespace twili;
-using namespace twili::twib;
-
-daemon::Daemon *g_Daemon;
-std::sig_atomic_t g_Running;
-
-extern "C" void sigint_handler(int) {
-	g_Running = 0;
-	g_Daemon->Awaken();
-}
-
-int main(int argc, char *argv[]) {
-#ifdef _WIN32
-	WSADATA wsaData;
-	int err;
-	err = WSAStartup(MAKEWORD(2, 2), &wsaData);
-	if (err != 0) {
-		printf("WSASStartup failed with error: %d\n", err);
-		return 1;
-	}
-#endif
-
-	CLI::App app {"Twili debug monitor daemon"};
-
-	int verbosity = 3;
-	app.add_flag("-v,--verbose", verbosity, "Enable verbose messages. Use twice to enable debug messages");
-
-	bool systemd_mode = false;
-#if WITH_SYSTEMD == 1
-	app.add_flag("--systemd", systemd_mode, "Log in systemd format and obtain sockets from systemd (disables unix and tcp frontends)");
-#endif
-
-	bool launchd_mode = false;
-#if WITH_LAUNCHD == 1
-	app.add_flag("--launchd", launchd_mode, "Obtain sockets from launchd (disables unix and tcp frontends)");
-#endif
-
-#if TWIB_UNIX_FRONTEND_ENABLED == 1
-	bool unix_frontend_enabled = true;
-	app.add_flag_function(
-		"--unix",
-		[&unix_frontend_enabled](int count) {
-			unix_frontend_enabled = true;
-		}, "Enable UNIX socket frontend");
-	app.add_flag_function(
-		"--no-unix",
-		[&unix_frontend_enabled](int count) {
-			unix_frontend_enabled = false;
-		}, "Disable UNIX socket frontend");
-	std::string unix_frontend_path = TWIB_UNIX_FRONTEND_DEFAULT_PATH;
-	app.add_option(
-		"-P,--unix-path", unix_frontend_path,
-		"Path for the twibd UNIX socket frontend")
-		->envname("TWIB_UNIX_FRONTEND_PATH");
-#endif
-
-#if TWIB_TCP_FRONTEND_ENABLED == 1
-	bool tcp_frontend_enabled = true;
-	app.add_flag_function(
-		"--tcp",
-		[&tcp_frontend_enabled](int count) {
-			tcp_frontend_enabled = true;
-		}, "Enable TCP socket frontend");
-	app.add_flag_function(
-		"--no-tcp",
-		[&tcp_frontend_enabled](int count) {
-			tcp_frontend_enabled = false;
-		}, "Disable TCP socket frontend");
-	uint16_t tcp_frontend_port;
-	app.add_option(
-		"-p,--tcp-port", tcp_frontend_port,
-		"Port for the twibd TCP socket frontend")
-		->envname("TWIB_TCP_FRONTEND_PORT");
-#endif
-
-#if TWIB_NAMED_PIPE_FRONTEND_ENABLED == 1
-	bool named_pipe_frontend_enabled = true;
-	app.add_flag_function(
-		"--named-pipe",
-		[&named_pipe_frontend_enabled](int count) {
-			named_pipe_frontend_enabled = true;
-		}, "Enable named pipe frontend");
-	app.add_flag_function(
-		"--no-named-pipe",
-		[&named_pipe_frontend_enabled](int count) {
-			named_pipe_frontend_enabled = false;
-		}, "Disable named pipe frontend");
-#endif
-
-	try {
-		app.parse(argc, argv);
-	} catch(const CLI::ParseError &e) {
-		return app.exit(e);
-	}
-
-	log::Level min_log_level = log::Level::Message;
-	if(verbosity >= 1) {
-		min_log_level = log::Level::Info;
-	}
-	if(verbosity >= 2) {
-		min_log_level = log::Level::Debug;
-	}
-#if WITH_SYSTEMD == 1
-	if(systemd_mode) {
-		add_log(std::make_shared<log::SystemdLogger>(stderr, min_log_level));
-	}
-#endif
-	if(!systemd_mode) {
-		log::init_color();
-		log::add_log(std::make_shared<log::PrettyFileLogger>(stdout, min_log_level, log::Level::Error));
-		log::add_log(std::make_shared<log::PrettyFileLogger>(stderr, log::Level::Error));
-	}
-
-	LogMessage(Message, "starting twibd");
-	daemon::Daemon daemon;
-	g_Daemon = &daemon;
-	g_Running = true;
-
-	std::vector<std::shared_ptr<daemon::frontend::Frontend>> frontends;
-	if(!systemd_mode && !launchd_mode) {
-#if TWIB_TCP_FRONTEND_ENABLED == 1
-		if(tcp_frontend_enabled) {
-			frontends.push_back(daemon::CreateTCPFrontend(daemon, tcp_frontend_port));
-		}
-#endif
-#if TWIB_UNIX_FRONTEND_ENABLED == 1
-		if(unix_frontend_enabled) {
-			frontends.push_back(daemon::CreateUNIXFrontend(daemon, unix_frontend_path));
-		}
-#endif
-#if TWIB_NAMED_PIPE_FRONTEND_ENABLED == 1
-		if(named_pipe_frontend_enabled) {
-			frontends.push_back(daemon::CreateNamedPipeFrontend(daemon));
-		}
-#endif
-	}
-
-#if WITH_SYSTEMD == 1
-	if(systemd_mode) {
-		int num_fds = sd_listen_fds(false);
-		if(num_fds < 0) {
-			LogMessage(Warning, "failed to get FDs from systemd");
-		} else {
-			LogMessage(Info, "got %d sockets from systemd", num_fds);
-			for(int fd = SD_LISTEN_FDS_START; fd < SD_LISTEN_FDS_START + num_fds; fd++) {
-				if(sd_is_socket(fd, 0, SOCK_STREAM, 1) == 1) {
-					frontends.push_back(std::make_shared<daemon::frontend::SocketFrontend>(daemon, platform::Socket(fd)));
-				} else {
-					LogMessage(Warning, "got an FD from systemd that wasn't a SOCK_STREAM: %d", fd);
-				}
-			}
-		}
-		sd_notify(false, "READY=1");
-	}
-#endif
-
-#if WITH_LAUNCHD == 1
-	if(launchd_mode) {
-		int *fds = nullptr;
-		size_t num_fds = 0;
-		int err = launch_activate_socket("twibd-listener", &fds, &num_fds);
-		if(err != 0 || fds == nullptr || num_fds == 0) {
-			LogMessage(Warning, "failed to get FDs from launchd");
-		} else {
-			LogMessage(Info, "got %zu sockets from launchd", num_fds);
-			for(size_t i = 0; i < num_fds; i++) {
-				frontends.push_back(std::make_shared<daemon::frontend::SocketFrontend>(daemon, platform::Socket(fds[i])));
-			}
-		}
-		if(fds != nullptr) {
-			free(fds);
-		}
-	}
-#endif
-
-	std::signal(SIGINT, &sigint_handler);
-
-	while(g_Running) {
-		daemon.Process();
-	}
-	return 0;
-}
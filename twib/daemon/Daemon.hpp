@@ -29,6 +29,7 @@
 #include<map>
 #include<random>
 #include<condition_variable>
+#include<atomic>
 
 #include "common/blockingconcurrentqueue.h"
 #include "common/config.hpp"
@@ -43,6 +44,9 @@
 #if TWIBD_LIBUSBK_BACKEND_ENABLED
 #include "USBKBackend.hpp"
 #endif
+#if TWIBD_LOOPBACK_BACKEND_ENABLED
+#include "LoopbackBackend.hpp"
+#endif
 
 #include "Messages.hpp"
 #include "Device.hpp"
@@ -55,7 +59,7 @@ namespace daemon {
 
 class Daemon {
  public:
-	Daemon();
+	Daemon(size_t dispatch_threads);
 	~Daemon();
 
 	void AddDevice(std::shared_ptr<Device> device);
@@ -66,15 +70,31 @@ class Daemon {
 	void RemoveDevice(std::shared_ptr<Device> device);
 	void RemoveClient(std::shared_ptr<Client> client);
 	
+	// dispatches jobs from the first dispatch queue. the rest of the queues
+	// have their own threads.
 	void Process();
 	Response HandleRequest(Request &request);
 	std::shared_ptr<Client> GetClient(uint32_t client_id);
+#if TWIBD_LOOPBACK_BACKEND_ENABLED
+	backend::LoopbackBackend &GetLoopbackBackend();
+#endif
 
 	std::shared_ptr<LocalClient> local_client;
 
 	InitialScanLock initial_scan_lock;
  private:
-	moodycamel::BlockingConcurrentQueue<std::variant<std::monostate, Request, Response>> dispatch_queue;
+	using Job = std::variant<std::monostate, Request, Response>;
+	using JobQueue = moodycamel::BlockingConcurrentQueue<Job>;
+
+	// Jobs are sharded across the dispatch queues by device id, so that
+	// everything to and from one device is dispatched in order while other
+	// devices proceed in parallel.
+	std::vector<std::unique_ptr<JobQueue>> dispatch_queues;
+	std::vector<std::thread> dispatch_threads;
+	std::atomic_bool dispatch_running;
+
+	JobQueue &QueueForDevice(uint32_t device_id);
+	void Dispatch(Job &job);
 	
 	std::mutex device_map_mutex;
 	std::map<uint32_t, std::weak_ptr<Device>> devices;
@@ -93,6 +113,9 @@ class Daemon {
 #if TWIBD_LIBUSBK_BACKEND_ENABLED
 	backend::USBKBackend usbk;
 #endif
+#if TWIBD_LOOPBACK_BACKEND_ENABLED
+	backend::LoopbackBackend loopback;
+#endif
 };
 
 } // namespace daemon
@@ -0,0 +1,84 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Device.hpp"
+
+#include<algorithm>
+
+#include "Buffer.hpp"
+#include "Hello.hpp"
+#include "common/Logger.hpp"
+#include "Protocol.hpp"
+
+namespace twili {
+namespace twib {
+namespace daemon {
+
+Request Device::MakeHelloRequest(uint32_t max_transfer_size) {
+	msgpack11::MsgPack hello = msgpack11::MsgPack::object {
+		{"version", protocol::HELLO_VERSION},
+		{"features", hello::SupportedFeatures},
+		{"max_transfer_size", max_transfer_size},
+	};
+	std::string packed = hello.dump();
+	
+	util::Buffer payload;
+	payload.Write<uint64_t>(packed.size());
+	payload.Write(packed);
+	return Request(std::shared_ptr<Client>(), 0x0, 0x0, (uint32_t) protocol::ITwibDeviceInterface::Command::HELLO, HelloTag, payload.GetData());
+}
+
+bool Device::ApplyHelloResponse(Response &r) {
+	if(r.result_code != 0) {
+		LogMessage(Info, "device doesn't understand HELLO (0x%x), using defaults", r.result_code);
+		return false;
+	}
+	if(r.payload.size() < sizeof(uint64_t)) {
+		LogMessage(Warning, "bad HELLO response");
+		return false;
+	}
+	
+	std::string err;
+	msgpack11::MsgPack obj = msgpack11::MsgPack::parse(std::string(r.payload.begin() + 8, r.payload.end()), err);
+	if(!err.empty()) {
+		LogMessage(Warning, "bad HELLO response: %s", err.c_str());
+		return false;
+	}
+	
+	features = obj["features"].uint32_value();
+	max_transfer_size = obj["max_transfer_size"].uint32_value();
+	max_outstanding_requests = obj["max_outstanding_requests"].uint32_value();
+	LogMessage(Info, "device says hello (version %d)", obj["version"].uint32_value());
+	LogMessage(Info, "  features: 0x%x", features);
+	LogMessage(Info, "  max transfer size: 0x%x", max_transfer_size);
+	LogMessage(Info, "  max outstanding requests: %u", max_outstanding_requests);
+	return true;
+}
+
+size_t Device::GetTransferSize(size_t limit) const {
+	if(max_transfer_size == 0) {
+		return limit;
+	}
+	return std::min((size_t) max_transfer_size, limit);
+}
+
+} // namespace daemon
+} // namespace twib
+} // namespace twili
@@ -41,6 +41,23 @@ class Device {
 	std::string serial_number;
 	bool deletion_flag = false;
 	uint32_t device_id;
+
+	// agreed on with the device through HELLO. devices that don't understand
+	// HELLO keep these defaults.
+	uint32_t features = 0;
+	uint32_t max_transfer_size = 0; // 0 means the bridge's default
+	uint32_t max_outstanding_requests = 0; // 0 means no limit
+
+	// how much a backend that can move up to limit at once should move per
+	// transfer, given what the device agreed to
+	size_t GetTransferSize(size_t limit) const;
+ protected:
+	static const uint32_t HelloTag = 0xFFFFFFFE;
+	// builds the HELLO request that goes out before IDENTIFY on every new
+	// connection, offering every feature twibd supports
+	static Request MakeHelloRequest(uint32_t max_transfer_size);
+	// records what the device agreed to. returns false if it didn't.
+	bool ApplyHelloResponse(Response &r);
 };
 
 } // namespace daemon
@@ -0,0 +1,564 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "LoopbackBackend.hpp"
+
+#include<algorithm>
+#include<chrono>
+#include<cstdlib>
+
+#include "Daemon.hpp"
+#include "MemoryMap.hpp"
+#include "err.hpp"
+
+namespace twili {
+namespace twib {
+namespace daemon {
+namespace backend {
+
+namespace {
+
+bool ReadString(util::Buffer &in, std::string &str) {
+	uint64_t size;
+	return in.Read<uint64_t>(size) && in.Read(str, size);
+}
+
+template<typename T>
+bool ReadVector(util::Buffer &in, std::vector<T> &vec) {
+	uint64_t count;
+	if(!in.Read(count) || count > in.ReadAvailable() / sizeof(T)) {
+		return false;
+	}
+	vec.resize(count);
+	return in.Read(vec);
+}
+
+void WriteString(util::Buffer &out, std::string str) {
+	out.Write<uint64_t>(str.size());
+	out.Write(str);
+}
+
+void WriteBytes(util::Buffer &out, const uint8_t *data, size_t size) {
+	out.Write<uint64_t>(size);
+	out.Write(data, size);
+}
+
+class FileAccessor : public LoopbackBackend::Object {
+ public:
+	FileAccessor(LoopbackBackend::Device &device, std::shared_ptr<std::vector<uint8_t>> file) :
+		Object(device), file(file) {
+	}
+	
+	virtual uint32_t Handle(uint32_t command_id, util::Buffer &in, util::Buffer &out, std::vector<uint32_t> &object_ids) override {
+		using Command = protocol::ITwibFileAccessor::Command;
+		switch((Command) command_id) {
+		case Command::READ: {
+			uint64_t offset, size;
+			if(!in.Read(offset) || !in.Read(size)) {
+				return TWILI_ERR_PROTOCOL_BAD_REQUEST;
+			}
+			offset = std::min(offset, (uint64_t) file->size());
+			size = std::min(std::min(size, (uint64_t) 0x40000), file->size() - offset);
+			WriteBytes(out, file->data() + offset, size);
+			return 0; }
+		case Command::WRITE: {
+			uint64_t offset, size;
+			// streamed arguments are prefixed with their size
+			if(!in.Read(offset) || !in.Read(size) || size != in.ReadAvailable()) {
+				return TWILI_ERR_PROTOCOL_BAD_REQUEST;
+			}
+			if(offset + size > file->size()) {
+				file->resize(offset + size);
+			}
+			in.Read(file->data() + offset, size);
+			return 0; }
+		case Command::FLUSH:
+			return 0;
+		case Command::SET_SIZE: {
+			uint64_t size;
+			if(!in.Read(size)) {
+				return TWILI_ERR_PROTOCOL_BAD_REQUEST;
+			}
+			file->resize(size);
+			return 0; }
+		case Command::GET_SIZE:
+			out.Write<uint64_t>(file->size());
+			return 0;
+		default:
+			return TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION;
+		}
+	}
+ private:
+	std::shared_ptr<std::vector<uint8_t>> file;
+};
+
+class FilesystemAccessor : public LoopbackBackend::Object {
+ public:
+	using Object::Object;
+	
+	virtual uint32_t Handle(uint32_t command_id, util::Buffer &in, util::Buffer &out, std::vector<uint32_t> &object_ids) override {
+		using Command = protocol::ITwibFilesystemAccessor::Command;
+		switch((Command) command_id) {
+		case Command::CREATE_FILE: {
+			uint32_t mode;
+			uint64_t size;
+			std::string path;
+			if(!in.Read(mode) || !in.Read(size) || !ReadString(in, path)) {
+				return TWILI_ERR_PROTOCOL_BAD_REQUEST;
+			}
+			if(device.files.find(path) != device.files.end()) {
+				return 0x402; // path already exists
+			}
+			device.files[path] = std::make_shared<std::vector<uint8_t>>(size, 0);
+			return 0; }
+		case Command::DELETE_FILE: {
+			std::string path;
+			if(!ReadString(in, path)) {
+				return TWILI_ERR_PROTOCOL_BAD_REQUEST;
+			}
+			if(device.files.erase(path) == 0) {
+				return 0x202; // path does not exist
+			}
+			return 0; }
+		case Command::GET_ENTRY_TYPE: {
+			std::string path;
+			if(!ReadString(in, path)) {
+				return TWILI_ERR_PROTOCOL_BAD_REQUEST;
+			}
+			if(device.files.find(path) == device.files.end()) {
+				return 0x202;
+			}
+			out.Write<uint32_t>(1); // file
+			return 0; }
+		case Command::OPEN_FILE: {
+			uint32_t mode;
+			std::string path;
+			if(!in.Read(mode) || !ReadString(in, path)) {
+				return TWILI_ERR_PROTOCOL_BAD_REQUEST;
+			}
+			auto i = device.files.find(path);
+			if(i == device.files.end()) {
+				return 0x202;
+			}
+			out.Write<uint32_t>(object_ids.size());
+			object_ids.push_back(device.AddObject(std::make_shared<FileAccessor>(device, i->second)));
+			return 0; }
+		default:
+			return TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION;
+		}
+	}
+};
+
+// unmapped, code (r-x), heap (rw-), reserved up to the top of the address space
+const std::vector<memory_map::Region> fake_memory_map = {
+	{0x0, 0x8000000, 0x00, 0, 0, 0, 0, 0},
+	{0x8000000, 0x100000, 0x03, 0, 5, 0, 0, 0},
+	{0x8100000, 0x1000000, 0x05, 0, 3, 0, 0, 0},
+	{0x9100000, 0 - (uint64_t) 0x9100000, 0x10, 0, 0, 0, 0, 0},
+};
+
+class Debugger : public LoopbackBackend::Object {
+ public:
+	using Object::Object;
+	
+	virtual uint32_t Handle(uint32_t command_id, util::Buffer &in, util::Buffer &out, std::vector<uint32_t> &object_ids) override {
+		using Command = protocol::ITwibDebugger::Command;
+		switch((Command) command_id) {
+		case Command::QUERY_MEMORY: {
+			uint64_t addr;
+			if(!in.Read(addr)) {
+				return TWILI_ERR_PROTOCOL_BAD_REQUEST;
+			}
+			for(const memory_map::Region &region : fake_memory_map) {
+				if(addr - region.base_addr < region.size) {
+					out.Write(region);
+					out.Write<uint32_t>(0); // page info
+					break;
+				}
+			}
+			return 0; }
+		case Command::QUERY_MEMORY_MAP: {
+			memory_map::Encode(fake_memory_map, std::vector<uint32_t>(fake_memory_map.size(), 0), out);
+			return 0; }
+		case Command::READ_MEMORY: {
+			uint64_t addr, size;
+			if(!in.Read(addr) || !in.Read(size)) {
+				return TWILI_ERR_PROTOCOL_BAD_REQUEST;
+			}
+			std::vector<uint8_t> bytes = ReadMemory(addr, size);
+			WriteBytes(out, bytes.data(), bytes.size());
+			return 0; }
+		case Command::READ_MEMORY_MULTI: {
+			std::vector<uint64_t> addresses, sizes;
+			if(!ReadVector(in, addresses) || !ReadVector(in, sizes) || addresses.size() != sizes.size()) {
+				return TWILI_ERR_PROTOCOL_BAD_REQUEST;
+			}
+			std::vector<uint8_t> data;
+			for(size_t i = 0; i < addresses.size(); i++) {
+				std::vector<uint8_t> bytes = ReadMemory(addresses[i], sizes[i]);
+				data.insert(data.end(), bytes.begin(), bytes.end());
+			}
+			WriteBytes(out, data.data(), data.size());
+			out.Write<uint64_t>(addresses.size());
+			for(size_t i = 0; i < addresses.size(); i++) {
+				out.Write<uint32_t>(0);
+			}
+			return 0; }
+		case Command::WRITE_MEMORY: {
+			uint64_t addr, size;
+			if(!in.Read(addr) || !in.Read(size) || size != in.ReadAvailable()) {
+				return TWILI_ERR_PROTOCOL_BAD_REQUEST;
+			}
+			for(uint64_t i = 0; in.ReadAvailable() > 0; i++) {
+				uint8_t byte;
+				in.Read(byte);
+				device.written_memory[addr + i] = byte;
+			}
+			return 0; }
+		case Command::WRITE_MEMORY_MULTI: {
+			std::vector<uint64_t> addresses, sizes;
+			std::vector<uint8_t> data;
+			if(!ReadVector(in, addresses) || !ReadVector(in, sizes) || !ReadVector(in, data) || addresses.size() != sizes.size()) {
+				return TWILI_ERR_PROTOCOL_BAD_REQUEST;
+			}
+			uint64_t offset = 0;
+			for(uint64_t size : sizes) {
+				if(size > data.size() - offset) {
+					return TWILI_ERR_PROTOCOL_BAD_REQUEST;
+				}
+				offset+= size;
+			}
+			offset = 0;
+			for(size_t i = 0; i < addresses.size(); i++) {
+				for(uint64_t j = 0; j < sizes[i]; j++) {
+					device.written_memory[addresses[i] + j] = data[offset++];
+				}
+			}
+			out.Write<uint64_t>(addresses.size());
+			for(size_t i = 0; i < addresses.size(); i++) {
+				out.Write<uint32_t>(0);
+			}
+			return 0; }
+		default:
+			return TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION;
+		}
+	}
+ private:
+	// memory that hasn't been written reads back as the low byte of its address
+	std::vector<uint8_t> ReadMemory(uint64_t addr, uint64_t size) {
+		std::vector<uint8_t> bytes(size);
+		for(uint64_t i = 0; i < size; i++) {
+			auto j = device.written_memory.find(addr + i);
+			bytes[i] = j == device.written_memory.end() ? (uint8_t) (addr + i) : j->second;
+		}
+		return bytes;
+	}
+};
+
+// produces an endless stream of zeroes, for measuring throughput
+class PipeReader : public LoopbackBackend::Object {
+ public:
+	using Object::Object;
+	
+	virtual uint32_t Handle(uint32_t command_id, util::Buffer &in, util::Buffer &out, std::vector<uint32_t> &object_ids) override {
+		using Command = protocol::ITwibPipeReader::Command;
+		switch((Command) command_id) {
+		case Command::READ: {
+			std::vector<uint8_t> data(0x4000, 0);
+			WriteBytes(out, data.data(), data.size());
+			return 0; }
+		default:
+			return TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION;
+		}
+	}
+};
+
+class DeviceInterface : public LoopbackBackend::Object {
+ public:
+	using Object::Object;
+	
+	virtual uint32_t Handle(uint32_t command_id, util::Buffer &in, util::Buffer &out, std::vector<uint32_t> &object_ids) override {
+		using Command = protocol::ITwibDeviceInterface::Command;
+		switch((Command) command_id) {
+		case Command::IDENTIFY:
+			WriteString(out, device.identification.dump());
+			return 0;
+		case Command::LIST_PROCESSES:
+			out.Write<uint64_t>(0);
+			return 0;
+		case Command::LIST_NAMED_PIPES:
+			out.Write<uint64_t>(1);
+			WriteString(out, "zero");
+			return 0;
+		case Command::OPEN_NAMED_PIPE: {
+			std::string name;
+			if(!ReadString(in, name)) {
+				return TWILI_ERR_PROTOCOL_BAD_REQUEST;
+			}
+			if(name != "zero") {
+				return TWILI_ERR_NO_SUCH_PIPE;
+			}
+			out.Write<uint32_t>(object_ids.size());
+			object_ids.push_back(device.AddObject(std::make_shared<PipeReader>(device)));
+			return 0; }
+		case Command::OPEN_ACTIVE_DEBUGGER: {
+			uint64_t pid;
+			if(!in.Read(pid)) {
+				return TWILI_ERR_PROTOCOL_BAD_REQUEST;
+			}
+			out.Write<uint32_t>(object_ids.size());
+			object_ids.push_back(device.AddObject(std::make_shared<Debugger>(device)));
+			return 0; }
+		case Command::OPEN_FILESYSTEM_ACCESSOR: {
+			std::string fs;
+			if(!ReadString(in, fs)) {
+				return TWILI_ERR_PROTOCOL_BAD_REQUEST;
+			}
+			out.Write<uint32_t>(object_ids.size());
+			object_ids.push_back(device.AddObject(std::make_shared<FilesystemAccessor>(device)));
+			return 0; }
+		default:
+			return TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION;
+		}
+	}
+};
+
+uint64_t GetEnvironmentNumber(const char *name) {
+	const char *value = getenv(name);
+	return value ? strtoull(value, nullptr, 0) : 0;
+}
+
+} // anonymous namespace
+
+LoopbackBackend::LoopbackBackend(Daemon &daemon) :
+	daemon(daemon),
+	latency_us(GetEnvironmentNumber("TWIBD_LOOPBACK_LATENCY_US")),
+	bandwidth(GetEnvironmentNumber("TWIBD_LOOPBACK_BANDWIDTH")),
+	send_delay_us(GetEnvironmentNumber("TWIBD_LOOPBACK_SEND_DELAY_US")),
+	device_count(std::max(GetEnvironmentNumber("TWIBD_LOOPBACK_DEVICES"), (uint64_t) 1)) {
+}
+
+LoopbackBackend::~LoopbackBackend() {
+	for(auto &device : devices) {
+		device->Stop();
+	}
+}
+
+void LoopbackBackend::Probe() {
+	LogMessage(Info, "adding %zu loopback device(s) (latency %luus, bandwidth %lu B/s, send delay %luus)", device_count, latency_us, bandwidth, send_delay_us);
+	for(size_t i = 0; i < device_count; i++) {
+		std::string serial_number = i == 0 ? "loopback" : "loopback-" + std::to_string(i);
+		devices.push_back(std::make_shared<Device>(*this, serial_number));
+		daemon.AddDevice(devices.back());
+	}
+}
+
+std::vector<std::shared_ptr<LoopbackBackend::Device>> LoopbackBackend::GetDevices() {
+	return devices;
+}
+
+LoopbackBackend::Object::Object(Device &device) : device(device) {
+}
+
+LoopbackBackend::Object::~Object() {
+}
+
+LoopbackBackend::Device::Device(LoopbackBackend &backend, std::string serial_number) :
+	backend(backend) {
+	device_nickname = serial_number;
+	this->serial_number = serial_number;
+	identification = msgpack11::MsgPack::object {
+		{"service", "twili"},
+		{"protocol", protocol::VERSION},
+		{"serial_number", serial_number},
+		{"device_nickname", device_nickname},
+	};
+	device_id = std::hash<std::string>()(serial_number);
+	objects[0] = std::make_shared<DeviceInterface>(*this);
+	
+	thread = std::thread(&Device::Run, this);
+}
+
+LoopbackBackend::Device::~Device() {
+	Stop();
+}
+
+void LoopbackBackend::Device::Stop() {
+	{
+		std::lock_guard<std::mutex> lock(wire_mutex);
+		stopping = true;
+	}
+	wire_cv.notify_all();
+	if(thread.joinable()) {
+		thread.join();
+	}
+}
+
+void LoopbackBackend::Device::SendRequest(const Request &&r) {
+	protocol::MessageHeader mhdr;
+	mhdr.client_id = r.client ? r.client->client_id : 0xffffffff;
+	mhdr.object_id = r.object_id;
+	mhdr.command_id = r.command_id;
+	mhdr.tag = r.tag;
+	mhdr.payload_size = r.payload.size();
+	mhdr.object_count = 0;
+
+	if(backend.send_delay_us > 0) {
+		std::this_thread::sleep_for(std::chrono::microseconds(backend.send_delay_us));
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(wire_mutex);
+		wire_out.Write(mhdr);
+		wire_out.Write(r.payload.data(), r.payload.size());
+	}
+	wire_cv.notify_one();
+}
+
+int LoopbackBackend::Device::GetPriority() {
+	return 0; // lower priority than real devices
+}
+
+std::string LoopbackBackend::Device::GetBridgeType() {
+	return "loopback";
+}
+
+uint32_t LoopbackBackend::Device::AddObject(std::shared_ptr<Object> object) {
+	uint32_t id = next_object_id++;
+	objects[id] = object;
+	object_count = objects.size() - 1;
+	return id;
+}
+
+size_t LoopbackBackend::Device::GetObjectCount() {
+	return object_count;
+}
+
+void LoopbackBackend::Device::Run() {
+	while(true) {
+		protocol::MessageHeader mh;
+		util::Buffer payload;
+		{
+			std::unique_lock<std::mutex> lock(wire_mutex);
+			wire_cv.wait(lock, [this]() {
+					return stopping || wire_out.ReadAvailable() >= sizeof(mh);
+				});
+			if(stopping) {
+				return;
+			}
+
+			// SendRequest always writes whole messages
+			wire_out.Read(mh);
+			wire_out.Read(payload, mh.payload_size);
+		}
+
+		Delay(sizeof(mh) + mh.payload_size);
+		HandleMessage(mh, payload);
+	}
+}
+
+void LoopbackBackend::Device::Delay(size_t bytes) {
+	uint64_t us = backend.latency_us;
+	if(backend.bandwidth > 0) {
+		us+= (bytes * 1000000) / backend.bandwidth;
+	}
+	if(us > 0) {
+		std::this_thread::sleep_for(std::chrono::microseconds(us));
+	}
+}
+
+void LoopbackBackend::Device::HandleMessage(protocol::MessageHeader &mh, util::Buffer &payload) {
+	util::Buffer response;
+	std::vector<uint32_t> object_ids;
+	
+	// check for a close object request
+	if(mh.command_id == 0xffffffff) {
+		if(mh.object_id == 0) {
+			// closing object 0 closes everything except object 0
+			for(auto i = objects.begin(); i != objects.end(); ) {
+				i = i->first == 0 ? std::next(i) : objects.erase(i);
+			}
+		} else {
+			objects.erase(mh.object_id);
+		}
+		object_count = objects.size() - 1;
+		Respond(mh, 0, response, object_ids);
+		return;
+	}
+
+	auto i = objects.find(mh.object_id);
+	if(i == objects.end()) {
+		Respond(mh, TWILI_ERR_PROTOCOL_UNRECOGNIZED_OBJECT, response, object_ids);
+		return;
+	}
+
+	uint32_t r = i->second->Handle(mh.command_id, payload, response, object_ids);
+	if(r != 0) {
+		response.Clear();
+		object_ids.clear();
+	}
+	Respond(mh, r, response, object_ids);
+}
+
+void LoopbackBackend::Device::Respond(protocol::MessageHeader &rq, uint32_t result_code, util::Buffer &payload, std::vector<uint32_t> &object_ids) {
+	// frame the response the way a bridge would, then unpack it again the
+	// way a backend would
+	util::Buffer wire_in;
+	protocol::MessageHeader mhdr;
+	mhdr.client_id = rq.client_id;
+	mhdr.object_id = rq.object_id;
+	mhdr.result_code = result_code;
+	mhdr.tag = rq.tag;
+	mhdr.payload_size = payload.ReadAvailable();
+	mhdr.object_count = object_ids.size();
+	wire_in.Write(mhdr);
+	wire_in.Write(payload.Read(), payload.ReadAvailable());
+	wire_in.Write(object_ids);
+
+	Delay(wire_in.ReadAvailable());
+
+	protocol::MessageHeader mh_in;
+	util::Buffer payload_in;
+	std::vector<uint32_t> object_ids_in(mhdr.object_count);
+	wire_in.Read(mh_in);
+	wire_in.Read(payload_in, mh_in.payload_size);
+	wire_in.Read(object_ids_in);
+	
+	Response response;
+	response.device_id = device_id;
+	response.client_id = mh_in.client_id;
+	response.object_id = mh_in.object_id;
+	response.result_code = mh_in.result_code;
+	response.tag = mh_in.tag;
+	response.payload = payload_in.TakeData();
+	for(uint32_t id : object_ids_in) {
+		response.objects.push_back(std::make_shared<BridgeObject>(backend.daemon, device_id, id));
+	}
+
+	if(response.client_id == 0xffffffff) {
+		return; // nobody to deliver it to
+	}
+	backend.daemon.PostResponse(std::move(response));
+}
+
+} // namespace backend
+} // namespace daemon
+} // namespace twib
+} // namespace twili
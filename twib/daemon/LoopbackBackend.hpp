@@ -0,0 +1,127 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<map>
+#include<memory>
+#include<atomic>
+
+#include "Buffer.hpp"
+#include "Device.hpp"
+#include "Messages.hpp"
+#include "Protocol.hpp"
+
+namespace twili {
+namespace twib {
+namespace daemon {
+
+class Daemon;
+
+namespace backend {
+
+// Fake in-process device that implements a small part of the bridge
+// (device identification, an in-memory filesystem, a debugger with fake
+// memory, and an endless named pipe) so that twibd can be exercised and
+// measured without a console attached. Messages are framed exactly as they
+// would be on the wire, and can be slowed down with the
+// TWIBD_LOOPBACK_LATENCY_US and TWIBD_LOOPBACK_BANDWIDTH (bytes per second)
+// environment variables. TWIBD_LOOPBACK_SEND_DELAY_US makes SendRequest
+// itself block for that long, the way a backend that writes to its link
+// synchronously would hold up the thread dispatching to it.
+// TWIBD_LOOPBACK_DEVICES sets how many independent devices to attach
+// (default 1).
+class LoopbackBackend {
+ public:
+	LoopbackBackend(Daemon &daemon);
+	~LoopbackBackend();
+
+	void Probe();
+
+	class Device;
+	std::vector<std::shared_ptr<Device>> GetDevices();
+
+	class Object;
+	
+	class Device : public daemon::Device, public std::enable_shared_from_this<Device> {
+	 public:
+		Device(LoopbackBackend &backend, std::string serial_number);
+		~Device();
+
+		virtual void SendRequest(const Request &&r) override;
+		virtual int GetPriority() override;
+		virtual std::string GetBridgeType() override;
+
+		void Stop();
+
+		// in-memory state shared between objects
+		std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files;
+		std::map<uint64_t, uint8_t> written_memory;
+		
+		// used by objects to create other objects
+		uint32_t AddObject(std::shared_ptr<Object> object);
+		// objects currently open, not counting object 0
+		size_t GetObjectCount();
+	 private:
+		LoopbackBackend &backend;
+		
+		std::thread thread;
+		std::mutex wire_mutex;
+		std::condition_variable wire_cv;
+		util::Buffer wire_out; // host -> device
+		bool stopping = false;
+
+		std::map<uint32_t, std::shared_ptr<Object>> objects;
+		std::atomic<size_t> object_count = 0;
+		uint32_t next_object_id = 1;
+
+		void Run();
+		void Delay(size_t bytes);
+		void HandleMessage(protocol::MessageHeader &mh, util::Buffer &payload);
+		void Respond(protocol::MessageHeader &rq, uint32_t result_code, util::Buffer &payload, std::vector<uint32_t> &object_ids);
+	};
+
+	// one bridge object; handlers read their arguments from the request
+	// payload and write their results to the response payload
+	class Object {
+	 public:
+		Object(Device &device);
+		virtual ~Object();
+		virtual uint32_t Handle(uint32_t command_id, util::Buffer &in, util::Buffer &out, std::vector<uint32_t> &object_ids) = 0;
+	 protected:
+		Device &device;
+	};
+	
+ private:
+	Daemon &daemon;
+	uint64_t latency_us = 0;
+	uint64_t bandwidth = 0;
+	uint64_t send_delay_us = 0;
+	size_t device_count = 1;
+	std::vector<std::shared_ptr<Device>> devices;
+};
+
+} // namespace backend
+} // namespace daemon
+} // namespace twib
+} // namespace twili
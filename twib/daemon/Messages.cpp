@@ -27,9 +27,9 @@ namespace daemon {
 Response::Response() {
 }
 
-Response::Response(uint32_t client_id, uint32_t device_id, uint32_t object_id, uint32_t result_code, uint32_t tag, std::vector<uint8_t> payload) :
+Response::Response(uint32_t client_id, uint32_t device_id, uint32_t object_id, uint32_t result_code, uint32_t tag, common::SharedBuffer payload) :
 	client_id(client_id), device_id(device_id), object_id(object_id),
-	result_code(result_code), tag(tag), payload(payload) {
+	result_code(result_code), tag(tag), payload(std::move(payload)) {
 }
 
 Response::Response(uint32_t client_id, uint32_t device_id, uint32_t object_id, uint32_t result_code, uint32_t tag) :
@@ -37,12 +37,51 @@ Response::Response(uint32_t client_id, uint32_t device_id, uint32_t object_id, u
 	result_code(result_code), tag(tag) {
 }
 
+void Client::AdoptObjects(const std::vector<std::shared_ptr<BridgeObject>> &objects) {
+	std::lock_guard<std::mutex> lock(owned_objects_mutex);
+	for(const std::shared_ptr<BridgeObject> &object : objects) {
+		if(!owned_objects.emplace(ObjectKey(object->device_id, object->object_id), object).second) {
+			// we already own this one, don't let the duplicate close it
+			object->valid = false;
+		}
+	}
+}
+
+bool Client::DisownObject(uint32_t device_id, uint32_t object_id) {
+	std::shared_ptr<BridgeObject> object;
+	{
+		std::lock_guard<std::mutex> lock(owned_objects_mutex);
+		auto i = owned_objects.find(ObjectKey(device_id, object_id));
+		if(i == owned_objects.end()) {
+			return false;
+		}
+		object = std::move(i->second);
+		owned_objects.erase(i);
+	}
+	// need to mark this so that it doesn't send another close request
+	object->valid = false;
+	return true;
+}
+
+void Client::ReleaseObjects() {
+	std::unordered_map<uint64_t, std::shared_ptr<BridgeObject>> released;
+	{
+		std::lock_guard<std::mutex> lock(owned_objects_mutex);
+		released.swap(owned_objects);
+	}
+	// objects send their close requests as they're destroyed here, outside the lock
+}
+
+uint64_t Client::ObjectKey(uint32_t device_id, uint32_t object_id) {
+	return ((uint64_t) device_id << 32) | object_id;
+}
+
 WeakRequest::WeakRequest() {
 }
 
-WeakRequest::WeakRequest(uint32_t client_id, uint32_t device_id, uint32_t object_id, uint32_t command_id, uint32_t tag, std::vector<uint8_t> payload) :
+WeakRequest::WeakRequest(uint32_t client_id, uint32_t device_id, uint32_t object_id, uint32_t command_id, uint32_t tag, common::SharedBuffer payload) :
 	client_id(client_id), device_id(device_id), object_id(object_id),
-	command_id(command_id), tag(tag), payload(payload) {
+	command_id(command_id), tag(tag), payload(std::move(payload)) {
 }
 
 WeakRequest::WeakRequest(uint32_t client_id, uint32_t device_id, uint32_t object_id, uint32_t command_id, uint32_t tag) :
@@ -51,7 +90,7 @@ WeakRequest::WeakRequest(uint32_t client_id, uint32_t device_id, uint32_t object
 }
 
 Response WeakRequest::RespondError(uint32_t code) {
-	return Response(client_id, device_id, object_id, code, tag, std::vector<uint8_t>());
+	return Response(client_id, device_id, object_id, code, tag);
 }
 
 Response WeakRequest::RespondOk() {
@@ -61,9 +100,9 @@ Response WeakRequest::RespondOk() {
 Request::Request() {
 }
 
-Request::Request(std::shared_ptr<Client> client, uint32_t device_id, uint32_t object_id, uint32_t command_id, uint32_t tag, std::vector<uint8_t> payload) :
+Request::Request(std::shared_ptr<Client> client, uint32_t device_id, uint32_t object_id, uint32_t command_id, uint32_t tag, common::SharedBuffer payload) :
 	client(client), device_id(device_id), object_id(object_id),
-	command_id(command_id), tag(tag), payload(payload) {
+	command_id(command_id), tag(tag), payload(std::move(payload)) {
 }
 
 Request::Request(std::shared_ptr<Client> client, uint32_t device_id, uint32_t object_id, uint32_t command_id, uint32_t tag) :
@@ -72,7 +111,7 @@ Request::Request(std::shared_ptr<Client> client, uint32_t device_id, uint32_t ob
 }
 
 Response Request::RespondError(uint32_t code) {
-	return Response(client->client_id, device_id, object_id, code, tag, std::vector<uint8_t>());
+	return Response(client->client_id, device_id, object_id, code, tag);
 }
 
 Response Request::RespondOk() {
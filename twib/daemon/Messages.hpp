@@ -22,10 +22,13 @@
 
 #include<vector>
 #include<memory>
+#include<mutex>
+#include<unordered_map>
 
 #include<stdint.h>
 
 #include "BridgeObject.hpp"
+#include "common/SharedBuffer.hpp"
 
 namespace twili {
 namespace twib {
@@ -34,7 +37,7 @@ namespace daemon {
 class Response {
  public:
 	Response();
-	Response(uint32_t client_id, uint32_t device_id, uint32_t object_id, uint32_t result_code, uint32_t tag, std::vector<uint8_t> payload);
+	Response(uint32_t client_id, uint32_t device_id, uint32_t object_id, uint32_t result_code, uint32_t tag, common::SharedBuffer payload);
 	Response(uint32_t client_id, uint32_t device_id, uint32_t object_id, uint32_t result_code, uint32_t tag);
 	
 	uint32_t client_id;
@@ -42,7 +45,7 @@ class Response {
 	uint32_t object_id;
 	uint32_t result_code;
 	uint32_t tag;
-	std::vector<uint8_t> payload;
+	common::SharedBuffer payload;
 	std::vector<std::shared_ptr<BridgeObject>> objects;
 };
 
@@ -51,13 +54,26 @@ class Client : public std::enable_shared_from_this<Client> {
 	uint32_t client_id;
 	bool deletion_flag = false;
 	virtual void PostResponse(Response &r) = 0;
-	std::vector<std::shared_ptr<BridgeObject>> owned_objects;
+
+	// Keeps objects handed to this client alive until the client closes
+	// them or goes away.
+	void AdoptObjects(const std::vector<std::shared_ptr<BridgeObject>> &objects);
+	// Forgets about an object the client is closing itself, so it won't be
+	// closed a second time. Returns false if the client didn't own it.
+	bool DisownObject(uint32_t device_id, uint32_t object_id);
+	// Drops every object the client still owns, closing them.
+	void ReleaseObjects();
+ private:
+	static uint64_t ObjectKey(uint32_t device_id, uint32_t object_id);
+	
+	std::mutex owned_objects_mutex;
+	std::unordered_map<uint64_t, std::shared_ptr<BridgeObject>> owned_objects;
 };
 
 class WeakRequest {
  public:
 	WeakRequest();
-	WeakRequest(uint32_t client, uint32_t device_id, uint32_t object_id, uint32_t command_id, uint32_t tag, std::vector<uint8_t> payload);
+	WeakRequest(uint32_t client, uint32_t device_id, uint32_t object_id, uint32_t command_id, uint32_t tag, common::SharedBuffer payload);
 	WeakRequest(uint32_t client, uint32_t device_id, uint32_t object_id, uint32_t command_id, uint32_t tag);
 	Response RespondError(uint32_t code);
 	Response RespondOk();
@@ -67,14 +83,14 @@ class WeakRequest {
 	uint32_t object_id;
 	uint32_t command_id;
 	uint32_t tag;
-	std::vector<uint8_t> payload;
+	common::SharedBuffer payload;
  private:
 };
 
 class Request {
  public:
 	Request();
-	Request(std::shared_ptr<Client> client, uint32_t device_id, uint32_t object_id, uint32_t command_id, uint32_t tag, std::vector<uint8_t> payload);
+	Request(std::shared_ptr<Client> client, uint32_t device_id, uint32_t object_id, uint32_t command_id, uint32_t tag, common::SharedBuffer payload);
 	Request(std::shared_ptr<Client> client, uint32_t device_id, uint32_t object_id, uint32_t command_id, uint32_t tag);
 	Response RespondError(uint32_t code);
 	Response RespondOk();
@@ -85,7 +101,7 @@ class Request {
 	uint32_t object_id;
 	uint32_t command_id;
 	uint32_t tag;
-	std::vector<uint8_t> payload;
+	common::SharedBuffer payload;
  private:
 };
 
@@ -33,6 +33,7 @@ namespace frontend {
 
 NamedPipeFrontend::NamedPipeFrontend(Daemon &daemon, const char *name) : daemon(daemon), pipe_logic(*this), pending_pipe(*this), event_loop(pipe_logic) {
 	LogMessage(Debug, "created NamedPipeFrontend");
+	event_loop.AddMember(pending_pipe);
 	event_loop.Begin();
 }
 
@@ -75,9 +76,6 @@ NamedPipeFrontend::Logic::Logic(NamedPipeFrontend &frontend) : frontend(frontend
 
 void NamedPipeFrontend::Logic::Prepare(platform::EventLoop &loop) {
 	LogMessage(Debug, "NamedPipeFrontend preparing");
-	loop.Clear();
-	loop.AddMember(frontend.pending_pipe);
-
 	for(auto i = frontend.clients.begin(); i != frontend.clients.end(); ) {
 		common::MessageConnection::Request *rq;
 		while((rq = (*i)->connection.Process()) != nullptr) {
@@ -89,7 +87,7 @@ void NamedPipeFrontend::Logic::Prepare(platform::EventLoop &loop) {
 					rq->mh.object_id,
 					rq->mh.command_id,
 					rq->mh.tag,
-					std::vector<uint8_t>(rq->payload.Read(), rq->payload.Read() + rq->payload.ReadAvailable())));
+					rq->payload.TakeData()));
 			LogMessage(Debug, "posted request");
 		}
 
@@ -98,13 +96,20 @@ void NamedPipeFrontend::Logic::Prepare(platform::EventLoop &loop) {
 		}
 		
 		if((*i)->deletion_flag) {
+			if((*i)->registered_flag) {
+				loop.RemoveMember((*i)->connection.input_member);
+				loop.RemoveMember((*i)->connection.output_member);
+			}
 			frontend.daemon.RemoveClient(*i);
 			i = frontend.clients.erase(i);
 			continue;
 		}
 
-		loop.AddMember((*i)->connection.input_member);
-		loop.AddMember((*i)->connection.output_member);
+		if(!(*i)->registered_flag) {
+			loop.AddMember((*i)->connection.input_member);
+			loop.AddMember((*i)->connection.output_member);
+			(*i)->registered_flag = true;
+		}
 		
 		i++;
 	}
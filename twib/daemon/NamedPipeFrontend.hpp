@@ -62,6 +62,7 @@ public:
 		common::NamedPipeMessageConnection connection;
 		NamedPipeFrontend &frontend;
 		Daemon &daemon;
+		bool registered_flag = false; // with the event loop
 	};
 
 private:
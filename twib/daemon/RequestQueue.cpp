@@ -0,0 +1,102 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "RequestQueue.hpp"
+
+#include "common/Logger.hpp"
+
+namespace twili {
+namespace twib {
+namespace daemon {
+
+void RequestQueue::Push(WeakRequest &&request) {
+	PendingRequest p = {
+		WeakRequest(request.client_id, request.device_id, request.object_id, request.command_id, request.tag),
+		false
+	};
+	auto r = pending.try_emplace(PendingKey(request.client_id, request.tag), std::move(p));
+	if(!r.second) {
+		LogMessage(Warning, "client 0x%x reused tag 0x%x while it was still pending", request.client_id, request.tag);
+		if(r.first->second.sent) {
+			outstanding--;
+		}
+		r.first->second = std::move(p);
+	}
+	queue.push_back(std::move(request));
+}
+
+bool RequestQueue::Pop(WeakRequest &out, size_t max_outstanding) {
+	if(queue.empty()) {
+		return false;
+	}
+	if(max_outstanding > 0 && outstanding >= max_outstanding) {
+		return false;
+	}
+
+	out = std::move(queue.front());
+	queue.pop_front();
+
+	auto i = pending.find(PendingKey(out.client_id, out.tag));
+	if(i != pending.end() && !i->second.sent) {
+		i->second.sent = true;
+		outstanding++;
+	}
+	return true;
+}
+
+bool RequestQueue::Complete(uint32_t client_id, uint32_t tag) {
+	auto i = pending.find(PendingKey(client_id, tag));
+	if(i == pending.end()) {
+		return false;
+	}
+	if(i->second.sent) {
+		outstanding--;
+	}
+	pending.erase(i);
+	return true;
+}
+
+std::vector<WeakRequest> RequestQueue::TakePending() {
+	std::vector<WeakRequest> taken;
+	taken.reserve(pending.size());
+	for(auto &i : pending) {
+		taken.push_back(std::move(i.second.request));
+	}
+	pending.clear();
+	queue.clear();
+	outstanding = 0;
+	return taken;
+}
+
+bool RequestQueue::Empty() const {
+	return queue.empty();
+}
+
+size_t RequestQueue::Outstanding() const {
+	return outstanding;
+}
+
+uint64_t RequestQueue::PendingKey(uint32_t client_id, uint32_t tag) {
+	return ((uint64_t) client_id << 32) | tag;
+}
+
+} // namespace daemon
+} // namespace twib
+} // namespace twili
@@ -0,0 +1,69 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<deque>
+#include<unordered_map>
+#include<vector>
+
+#include<stdint.h>
+
+#include "Messages.hpp"
+
+namespace twili {
+namespace twib {
+namespace daemon {
+
+// Bookkeeping for a link that sends requests to a device one at a time and
+// gets responses back in any order. Requests wait in the queue until the
+// link is free (and the device has room for them), and stay pending until
+// the device responds. Doesn't do any locking of its own.
+class RequestQueue {
+ public:
+	void Push(WeakRequest &&request);
+	// Takes the next request to send, unless the queue is empty or
+	// max_outstanding (if nonzero) requests are already waiting on the device.
+	bool Pop(WeakRequest &out, size_t max_outstanding);
+	// Matches a response up with the request it answers. Returns false if no
+	// request from that client with that tag was pending.
+	bool Complete(uint32_t client_id, uint32_t tag);
+	// Removes and returns everything that hasn't been responded to yet, sent
+	// or not. Payloads are not included.
+	std::vector<WeakRequest> TakePending();
+
+	bool Empty() const; // nothing left to send
+	size_t Outstanding() const; // sent, but not responded to
+ private:
+	struct PendingRequest {
+		WeakRequest request; // without payload
+		bool sent;
+	};
+
+	// keyed by (client_id << 32) | tag, since tags are only unique per client
+	static uint64_t PendingKey(uint32_t client_id, uint32_t tag);
+	std::deque<WeakRequest> queue;
+	std::unordered_map<uint64_t, PendingRequest> pending;
+	size_t outstanding = 0;
+};
+
+} // namespace daemon
+} // namespace twib
+} // namespace twili
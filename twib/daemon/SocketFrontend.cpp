@@ -60,6 +60,7 @@ SocketFrontend::SocketFrontend(Daemon &daemon, int address_family, int socktype,
 
 	server_member.socket.Bind(bind_addr, bind_addrlen);
 	server_member.socket.Listen(20);
+	event_loop.AddMember(server_member);
 	event_loop.Begin();
 }
 
@@ -70,6 +71,7 @@ SocketFrontend::SocketFrontend(Daemon &daemon, platform::Socket &&socket) :
 	socktype(SOCK_STREAM),
 	server_logic(*this),
 	event_loop(server_logic) {
+	event_loop.AddMember(server_member);
 	event_loop.Begin();
 }
 
@@ -102,6 +104,7 @@ void SocketFrontend::ServerMember::SignalRead() {
 	platform::Socket client_socket = socket.Accept(nullptr, nullptr);
 	std::shared_ptr<Client> c = std::make_shared<Client>(std::move(client_socket), frontend);
 	frontend.clients.push_back(c);
+	frontend.event_loop.AddMember(c->connection.member);
 	frontend.daemon.AddClient(c);
 }
 
@@ -114,8 +117,6 @@ SocketFrontend::ServerLogic::ServerLogic(SocketFrontend &frontend) : frontend(fr
 }
 
 void SocketFrontend::ServerLogic::Prepare(platform::EventLoop &loop) {
-	loop.Clear();
-	loop.AddMember(frontend.server_member);
 	for(auto i = frontend.clients.begin(); i != frontend.clients.end(); ) {
 		common::MessageConnection::Request *rq;
 		while((rq = (*i)->connection.Process()) != nullptr) {
@@ -127,7 +128,7 @@ void SocketFrontend::ServerLogic::Prepare(platform::EventLoop &loop) {
 					rq->mh.object_id,
 					rq->mh.command_id,
 					rq->mh.tag,
-					std::vector<uint8_t>(rq->payload.Read(), rq->payload.Read() + rq->payload.ReadAvailable())));
+					rq->payload.TakeData()));
 			LogMessage(Debug, "posted request");
 		}
 
@@ -136,12 +137,11 @@ void SocketFrontend::ServerLogic::Prepare(platform::EventLoop &loop) {
 		}
 		
 		if((*i)->deletion_flag) {
+			loop.RemoveMember((*i)->connection.member);
 			frontend.daemon.RemoveClient(*i);
 			i = frontend.clients.erase(i);
 			continue;
 		}
-
-		loop.AddMember((*i)->connection.member);
 		
 		i++;
 	}
@@ -20,9 +20,12 @@
 
 #include "TCPBackend.hpp"
 
+#include "common/config.hpp"
+
 #include "platform/platform.hpp"
 
 #include "Daemon.hpp"
+#include "err.hpp"
 
 namespace twili {
 namespace twib {
@@ -48,6 +51,7 @@ TCPBackend::TCPBackend(Daemon &daemon) :
 		exit(1);
 	}
 
+	event_loop.AddMember(listen_member);
 	event_loop.Begin();
 }
 
@@ -109,9 +113,30 @@ TCPBackend::Device::Device(platform::Socket &&socket, TCPBackend &backend) :
 }
 
 TCPBackend::Device::~Device() {
+	std::lock_guard<std::mutex> lock(pending_requests_mutex);
+	for(auto &i : pending_requests) {
+		WeakRequest &r = i.second.request;
+		if(r.client_id != 0xffffffff && !i.second.abandoned) {
+			backend.daemon.PostResponse(r.RespondError(TWILI_ERR_PROTOCOL_TRANSFER_ERROR));
+		}
+	}
+	for(Request &r : request_backlog) {
+		if(r.client) {
+			backend.daemon.PostResponse(r.RespondError(TWILI_ERR_PROTOCOL_TRANSFER_ERROR));
+		}
+	}
+}
+
+uint64_t TCPBackend::Device::PendingKey(uint32_t client_id, uint32_t tag) {
+	return ((uint64_t) client_id << 32) | tag;
 }
 
 void TCPBackend::Device::Begin() {
+	// The socket doesn't care how responses are chunked, but the bridge
+	// buffers a chunk per response it's writing. 64 KiB by default is four
+	// times the bridge's own default, which cuts down on send calls for
+	// large reads, while staying well under its 256 KiB limit.
+	SendRequest(MakeHelloRequest(TWIBD_TCP_TRANSFER_SIZE));
 	SendRequest(Request(std::shared_ptr<Client>(), 0x0, 0x0, (uint32_t) protocol::ITwibDeviceInterface::Command::IDENTIFY, 0xFFFFFFFF, std::vector<uint8_t>()));
 }
 
@@ -121,7 +146,7 @@ void TCPBackend::Device::IncomingMessage(protocol::MessageHeader &mh, util::Buff
 	response_in.object_id = mh.object_id;
 	response_in.result_code = mh.result_code;
 	response_in.tag = mh.tag;
-	response_in.payload = std::vector<uint8_t>(payload.Read(), payload.Read() + payload.ReadAvailable());
+	response_in.payload = payload.TakeData();
 	
 	// create BridgeObjects
 	response_in.objects.resize(mh.object_count);
@@ -131,21 +156,44 @@ void TCPBackend::Device::IncomingMessage(protocol::MessageHeader &mh, util::Buff
 			LogMessage(Error, "not enough object IDs");
 			return;
 		}
-		response_in.objects[i] = std::make_shared<BridgeObject>(backend.daemon, mh.device_id, id);
+		response_in.objects[i] = std::make_shared<BridgeObject>(backend.daemon, device_id, id);
 	}
 
 	// remove from pending requests
-	pending_requests.remove_if([this](WeakRequest &r) {
-			return r.tag == response_in.tag;
-		});
+	{
+		std::lock_guard<std::mutex> lock(pending_requests_mutex);
+		auto i = pending_requests.find(PendingKey(response_in.client_id, response_in.tag));
+		if(i == pending_requests.end()) {
+			LogMessage(Debug, "dropping response for request that was not pending (client 0x%x, tag 0x%x)", response_in.client_id, response_in.tag);
+			return;
+		}
+		bool abandoned = i->second.abandoned;
+		pending_requests.erase(i);
+		DrainBacklog();
+		if(abandoned) {
+			LogMessage(Debug, "dropping response for abandoned request (client 0x%x, tag 0x%x)", response_in.client_id, response_in.tag);
+			return;
+		}
+	}
 	
 	if(response_in.client_id == 0xFFFFFFFF) { // identification meta-client
-		Identified(response_in);
+		if(response_in.tag == HelloTag) {
+			Negotiated(response_in);
+		} else {
+			Identified(response_in);
+		}
 	} else {
 		backend.daemon.PostResponse(std::move(response_in));
 	}
 }
 
+void TCPBackend::Device::Negotiated(Response &r) {
+	std::lock_guard<std::mutex> lock(pending_requests_mutex);
+	if(ApplyHelloResponse(r)) {
+		connection.compression_enabled = features & protocol::FEATURE_COMPRESSION;
+	}
+}
+
 void TCPBackend::Device::Identified(Response &r) {
 	LogMessage(Debug, "got identification response back");
 	LogMessage(Debug, "payload size: 0x%x", r.payload.size());
@@ -169,6 +217,22 @@ void TCPBackend::Device::Identified(Response &r) {
 }
 
 void TCPBackend::Device::SendRequest(const Request &&r) {
+	std::lock_guard<std::mutex> lock(pending_requests_mutex);
+	if(max_outstanding_requests > 0 && (!request_backlog.empty() || pending_requests.size() >= max_outstanding_requests)) {
+		request_backlog.push_back(r);
+		return;
+	}
+	TransmitRequest(r);
+}
+
+void TCPBackend::Device::DrainBacklog() {
+	while(!request_backlog.empty() && (max_outstanding_requests == 0 || pending_requests.size() < max_outstanding_requests)) {
+		TransmitRequest(request_backlog.front());
+		request_backlog.pop_front();
+	}
+}
+
+void TCPBackend::Device::TransmitRequest(const Request &r) {
 	protocol::MessageHeader mhdr;
 	mhdr.client_id = r.client ? r.client->client_id : 0xffffffff;
 	mhdr.object_id = r.object_id;
@@ -177,7 +241,9 @@ void TCPBackend::Device::SendRequest(const Request &&r) {
 	mhdr.payload_size = r.payload.size();
 	mhdr.object_count = 0;
 
-	pending_requests.push_back(r.Weak());
+	pending_requests[PendingKey(mhdr.client_id, mhdr.tag)] = PendingRequest {
+		WeakRequest(mhdr.client_id, r.device_id, r.object_id, r.command_id, r.tag),
+		std::chrono::steady_clock::now()};
 
 	/* TODO: request objects
 	std::vector<uint32_t> object_ids(r.objects.size(), 0);
@@ -190,6 +256,57 @@ void TCPBackend::Device::SendRequest(const Request &&r) {
 	connection.SendMessage(mhdr, r.payload, std::vector<uint32_t>());
 }
 
+void TCPBackend::Device::SweepPendingRequests() {
+	// the event loop has no timers, so this only runs when it wakes up for
+	// some other reason. throttle it so busy connections don't pay for it.
+	auto now = std::chrono::steady_clock::now();
+	if(now - last_sweep < std::chrono::seconds(1)) {
+		return;
+	}
+	last_sweep = now;
+
+	std::vector<Response> failed;
+	{
+		std::lock_guard<std::mutex> lock(pending_requests_mutex);
+		// requests that haven't been sent yet can really be cancelled
+		for(auto i = request_backlog.begin(); i != request_backlog.end(); ) {
+			if(i->client && !backend.daemon.GetClient(i->client->client_id)) {
+				i = request_backlog.erase(i);
+			} else {
+				i++;
+			}
+		}
+		
+		// the rest are in the device's hands, so all we can do is stop
+		// waiting for them
+		for(auto &i : pending_requests) {
+			WeakRequest &r = i.second.request;
+			if(r.client_id == 0xffffffff) { // identification meta-client
+				continue;
+			}
+			if(i.second.abandoned) {
+				continue;
+			}
+			if(!backend.daemon.GetClient(r.client_id)) {
+				// nobody left to receive the response
+				i.second.abandoned = true;
+				continue;
+			}
+#if TWIBD_TCP_REQUEST_TIMEOUT > 0
+			if(now - i.second.sent > std::chrono::seconds(TWIBD_TCP_REQUEST_TIMEOUT)) {
+				LogMessage(Warning, "request timed out (client 0x%x, object 0x%x, command 0x%x)", r.client_id, r.object_id, r.command_id);
+				failed.push_back(r.RespondError(TWILI_ERR_PROTOCOL_TRANSFER_ERROR));
+				i.second.abandoned = true;
+			}
+#endif
+		}
+	}
+
+	for(Response &rs : failed) {
+		backend.daemon.PostResponse(std::move(rs));
+	}
+}
+
 int TCPBackend::Device::GetPriority() {
 	return 1; // lower priority than USB devices
 }
@@ -233,9 +350,14 @@ TCPBackend::ServerLogic::ServerLogic(TCPBackend &backend) : backend(backend) {
 }
 
 void TCPBackend::ServerLogic::Prepare(platform::EventLoop &loop) {
-	loop.Clear();
-	loop.AddMember(backend.listen_member);
 	for(auto i = backend.devices.begin(); i != backend.devices.end(); ) {
+		// devices can be connected from other threads, so they get added to
+		// the loop here
+		if(!(*i)->registered_flag) {
+			loop.AddMember((*i)->connection.member);
+			(*i)->registered_flag = true;
+		}
+		
 		common::MessageConnection::Request *rq;
 		while((rq = (*i)->connection.Process()) != nullptr) {
 			(*i)->IncomingMessage(rq->mh, rq->payload, rq->object_ids);
@@ -245,10 +367,13 @@ void TCPBackend::ServerLogic::Prepare(platform::EventLoop &loop) {
 			(*i)->deletion_flag = true;
 		}
 		
+		(*i)->SweepPendingRequests();
+		
 		if((*i)->deletion_flag) {
 			if((*i)->added_flag) {
 				backend.daemon.RemoveDevice(*i);
 			}
+			loop.RemoveMember((*i)->connection.member);
 			i = backend.devices.erase(i);
 			continue;
 		} else {
@@ -257,8 +382,6 @@ void TCPBackend::ServerLogic::Prepare(platform::EventLoop &loop) {
 				(*i)->added_flag = true;
 			}
 		}
-
-		loop.AddMember((*i)->connection.member);
 		
 		i++;
 	}
@@ -24,6 +24,9 @@
 
 #include<thread>
 #include<list>
+#include<deque>
+#include<unordered_map>
+#include<chrono>
 #include<queue>
 #include<mutex>
 #include<condition_variable>
@@ -57,18 +60,43 @@ class TCPBackend {
 		~Device();
 
 		void Begin();
+		void Negotiated(Response &r);
 		void Identified(Response &r);
 		void IncomingMessage(protocol::MessageHeader &mh, util::Buffer &payload, util::Buffer &object_ids);
 		virtual void SendRequest(const Request &&r) override;
+		void TransmitRequest(const Request &r); // assumes pending_requests_mutex is held
+		void DrainBacklog(); // assumes pending_requests_mutex is held
 		virtual int GetPriority() override;
 		virtual std::string GetBridgeType() override;
+		// fails requests that have timed out, and drops the ones whose client
+		// has gone away
+		void SweepPendingRequests();
 		
 		TCPBackend &backend;
 		common::SocketMessageConnection connection;
-		std::list<WeakRequest> pending_requests;
+
+		struct PendingRequest {
+			WeakRequest request;
+			std::chrono::steady_clock::time_point sent;
+			// Nobody is waiting for the response anymore, because the
+			// client went away or the request already failed with a
+			// timeout. The device is still working on it though, so it
+			// keeps counting against max_outstanding_requests until the
+			// response comes in and gets dropped.
+			bool abandoned = false;
+		};
+		// keyed by (client_id << 32) | tag, since tags are only unique per client
+		static uint64_t PendingKey(uint32_t client_id, uint32_t tag);
+		std::mutex pending_requests_mutex;
+		std::unordered_map<uint64_t, PendingRequest> pending_requests;
+		// requests held back because the device has as many outstanding as
+		// it said it can take
+		std::deque<Request> request_backlog;
+		std::chrono::steady_clock::time_point last_sweep;
 		Response response_in;
 		bool ready_flag = false;
 		bool added_flag = false;
+		bool registered_flag = false; // with the event loop
 	};
 
  private:
@@ -22,10 +22,11 @@
 
 #include "common/config.hpp"
 
+#include<algorithm>
+
 #include<msgpack11.hpp>
 
 #include "Daemon.hpp"
-#include "err.hpp"
 
 void show(msgpack11::MsgPack const& blob);
 
@@ -77,366 +78,95 @@ USBBackend::~USBBackend() {
 	event_thread.join();
 }
 
-USBBackend::Device::Device(USBBackend *backend, libusb_device_handle *handle, uint8_t endp_addrs[4], uint8_t interface_number) :
-	backend(backend), handle(handle),
-	endp_meta_out(endp_addrs[0]), endp_meta_in(endp_addrs[2]),
-	endp_data_out(endp_addrs[1]), endp_data_in(endp_addrs[3]),
-	interface_number(interface_number),
-	isl_lock(backend->daemon.initial_scan_lock) {
-	
-	tfer_meta_out = libusb_alloc_transfer(0);
-	tfer_data_out = libusb_alloc_transfer(0);
-	tfer_meta_in = libusb_alloc_transfer(0);
-	tfer_data_in = libusb_alloc_transfer(0);
+USBBackend::LibusbTransport::LibusbTransport(libusb_device_handle *handle, uint8_t endp_addrs[4], uint8_t interface_number) :
+	handle(handle),
+	interface_number(interface_number) {
+	std::copy(endp_addrs, endp_addrs + 4, endpoints);
 }
 
-USBBackend::Device::~Device() {
-	for(auto r : pending_requests) {
-		if(r.client_id != 0xffffffff) {
-			backend->daemon.PostResponse(r.RespondError(TWILI_ERR_PROTOCOL_TRANSFER_ERROR));
-		}
-	}
-	Destroy();
-	libusb_free_transfer(tfer_meta_out);
-	libusb_free_transfer(tfer_data_out);
-	libusb_free_transfer(tfer_meta_in);
-	libusb_free_transfer(tfer_data_in);
+USBBackend::LibusbTransport::~LibusbTransport() {
 	libusb_release_interface(handle, interface_number);
 	libusb_close(handle);
 }
 
-void USBBackend::Device::Begin() {
-	ResubmitMetaInTransfer();
-
-	// request identification
-	SendRequest(Request(std::shared_ptr<Client>(), 0x0, 0x0, (uint32_t) protocol::ITwibDeviceInterface::Command::IDENTIFY, 0xFFFFFFFF, std::vector<uint8_t>()));
+USBBackend::LibusbTransport::Transfer::Transfer() {
+	tfer = libusb_alloc_transfer(0);
 }
 
-void USBBackend::Device::Destroy() {
-	libusb_cancel_transfer(tfer_meta_out);
-	libusb_cancel_transfer(tfer_data_out);
-	libusb_cancel_transfer(tfer_meta_in);
-	libusb_cancel_transfer(tfer_data_in);
-	if(isl_lock) { isl_lock.unlock(); }
+USBBackend::LibusbTransport::Transfer::~Transfer() {
+	libusb_free_transfer(tfer);
 }
 
-void USBBackend::Device::MarkAdded() {
-	if(isl_lock) {
-		isl_lock.unlock();
-	}
-	added_flag = true;
+std::unique_ptr<USBTransport::Transfer> USBBackend::LibusbTransport::AllocTransfer() {
+	return std::make_unique<Transfer>();
 }
 
-void USBBackend::Device::SendRequest(const Request &&request) {
-	std::unique_lock<std::mutex> lock(state_mutex);
-	while(state != State::AVAILABLE && !deletion_flag) {
-		state_cv.wait(lock);
-	}
-	if(deletion_flag) { return; }
-	state = State::BUSY;
-	
-	/*
-	LogMessage(Debug, "sending request");
-	LogMessage(Debug, "  client id 0x%x", request.client ? request.client->client_id : 0xffffffff);
-	LogMessage(Debug, "  object id 0x%x", request.object_id);
-	LogMessage(Debug, "  command id 0x%x", request.command_id);
-	LogMessage(Debug, "  tag 0x%x", request.tag);
-	LogMessage(Debug, "  payload size 0x%lx", request.payload.size());
-	*/
-	
-	mhdr.client_id = request.client ? request.client->client_id : 0xffffffff;
-	mhdr.object_id = request.object_id;
-	mhdr.command_id = request.command_id;
-	mhdr.tag = request.tag;
-	mhdr.payload_size = request.payload.size();
-	mhdr.object_count = 0;
-
-	request_out = request.Weak();
-	pending_requests.push_back(request_out);
-
-	libusb_fill_bulk_transfer(tfer_meta_out, handle, endp_meta_out, (uint8_t*) &mhdr, sizeof(mhdr), &Device::MetaOutTransferShim, SharedPtrForTransfer(), 5000);
-	transferring_meta = true;
-	int r = libusb_submit_transfer(tfer_meta_out);
+bool USBBackend::LibusbTransport::Submit(USBTransport::Transfer &t, Endpoint endpoint, uint8_t *buffer, size_t size, USBTransport::Transfer::Callback cb, unsigned int timeout) {
+	Transfer &lt = (Transfer&) t;
+	lt.callback = cb;
+	lt.length = size;
+	lt.actual_length = 0;
+	libusb_fill_bulk_transfer(lt.tfer, handle, endpoints[(int) endpoint], buffer, size, &LibusbTransport::TransferShim, &lt, timeout);
+	int r = libusb_submit_transfer(lt.tfer);
 	if(r != 0) {
 		LogMessage(Debug, "transfer failed: %s", libusb_error_name(r));
-		Kill();
-		return;
-	}
-}
-
-int USBBackend::Device::GetPriority() {
-	return 2; // USB devices are a higher priority than TCP devices
-}
-
-std::string USBBackend::Device::GetBridgeType() {
-	return "usb";
-}
-
-void USBBackend::Device::Kill() {
-	deletion_flag = true;
-	if(isl_lock) { isl_lock.unlock(); }
-	state_cv.notify_all();
-}
-
-std::shared_ptr<USBBackend::Device> *USBBackend::Device::SharedPtrForTransfer() {
-	return new std::shared_ptr<Device>(shared_from_this());
-}
-
-void USBBackend::Device::MetaOutTransferCompleted() {
-	LogMessage(Debug, "finished transferring meta");
-	std::unique_lock<std::mutex> lock(state_mutex);
-
-	if(request_out.payload.size() > 0) {
-		LogMessage(Debug, "transferring data");
-		libusb_fill_bulk_transfer(tfer_data_out, handle, endp_data_out, (uint8_t*) request_out.payload.data(), LimitTransferSize(request_out.payload.size()), &Device::DataOutTransferShim, SharedPtrForTransfer(), 5000);
-		transferring_data = true;
-		int r = libusb_submit_transfer(tfer_data_out);
-		if(r != 0) {
-			LogMessage(Debug, "transfer failed: %s", libusb_error_name(r));
-			Kill();
-			return;
-		}
-	}
-
-	transferring_meta = false;
-	if(!transferring_meta && !transferring_data) {
-		LogMessage(Debug, "entering AVAILABLE state");
-		state = State::AVAILABLE;
-		state_cv.notify_one();
-	}
-}
-
-void USBBackend::Device::DataOutTransferCompleted() {
-	size_t beg_off = (tfer_data_out->buffer - request_out.payload.data());
-	size_t read = beg_off + tfer_data_out->actual_length;
-	size_t remaining = mhdr.payload_size - read;
-	LogMessage(Debug, "send request data 0x%x/0x%x. 0x%x remaining", read, request_out.payload.size(), remaining);
-
-	if(remaining > 0) {
-		// continue transferring
-		libusb_fill_bulk_transfer(tfer_data_out, handle, endp_data_out,
-															request_out.payload.data() + read,
-															LimitTransferSize(remaining),
-															&Device::DataOutTransferShim, SharedPtrForTransfer(), 15000);
-		int r = libusb_submit_transfer(tfer_data_out);
-		if(r != 0) {
-			LogMessage(Debug, "transfer failed: %s", libusb_error_name(r));
-			Kill();
-			return;
-		}
-		return;
-	} else {
-		LogMessage(Debug, "finished transferring data");
-		std::unique_lock<std::mutex> lock(state_mutex);
-		
-		transferring_data = false;
-		if(!transferring_meta && !transferring_data) {
-			LogMessage(Debug, "entering AVAILABLE state");
-			state = State::AVAILABLE;
-			state_cv.notify_one();
-		}
-	}
-}
-
-void USBBackend::Device::MetaInTransferCompleted() {
-	/*
-  LogMessage(Debug, "got response header");
-	LogMessage(Debug, "  client id: 0x%x", mhdr_in.client_id);
-	LogMessage(Debug, "  object_id: 0x%x", mhdr_in.object_id);
-	LogMessage(Debug, "  result_code: 0x%x", mhdr_in.result_code);
-	LogMessage(Debug, "  tag: 0x%x", mhdr_in.tag);
-	LogMessage(Debug, "  payload_size: 0x%lx", mhdr_in.payload_size);
-	LogMessage(Debug, "  object_count: %d", mhdr_in.object_count);
-  */
-
-	response_in.device_id = device_id;
-	response_in.client_id = mhdr_in.client_id;
-	response_in.object_id = mhdr_in.object_id;
-	response_in.result_code = mhdr_in.result_code;
-	response_in.tag = mhdr_in.tag;
-	response_in.payload.resize(mhdr_in.payload_size);
-	object_ids_in.resize(mhdr_in.object_count);
-	
-	if(mhdr_in.payload_size > 0) {
-		libusb_fill_bulk_transfer(tfer_data_in, handle, endp_data_in, response_in.payload.data(), LimitTransferSize(response_in.payload.size()), &Device::DataInTransferShim, SharedPtrForTransfer(), 5000);
-		int r = libusb_submit_transfer(tfer_data_in);
-		if(r != 0) {
-			LogMessage(Debug, "transfer failed: %s", libusb_error_name(r));
-			Kill();
-			return;
-		}
-	} else if(mhdr_in.object_count > 0) {
-		libusb_fill_bulk_transfer(tfer_data_in, handle, endp_data_in, (uint8_t*) object_ids_in.data(), object_ids_in.size() * sizeof(uint32_t), &Device::ObjectInTransferShim, SharedPtrForTransfer(), 5000);
-		int r = libusb_submit_transfer(tfer_data_in);
-		if(r != 0) {
-			LogMessage(Debug, "transfer failed: %s", libusb_error_name(r));
-			Kill();
-			return;
-		}
-	} else {
-		DispatchResponse();
-	}
-}
-
-void USBBackend::Device::DataInTransferCompleted() {
-	size_t beg_off = (tfer_data_in->buffer - response_in.payload.data());
-	size_t read = beg_off + tfer_data_in->actual_length;
-	size_t remaining = mhdr_in.payload_size - read;
-
-	if(remaining > 0) {
-		// continue transferring
-		libusb_fill_bulk_transfer(tfer_data_in, handle, endp_data_in,
-															response_in.payload.data() + read,
-															LimitTransferSize(remaining),
-															&Device::DataInTransferShim, SharedPtrForTransfer(), 15000);
-		int r = libusb_submit_transfer(tfer_data_in);
-		if(r != 0) {
-			LogMessage(Debug, "transfer failed: %s", libusb_error_name(r));
-			Kill();
-			return;
-		}
-		return;
-	}
-
-	if(mhdr_in.object_count > 0) {
-		libusb_fill_bulk_transfer(tfer_data_in, handle, endp_data_in, (uint8_t*) object_ids_in.data(), object_ids_in.size() * sizeof(uint32_t), &Device::ObjectInTransferShim, SharedPtrForTransfer(), 5000);
-		int r = libusb_submit_transfer(tfer_data_in);
-		if(r != 0) {
-			LogMessage(Debug, "transfer failed: %s", libusb_error_name(r));
-			Kill();
-			return;
-		}
-	} else {
-		DispatchResponse();
-	}
-}
-
-void USBBackend::Device::ObjectInTransferCompleted() {
-	if(tfer_data_in->actual_length != mhdr_in.object_count * sizeof(uint32_t)) {
-		LogMessage(Debug, "invalid object ID transfer\n");
-		Kill();
-		return;
-	}
-
-	DispatchResponse();
-}
-
-void USBBackend::Device::DispatchResponse() {
-	// create BridgeObjects
-	response_in.objects.resize(object_ids_in.size());
-	std::transform(
-		object_ids_in.begin(), object_ids_in.end(), response_in.objects.begin(),
-		[this](uint32_t id) {
-			return std::make_shared<BridgeObject>(backend->daemon, response_in.device_id, id);
-		});
-
-	// remove from pending requests
-	pending_requests.remove_if([this](WeakRequest &r) {
-			return r.tag == response_in.tag;
-		});
-	
-	if(response_in.client_id == 0xFFFFFFFF) { // identification meta-client
-		Identified(response_in);
-	} else {
-		backend->daemon.PostResponse(std::move(response_in));
-	}
-	ResubmitMetaInTransfer();
-}
-
-void USBBackend::Device::Identified(Response &r) {
-	LogMessage(Debug, "got identification response back");
-	LogMessage(Debug, "payload size: 0x%x", r.payload.size());
-	if(r.result_code != 0) {
-		LogMessage(Warning, "device identification error: 0x%x", r.result_code);
-		Kill();
-		return;
+		return false;
 	}
-	std::string err;
-	msgpack11::MsgPack obj = msgpack11::MsgPack::parse(std::string(r.payload.begin() + 8, r.payload.end()), err);
-	identification = obj;
-	device_nickname = obj["device_nickname"].string_value();
-	serial_number = obj["serial_number"].string_value();
-
-	LogMessage(Info, "nickname: %s", device_nickname.c_str());
-	LogMessage(Info, "serial number: %s", serial_number.c_str());
-	
-	device_id = std::hash<std::string>()(serial_number);
-	LogMessage(Info, "assigned device id: %08x", device_id);
-	ready_flag = true;
+	return true;
 }
 
-void USBBackend::Device::ResubmitMetaInTransfer() {
-	LogMessage(Debug, "submitting meta in transfer");
-	libusb_fill_bulk_transfer(tfer_meta_in, handle, endp_meta_in, (uint8_t*) &mhdr_in, sizeof(mhdr_in), &Device::MetaInTransferShim, SharedPtrForTransfer(), 600000);
-	int r = libusb_submit_transfer(tfer_meta_in);
-	if(r != 0) {
-		LogMessage(Debug, "transfer failed: %s", libusb_error_name(r));
-		Kill();
-	}
+void USBBackend::LibusbTransport::Cancel(USBTransport::Transfer &t) {
+	libusb_cancel_transfer(((Transfer&) t).tfer);
 }
 
-bool USBBackend::Device::CheckTransfer(libusb_transfer *tfer) {
-	if(tfer->status != LIBUSB_TRANSFER_COMPLETED) {
-		LogMessage(Debug, "transfer failed (status = %d)", tfer->status);
-		Kill();
-		return true;
-	} else {
-		return false;
+void USBBackend::LibusbTransport::TransferShim(libusb_transfer *tfer) {
+	Transfer *t = (Transfer*) tfer->user_data;
+	switch(tfer->status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+		t->status = Status::Completed;
+		break;
+	case LIBUSB_TRANSFER_TIMED_OUT:
+		t->status = Status::TimedOut;
+		break;
+	default:
+		LogMessage(Debug, "libusb transfer status = %d", tfer->status);
+		t->status = Status::Failed;
+		break;
 	}
+	t->actual_length = tfer->actual_length;
+	t->callback(*t);
 }
 
-size_t USBBackend::Device::LimitTransferSize(size_t sz) {
-	const size_t max_size = 0x10000;
-	if(sz > max_size) {
-		return max_size;
-	} else {
-		return sz;
-	}
+USBBackend::Device::Device(USBBackend *backend, libusb_device_handle *handle, uint8_t endp_addrs[4], uint8_t interface_number) :
+	USBDevice(
+		std::make_unique<LibusbTransport>(handle, endp_addrs, interface_number),
+		TWIBD_LIBUSB_TRANSFER_SIZE, TWIBD_LIBUSB_TRANSFER_COUNT),
+	backend(backend),
+	isl_lock(backend->daemon.initial_scan_lock) {
 }
 
-void USBBackend::Device::MetaOutTransferShim(libusb_transfer *tfer) {
-	LogMessage(Debug, "meta out transfer shim, status = %d", tfer->status);
-	std::shared_ptr<Device> *d = (std::shared_ptr<Device> *) tfer->user_data;
-	if(!(*d)->CheckTransfer(tfer)) {
-		(*d)->MetaOutTransferCompleted();
-	}
-	delete d;
+USBBackend::Device::~Device() {
+	FailPendingRequests();
 }
 
-void USBBackend::Device::DataOutTransferShim(libusb_transfer *tfer) {
-	std::shared_ptr<Device> *d = (std::shared_ptr<Device> *) tfer->user_data;
-	if(!(*d)->CheckTransfer(tfer)) {
-		(*d)->DataOutTransferCompleted();
-	}
-	delete d;
+void USBBackend::Device::Destroy() {
+	USBDevice::Destroy();
+	if(isl_lock) { isl_lock.unlock(); }
 }
 
-void USBBackend::Device::MetaInTransferShim(libusb_transfer *tfer) {
-	std::shared_ptr<Device> *d = (std::shared_ptr<Device> *) tfer->user_data;
-	if(tfer->status == LIBUSB_TRANSFER_TIMED_OUT) {
-		(*d)->ResubmitMetaInTransfer();
-	} else {
-		if(!(*d)->CheckTransfer(tfer)) {
-			(*d)->MetaInTransferCompleted();
-		}
+void USBBackend::Device::MarkAdded() {
+	if(isl_lock) {
+		isl_lock.unlock();
 	}
-	delete d;
+	added_flag = true;
 }
 
-void USBBackend::Device::DataInTransferShim(libusb_transfer *tfer) {
-	std::shared_ptr<Device> *d = (std::shared_ptr<Device> *) tfer->user_data;
-	if(!(*d)->CheckTransfer(tfer)) {
-		(*d)->DataInTransferCompleted();
-	}
-	delete d;
+void USBBackend::Device::PostResponse(Response &&r) {
+	backend->daemon.PostResponse(std::move(r));
 }
 
-void USBBackend::Device::ObjectInTransferShim(libusb_transfer *tfer) {
-	std::shared_ptr<Device> *d = (std::shared_ptr<Device> *) tfer->user_data;
-	if(!(*d)->CheckTransfer(tfer)) {
-		(*d)->ObjectInTransferCompleted();
-	}
-	delete d;
+std::shared_ptr<BridgeObject> USBBackend::Device::MakeObject(uint32_t object_id) {
+	return std::make_shared<BridgeObject>(backend->daemon, device_id, object_id);
 }
 
 void USBBackend::Probe() {
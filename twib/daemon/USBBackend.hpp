@@ -21,12 +21,14 @@
 #pragma once
 
 #include "platform/platform.hpp"
+#include "common/config.hpp"
 
+#include<atomic>
 #include<thread>
 #include<list>
 #include<queue>
+#include<unordered_map>
 #include<mutex>
-#include<condition_variable>
 
 #include<libusb.h>
 
@@ -35,6 +37,8 @@
 #include "Messages.hpp"
 #include "Protocol.hpp"
 #include "InitialScanLock.hpp"
+#include "USBDevice.hpp"
+#include "USBTransport.hpp"
 
 namespace twili {
 namespace twib {
@@ -57,71 +61,47 @@ class USBBackend {
 		libusb_context *ctx;
 	};
 	
-	class Device : public daemon::Device, public std::enable_shared_from_this<Device> {
+	// USBTransport over a claimed libusb interface
+	class LibusbTransport : public USBTransport {
 	 public:
-		Device(USBBackend *backend, libusb_device_handle *device, uint8_t endp_addrs[4], uint8_t interface_number);
-		~Device();
+		LibusbTransport(libusb_device_handle *handle, uint8_t endp_addrs[4], uint8_t interface_number);
+		~LibusbTransport();
 
-		enum class State {
-			AVAILABLE, BUSY
+		virtual std::unique_ptr<USBTransport::Transfer> AllocTransfer() override;
+		virtual bool Submit(USBTransport::Transfer &t, Endpoint endpoint, uint8_t *buffer, size_t size, USBTransport::Transfer::Callback cb, unsigned int timeout) override;
+		virtual void Cancel(USBTransport::Transfer &t) override;
+	 private:
+		class Transfer : public USBTransport::Transfer {
+		 public:
+			Transfer();
+			Transfer(const Transfer &other) = delete;
+			~Transfer();
+
+			libusb_transfer *tfer;
 		};
 
-		void Begin();
-		void Destroy();
-		void MarkAdded();
+		static void TransferShim(libusb_transfer *tfer);
 		
-		// thread-agnostic
-		virtual void SendRequest(const Request &&r) override;
+		libusb_device_handle *handle;
+		uint8_t interface_number;
+		uint8_t endpoints[4]; // indexed by Endpoint
+	};
+	
+	class Device : public USBDevice {
+	 public:
+		Device(USBBackend *backend, libusb_device_handle *device, uint8_t endp_addrs[4], uint8_t interface_number);
+		~Device();
 
-		virtual int GetPriority() override;
-		virtual std::string GetBridgeType() override;
+		virtual void Destroy() override;
+		void MarkAdded();
 		
-		bool ready_flag = false;
 		bool added_flag = false;
+	 protected:
+		virtual void PostResponse(Response &&r) override;
+		virtual std::shared_ptr<BridgeObject> MakeObject(uint32_t object_id) override;
 	 private:
 		USBBackend *backend;
-		
-		libusb_device_handle *handle;
-		uint8_t interface_number;
-		uint8_t endp_meta_out;
-		uint8_t endp_data_out;
-		uint8_t endp_meta_in;
-		uint8_t endp_data_in;
-		libusb_transfer *tfer_meta_out = NULL;
-		libusb_transfer *tfer_data_out = NULL;
-		libusb_transfer *tfer_meta_in = NULL;
-		libusb_transfer *tfer_data_in = NULL;
-		State state = State::AVAILABLE;
-		bool transferring_meta = false;
-		bool transferring_data = false;
-		std::mutex state_mutex;
-		std::condition_variable state_cv;
-		protocol::MessageHeader mhdr;
-		protocol::MessageHeader mhdr_in;
-		WeakRequest request_out;
-		Response response_in;
-		std::vector<uint32_t> object_ids_in;
-		std::list<WeakRequest> pending_requests;
-
 		std::unique_lock<InitialScanLock> isl_lock;
-
-		void Kill();
-		std::shared_ptr<Device> *SharedPtrForTransfer();
-		void MetaOutTransferCompleted();
-		void DataOutTransferCompleted();
-		void MetaInTransferCompleted();
-		void DataInTransferCompleted();
-		void ObjectInTransferCompleted();
-		void DispatchResponse();
-		void Identified(Response &r);
-		void ResubmitMetaInTransfer();
-		bool CheckTransfer(libusb_transfer *tfer);
-		static size_t LimitTransferSize(size_t size);
-		static void MetaOutTransferShim(libusb_transfer *tfer);
-		static void DataOutTransferShim(libusb_transfer *tfer);
-		static void MetaInTransferShim(libusb_transfer *tfer);
-		static void DataInTransferShim(libusb_transfer *tfer);
-		static void ObjectInTransferShim(libusb_transfer *tfer);
 	};
 
 	void Probe();
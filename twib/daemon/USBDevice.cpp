@@ -0,0 +1,410 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "USBDevice.hpp"
+
+#include<algorithm>
+
+#include<msgpack11.hpp>
+
+#include "common/Logger.hpp"
+
+#include "Compression.hpp"
+#include "err.hpp"
+
+namespace twili {
+namespace twib {
+namespace daemon {
+namespace backend {
+
+USBDevice::Transfer::Transfer(USBTransport &transport, size_t buffer_size) :
+	tfer(transport.AllocTransfer()),
+	buffer(buffer_size) {
+	tfer->user_data = this;
+}
+
+USBDevice::USBDevice(std::unique_ptr<USBTransport> transport, size_t transfer_size, size_t transfer_count) :
+	transport(std::move(transport)),
+	transfer_size_limit(transfer_size),
+	tfer_meta_out(*this->transport),
+	tfer_meta_in(*this->transport),
+	transfer_size(transfer_size) {
+	
+	for(size_t i = 0; i < transfer_count; i++) {
+		// out transfers point straight into the request payload
+		tfers_data_out.emplace_back(std::make_unique<Transfer>(*this->transport));
+		free_data_out.push_back(tfers_data_out.back().get());
+		
+		tfers_data_in.emplace_back(std::make_unique<Transfer>(*this->transport, transfer_size));
+		free_data_in.push_back(tfers_data_in.back().get());
+	}
+}
+
+USBDevice::~USBDevice() {
+	Destroy();
+}
+
+void USBDevice::Begin() {
+	ResubmitMetaInTransfer();
+
+	// find out what the bridge supports, then request identification
+	SendRequest(MakeHelloRequest(transfer_size_limit));
+	SendRequest(Request(std::shared_ptr<Client>(), 0x0, 0x0, (uint32_t) protocol::ITwibDeviceInterface::Command::IDENTIFY, 0xFFFFFFFF, std::vector<uint8_t>()));
+}
+
+void USBDevice::Destroy() {
+	transport->Cancel(*tfer_meta_out.tfer);
+	transport->Cancel(*tfer_meta_in.tfer);
+	for(auto &t : tfers_data_out) {
+		transport->Cancel(*t->tfer);
+	}
+	for(auto &t : tfers_data_in) {
+		transport->Cancel(*t->tfer);
+	}
+}
+
+void USBDevice::FailPendingRequests() {
+	std::vector<WeakRequest> pending;
+	{
+		std::unique_lock<std::mutex> lock(state_mutex);
+		pending = requests.TakePending();
+	}
+	for(WeakRequest &r : pending) {
+		if(r.client_id != 0xffffffff) {
+			PostResponse(r.RespondError(TWILI_ERR_PROTOCOL_TRANSFER_ERROR));
+		}
+	}
+}
+
+void USBDevice::SendRequest(const Request &&request) {
+	std::unique_lock<std::mutex> lock(state_mutex);
+	if(deletion_flag) { return; }
+
+	requests.Push(request.Weak());
+
+	if(!transferring_request) {
+		BeginNextRequest();
+	}
+}
+
+void USBDevice::BeginNextRequest() {
+	// The bridge expects a request's payload to arrive in full before the
+	// next request's header, so requests go out strictly one after another.
+	// Responses are matched back up by client and tag, so we don't wait for
+	// those unless the device asked us to limit how many requests it has to
+	// juggle at once.
+	if(!requests.Pop(request_out, max_outstanding_requests)) {
+		LogMessage(Debug, "request queue drained or device busy");
+		transferring_request = false;
+		return;
+	}
+	transferring_request = true;
+
+	mhdr.client_id = request_out.client_id;
+	mhdr.object_id = request_out.object_id;
+	mhdr.command_id = request_out.command_id;
+	mhdr.tag = request_out.tag;
+	mhdr.payload_size = request_out.payload.size();
+	mhdr.object_count = 0;
+
+	std::vector<uint8_t> compressed;
+	if(compression_enabled && compression::CompressPayload(request_out.payload.data(), request_out.payload.size(), compressed)) {
+		request_out.payload = common::SharedBuffer(std::move(compressed));
+		mhdr.payload_size = request_out.payload.size() | protocol::PAYLOAD_COMPRESSED;
+	}
+
+	Submit(tfer_meta_out, Endpoint::MetaOut, (uint8_t*) &mhdr, sizeof(mhdr), &USBDevice::MetaOutTransferShim, 5000);
+}
+
+void USBDevice::SubmitDataOut() {
+	// queue up as much of the payload as we have transfers for
+	while(!free_data_out.empty() && data_out_submitted < request_out.payload.size()) {
+		Transfer *t = free_data_out.back();
+		size_t size = std::min(request_out.payload.size() - data_out_submitted, transfer_size.load());
+		if(!Submit(*t, Endpoint::DataOut, (uint8_t*) request_out.payload.data() + data_out_submitted, size, &USBDevice::DataOutTransferShim, 15000)) {
+			return;
+		}
+		free_data_out.pop_back();
+		data_out_submitted+= size;
+	}
+}
+
+int USBDevice::GetPriority() {
+	return 2; // USB devices are a higher priority than TCP devices
+}
+
+std::string USBDevice::GetBridgeType() {
+	return "usb";
+}
+
+void USBDevice::Kill() {
+	deletion_flag = true;
+	Destroy();
+}
+
+bool USBDevice::Submit(Transfer &t, Endpoint endpoint, uint8_t *buffer, size_t size, USBTransport::Transfer::Callback cb, unsigned int timeout) {
+	if(deletion_flag) {
+		return false;
+	}
+	
+	t.device = shared_from_this();
+	if(!transport->Submit(*t.tfer, endpoint, buffer, size, cb, timeout)) {
+		t.device.reset();
+		Kill();
+		return false;
+	}
+	return true;
+}
+
+void USBDevice::MetaOutTransferCompleted() {
+	LogMessage(Debug, "finished transferring meta");
+	std::unique_lock<std::mutex> lock(state_mutex);
+
+	if(request_out.payload.size() > 0) {
+		LogMessage(Debug, "transferring data");
+		data_out_submitted = 0;
+		data_out_completed = 0;
+		SubmitDataOut();
+	} else {
+		BeginNextRequest();
+	}
+}
+
+void USBDevice::DataOutTransferCompleted(Transfer &t) {
+	std::unique_lock<std::mutex> lock(state_mutex);
+	free_data_out.push_back(&t);
+	
+	if(t.tfer->actual_length != t.tfer->length) {
+		LogMessage(Debug, "short data out transfer (0x%lx/0x%lx)", t.tfer->actual_length, t.tfer->length);
+		Kill();
+		return;
+	}
+	
+	data_out_completed+= t.tfer->actual_length;
+	LogMessage(Debug, "send request data 0x%x/0x%x", data_out_completed, request_out.payload.size());
+
+	if(data_out_completed < request_out.payload.size()) {
+		SubmitDataOut();
+	} else {
+		LogMessage(Debug, "finished transferring data");
+		request_out.payload = common::SharedBuffer();
+		BeginNextRequest();
+	}
+}
+
+void USBDevice::MetaInTransferCompleted() {
+	response_in.device_id = device_id;
+	response_in.client_id = mhdr_in.client_id;
+	response_in.object_id = mhdr_in.object_id;
+	response_in.result_code = mhdr_in.result_code;
+	response_in.tag = mhdr_in.tag;
+	payload_in_compressed = mhdr_in.payload_size & protocol::PAYLOAD_COMPRESSED;
+	mhdr_in.payload_size&= ~protocol::PAYLOAD_COMPRESSED;
+	payload_in.resize(mhdr_in.payload_size);
+	object_ids_in.resize(mhdr_in.object_count);
+
+	receiving_response = true;
+	payload_received = 0;
+	data_in_expected = mhdr_in.payload_size + object_ids_in.size() * sizeof(uint32_t);
+	
+	SubmitDataIn();
+	ProcessDataIn();
+}
+
+void USBDevice::SubmitDataIn() {
+	// keep as many transfers in flight as the rest of the response can fill
+	while(!free_data_in.empty() && data_in_requested < data_in_expected) {
+		Transfer *t = free_data_in.back();
+		size_t size = std::min(data_in_expected - data_in_requested, transfer_size.load());
+		if(!Submit(*t, Endpoint::DataIn, t->buffer.data(), size, &USBDevice::DataInTransferShim, 0)) {
+			return;
+		}
+		free_data_in.pop_back();
+		data_in_requested+= size;
+	}
+}
+
+void USBDevice::DataInTransferCompleted(Transfer &t) {
+	data_in_stream.Write(t.buffer.data(), t.tfer->actual_length);
+	free_data_in.push_back(&t);
+	data_in_requested-= t.tfer->length;
+	data_in_expected-= std::min(t.tfer->actual_length, data_in_expected);
+
+	// a short transfer leaves some of the response for another one
+	SubmitDataIn();
+	ProcessDataIn();
+}
+
+void USBDevice::ProcessDataIn() {
+	if(!receiving_response) {
+		return;
+	}
+
+	if(payload_received < mhdr_in.payload_size) {
+		size_t size = std::min(mhdr_in.payload_size - payload_received, data_in_stream.ReadAvailable());
+		data_in_stream.Read(payload_in.data() + payload_received, size);
+		payload_received+= size;
+		if(payload_received < mhdr_in.payload_size) {
+			return;
+		}
+	}
+
+	if(mhdr_in.object_count > 0) {
+		if(data_in_stream.ReadAvailable() < object_ids_in.size() * sizeof(uint32_t)) {
+			return;
+		}
+		data_in_stream.Read((uint8_t*) object_ids_in.data(), object_ids_in.size() * sizeof(uint32_t));
+	}
+
+	receiving_response = false;
+	DispatchResponse();
+}
+
+void USBDevice::DispatchResponse() {
+	if(payload_in_compressed) {
+		std::vector<uint8_t> decompressed;
+		if(!compression::DecompressPayload(payload_in.data(), payload_in.size(), decompressed)) {
+			LogMessage(Error, "bad compressed payload from device");
+			Kill();
+			return;
+		}
+		payload_in = std::move(decompressed);
+	}
+	
+	response_in.payload = std::move(payload_in);
+	payload_in.clear();
+	
+	// create BridgeObjects
+	response_in.objects.resize(object_ids_in.size());
+	std::transform(
+		object_ids_in.begin(), object_ids_in.end(), response_in.objects.begin(),
+		[this](uint32_t id) {
+			return MakeObject(id);
+		});
+
+	// remove from pending requests
+	{
+		std::unique_lock<std::mutex> lock(state_mutex);
+		if(!requests.Complete(response_in.client_id, response_in.tag)) {
+			LogMessage(Debug, "got response for request that was not pending (client 0x%x, tag 0x%x)", response_in.client_id, response_in.tag);
+		}
+		if(!transferring_request) {
+			BeginNextRequest();
+		}
+	}
+	
+	if(response_in.client_id == 0xFFFFFFFF) { // identification meta-client
+		if(response_in.tag == HelloTag) {
+			Negotiated(response_in);
+		} else {
+			Identified(response_in);
+		}
+	} else {
+		PostResponse(std::move(response_in));
+	}
+	ResubmitMetaInTransfer();
+}
+
+void USBDevice::Negotiated(Response &r) {
+	std::unique_lock<std::mutex> lock(state_mutex);
+	if(ApplyHelloResponse(r)) {
+		compression_enabled = features & protocol::FEATURE_COMPRESSION;
+		transfer_size = GetTransferSize(transfer_size_limit);
+	}
+}
+
+void USBDevice::Identified(Response &r) {
+	LogMessage(Debug, "got identification response back");
+	LogMessage(Debug, "payload size: 0x%x", r.payload.size());
+	if(r.result_code != 0) {
+		LogMessage(Warning, "device identification error: 0x%x", r.result_code);
+		Kill();
+		return;
+	}
+	std::string err;
+	msgpack11::MsgPack obj = msgpack11::MsgPack::parse(std::string(r.payload.begin() + 8, r.payload.end()), err);
+	identification = obj;
+	device_nickname = obj["device_nickname"].string_value();
+	serial_number = obj["serial_number"].string_value();
+
+	LogMessage(Info, "nickname: %s", device_nickname.c_str());
+	LogMessage(Info, "serial number: %s", serial_number.c_str());
+	
+	device_id = std::hash<std::string>()(serial_number);
+	LogMessage(Info, "assigned device id: %08x", device_id);
+	ready_flag = true;
+}
+
+void USBDevice::ResubmitMetaInTransfer() {
+	LogMessage(Debug, "submitting meta in transfer");
+	Submit(tfer_meta_in, Endpoint::MetaIn, (uint8_t*) &mhdr_in, sizeof(mhdr_in), &USBDevice::MetaInTransferShim, 600000);
+}
+
+bool USBDevice::CheckTransfer(USBTransport::Transfer &tfer) {
+	if(tfer.status != USBTransport::Status::Completed) {
+		LogMessage(Debug, "transfer failed (status = %d)", (int) tfer.status);
+		Kill();
+		return true;
+	} else {
+		return false;
+	}
+}
+
+void USBDevice::MetaOutTransferShim(USBTransport::Transfer &tfer) {
+	LogMessage(Debug, "meta out transfer shim, status = %d", (int) tfer.status);
+	Transfer *t = (Transfer*) tfer.user_data;
+	std::shared_ptr<USBDevice> d = std::move(t->device);
+	if(!d->CheckTransfer(tfer)) {
+		d->MetaOutTransferCompleted();
+	}
+}
+
+void USBDevice::DataOutTransferShim(USBTransport::Transfer &tfer) {
+	Transfer *t = (Transfer*) tfer.user_data;
+	std::shared_ptr<USBDevice> d = std::move(t->device);
+	if(!d->CheckTransfer(tfer)) {
+		d->DataOutTransferCompleted(*t);
+	}
+}
+
+void USBDevice::MetaInTransferShim(USBTransport::Transfer &tfer) {
+	Transfer *t = (Transfer*) tfer.user_data;
+	std::shared_ptr<USBDevice> d = std::move(t->device);
+	if(tfer.status == USBTransport::Status::TimedOut) {
+		d->ResubmitMetaInTransfer();
+	} else {
+		if(!d->CheckTransfer(tfer)) {
+			d->MetaInTransferCompleted();
+		}
+	}
+}
+
+void USBDevice::DataInTransferShim(USBTransport::Transfer &tfer) {
+	Transfer *t = (Transfer*) tfer.user_data;
+	std::shared_ptr<USBDevice> d = std::move(t->device);
+	if(!d->CheckTransfer(tfer)) {
+		d->DataInTransferCompleted(*t);
+	}
+}
+
+} // namespace backend
+} // namespace daemon
+} // namespace twib
+} // namespace twili
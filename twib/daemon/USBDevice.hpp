@@ -0,0 +1,147 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<atomic>
+#include<memory>
+#include<mutex>
+#include<vector>
+
+#include "Buffer.hpp"
+#include "Device.hpp"
+#include "Messages.hpp"
+#include "Protocol.hpp"
+#include "RequestQueue.hpp"
+#include "USBTransport.hpp"
+
+namespace twili {
+namespace twib {
+namespace daemon {
+namespace backend {
+
+// Speaks the Twili USB protocol over a USBTransport: sends requests one at a
+// time, reads responses back as they come, and matches them up with the
+// requests they answer. Everything that touches libusb is in the transport,
+// and everything that touches the daemon is left to subclasses.
+class USBDevice : public daemon::Device, public std::enable_shared_from_this<USBDevice> {
+ public:
+	// transfer_size is the most moved by one data transfer, and
+	// transfer_count is how many data transfers are kept per endpoint.
+	USBDevice(std::unique_ptr<USBTransport> transport, size_t transfer_size, size_t transfer_count);
+	virtual ~USBDevice();
+
+	void Begin();
+	virtual void Destroy();
+
+	// thread-agnostic
+	virtual void SendRequest(const Request &&r) override;
+
+	virtual int GetPriority() override;
+	virtual std::string GetBridgeType() override;
+
+	bool ready_flag = false;
+ protected:
+	virtual void PostResponse(Response &&r) = 0;
+	virtual std::shared_ptr<BridgeObject> MakeObject(uint32_t object_id) = 0;
+
+	// Answers every request that hasn't been answered yet with an error.
+	// Subclasses call this from their destructor, while PostResponse still
+	// works.
+	void FailPendingRequests();
+	void Kill();
+ private:
+	// While a transfer is submitted, it holds a reference to the device so
+	// that the device outlives its callback.
+	class Transfer {
+	 public:
+		Transfer(USBTransport &transport, size_t buffer_size=0);
+		Transfer(const Transfer &other) = delete;
+
+		std::unique_ptr<USBTransport::Transfer> tfer;
+		std::shared_ptr<USBDevice> device;
+		std::vector<uint8_t> buffer;
+	};
+
+	using Endpoint = USBTransport::Endpoint;
+
+	std::unique_ptr<USBTransport> transport;
+	const size_t transfer_size_limit;
+	Transfer tfer_meta_out;
+	Transfer tfer_meta_in;
+	std::vector<std::unique_ptr<Transfer>> tfers_data_out;
+	std::vector<std::unique_ptr<Transfer>> tfers_data_in;
+	// requests are queued here by SendRequest and sent one at a time by
+	// the transport's event thread as the out transfers complete, so the
+	// daemon thread never has to wait on the bus.
+	bool transferring_request = false;
+	std::atomic<bool> compression_enabled = false; // agreed to in HELLO
+	// data transfers are split into chunks of this size, which is also
+	// the size of the chunks the bridge sends responses in once it has
+	// agreed to it in HELLO
+	std::atomic<size_t> transfer_size;
+	std::mutex state_mutex;
+	RequestQueue requests;
+	protocol::MessageHeader mhdr;
+	protocol::MessageHeader mhdr_in;
+	WeakRequest request_out;
+	std::vector<Transfer*> free_data_out;
+	size_t data_out_submitted;
+	size_t data_out_completed;
+	// the data in endpoint is treated as a stream, since the bridge is
+	// free to end its transfers early with a short packet. It doesn't end
+	// responses with a zero-length packet though, so we never ask for
+	// more than the rest of the current response; a transfer that did
+	// would never complete if the response ended on a packet boundary.
+	util::Buffer data_in_stream;
+	std::vector<Transfer*> free_data_in;
+	size_t data_in_expected = 0; // bytes of this response not yet received
+	size_t data_in_requested = 0; // by data in transfers that are in flight
+	bool receiving_response = false;
+	bool payload_in_compressed = false;
+	std::vector<uint8_t> payload_in;
+	size_t payload_received;
+	Response response_in;
+	std::vector<uint32_t> object_ids_in;
+
+	bool Submit(Transfer &t, Endpoint endpoint, uint8_t *buffer, size_t size, USBTransport::Transfer::Callback cb, unsigned int timeout);
+	void BeginNextRequest(); // assumes state_mutex is held
+	void SubmitDataOut(); // assumes state_mutex is held
+	void SubmitDataIn();
+	void MetaOutTransferCompleted();
+	void DataOutTransferCompleted(Transfer &t);
+	void MetaInTransferCompleted();
+	void DataInTransferCompleted(Transfer &t);
+	void ProcessDataIn();
+	void DispatchResponse();
+	void Negotiated(Response &r);
+	void Identified(Response &r);
+	void ResubmitMetaInTransfer();
+	bool CheckTransfer(USBTransport::Transfer &tfer);
+	static void MetaOutTransferShim(USBTransport::Transfer &tfer);
+	static void DataOutTransferShim(USBTransport::Transfer &tfer);
+	static void MetaInTransferShim(USBTransport::Transfer &tfer);
+	static void DataInTransferShim(USBTransport::Transfer &tfer);
+};
+
+} // namespace backend
+} // namespace daemon
+} // namespace twib
+} // namespace twili
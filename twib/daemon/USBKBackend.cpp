@@ -197,6 +197,15 @@ void USBKBackend::Device::AddMembers(platform::EventLoop &loop) {
 	loop.AddMember(member_data_out);
 	loop.AddMember(member_meta_in);
 	loop.AddMember(member_meta_out);
+	registered_flag = true;
+}
+
+void USBKBackend::Device::RemoveMembers(platform::EventLoop &loop) {
+	loop.RemoveMember(member_data_in);
+	loop.RemoveMember(member_data_out);
+	loop.RemoveMember(member_meta_in);
+	loop.RemoveMember(member_meta_out);
+	registered_flag = false;
 }
 
 void USBKBackend::Device::MarkAdded() {
@@ -279,13 +288,13 @@ void USBKBackend::Device::MetaInTransferCompleted(size_t size) {
 	response_in.object_id = mhdr_in.object_id;
 	response_in.result_code = mhdr_in.result_code;
 	response_in.tag = mhdr_in.tag;
-	response_in.payload.resize(mhdr_in.payload_size);
+	payload_in.resize(mhdr_in.payload_size);
 	object_ids_in.resize(mhdr_in.object_count);
 	
 	data_in_transferred = 0;
 	read_in_objects = 0;
 	if(mhdr_in.payload_size > 0) {
-		member_data_in.Submit(response_in.payload.data(), LimitTransferSize(response_in.payload.size()));
+		member_data_in.Submit(payload_in.data(), LimitTransferSize(payload_in.size()));
 	} else if(mhdr_in.object_count > 0) {
 		member_data_in.Submit((uint8_t*) object_ids_in.data(), object_ids_in.size() * sizeof(uint32_t));
 	} else {
@@ -300,7 +309,7 @@ void USBKBackend::Device::DataInTransferCompleted(size_t size) {
 
 		if(remaining > 0) {
 			// continue transferring
-			member_data_in.Submit(response_in.payload.data() + data_in_transferred, LimitTransferSize(remaining));
+			member_data_in.Submit(payload_in.data() + data_in_transferred, LimitTransferSize(remaining));
 			return;
 		}
 
@@ -321,6 +330,9 @@ void USBKBackend::Device::DataInTransferCompleted(size_t size) {
 }
 
 void USBKBackend::Device::DispatchResponse() {
+	response_in.payload = std::move(payload_in);
+	payload_in.clear();
+	
 	// create BridgeObjects
 	response_in.objects.resize(object_ids_in.size());
 	std::transform(
@@ -610,13 +622,18 @@ USBKBackend::Logic::Logic(USBKBackend &backend) : backend(backend) {
 }
 
 void USBKBackend::Logic::Prepare(platform::EventLoop &loop) {
-	loop.Clear();
 	for(auto i = backend.stdout_transfers.begin(); i != backend.stdout_transfers.end();) {
 		if((*i)->deletion_flag) {
+			if((*i)->registered_flag) {
+				loop.RemoveMember(**i);
+			}
 			i = backend.stdout_transfers.erase(i);
 			continue;
 		}
-		loop.AddMember(**i);
+		if(!(*i)->registered_flag) {
+			loop.AddMember(**i);
+			(*i)->registered_flag = true;
+		}
 		i++;
 	}
 	for(auto i = backend.devices.begin(); i != backend.devices.end(); ) {
@@ -625,6 +642,9 @@ void USBKBackend::Logic::Prepare(platform::EventLoop &loop) {
 			if(d->added_flag) {
 				backend.daemon.RemoveDevice(d);
 			}
+			if(d->registered_flag) {
+				d->RemoveMembers(loop);
+			}
 			i = backend.devices.erase(i);
 			continue;
 		}
@@ -634,7 +654,9 @@ void USBKBackend::Logic::Prepare(platform::EventLoop &loop) {
 			d->MarkAdded();
 		}
 
-		d->AddMembers(loop);
+		if(!d->registered_flag) {
+			d->AddMembers(loop);
+		}
 		i++;
 	}
 }
@@ -100,6 +100,7 @@ class USBKBackend {
 
 		void Begin();
 		void AddMembers(platform::EventLoop &loop);
+		void RemoveMembers(platform::EventLoop &loop);
 		void MarkAdded();
 		
 		// thread-agnostic
@@ -110,6 +111,7 @@ class USBKBackend {
 		
 		bool ready_flag = false;
 		bool added_flag = false;
+		bool registered_flag = false; // with the event loop
 	 private:
 		USBKBackend &backend;
 		KUSB_DRIVER_API Usb;
@@ -150,6 +152,7 @@ class USBKBackend {
 		protocol::MessageHeader mhdr_in;
 		protocol::MessageHeader mhdr;
 		WeakRequest request_out;
+		std::vector<uint8_t> payload_in;
 		Response response_in;
 		std::list<WeakRequest> pending_requests;
 		std::vector<uint32_t> object_ids_in;
@@ -189,6 +192,7 @@ class USBKBackend {
 		virtual platform::windows::Event &GetEvent();
 
 		bool deletion_flag = false;
+		bool registered_flag = false; // with the event loop
 	private:
 		USBKBackend &backend;
 		KUSB_DRIVER_API Usb;
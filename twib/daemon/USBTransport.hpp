@@ -0,0 +1,79 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<memory>
+
+#include<stdint.h>
+#include<stddef.h>
+
+namespace twili {
+namespace twib {
+namespace daemon {
+namespace backend {
+
+// The bulk transfers a USB device is driven through. The USB backend
+// implements this with libusb; tests implement it with a fake bridge.
+class USBTransport {
+ public:
+	// the four endpoints of the Twili interface
+	enum class Endpoint {
+		MetaOut,
+		DataOut,
+		MetaIn,
+		DataIn,
+	};
+
+	enum class Status {
+		Completed,
+		TimedOut,
+		Failed, // includes cancellation
+	};
+
+	// Allocated once by the owner and reused for every submission.
+	class Transfer {
+	 public:
+		using Callback = void (*)(Transfer &t);
+		
+		virtual ~Transfer() = default;
+		
+		void *user_data = nullptr; // for the owner
+		Callback callback = nullptr; // set by Submit
+		Status status = Status::Completed;
+		size_t length = 0; // what was asked for
+		size_t actual_length = 0; // what was actually transferred
+	};
+
+	virtual ~USBTransport() = default;
+
+	virtual std::unique_ptr<Transfer> AllocTransfer() = 0;
+	// Returns false if the transfer couldn't be submitted. Otherwise cb is
+	// called once the transfer completes, fails, times out, or is cancelled.
+	// A timeout of 0 means no timeout.
+	virtual bool Submit(Transfer &t, Endpoint endpoint, uint8_t *buffer, size_t size, Transfer::Callback cb, unsigned int timeout) = 0;
+	// Cancels the transfer if it's in flight. Its callback still runs.
+	virtual void Cancel(Transfer &t) = 0;
+};
+
+} // namespace backend
+} // namespace daemon
+} // namespace twib
+} // namespace twili
@@ -22,6 +22,7 @@
 
 #include "platform/common/EventLoop.hpp"
 
+#include<algorithm>
 #include<list>
 #include<vector>
 #include<thread>
@@ -66,16 +67,33 @@ class EventLoopBase {
 		}
 	}
 	
-	void Clear() {
-		members.clear();
-	}
-	
+	// Members stay registered until they're removed, so logic only needs to
+	// tell the loop about members coming and going. These must be called
+	// from the event thread (from Prepare or a member's callbacks), or
+	// before Begin().
 	void AddMember(Member &member) {
 		members.push_back(member);
+		MemberAdded(member);
+	}
+
+	void RemoveMember(Member &member) {
+		auto i = std::find_if(
+			members.begin(), members.end(),
+			[&member](auto &m) { return &m.get() == &member; });
+		if(i != members.end()) {
+			members.erase(i);
+			MemberRemoved(member);
+		}
 	}
 
 	virtual const Notifier &GetNotifier() = 0;
  protected:
+	// hooks for loops that keep their own registrations
+	virtual void MemberAdded(Member &) {
+	}
+	virtual void MemberRemoved(Member &) {
+	}
+	
 	std::vector<std::reference_wrapper<Member>> members;
 	Logic &logic;
 
@@ -47,10 +47,30 @@ EventLoop::EventLoop(Logic &logic) :
 		LogMessage(Fatal, "failed to create pipe for event thread notifications: %s", strerror(errno));
 		exit(1);
 	}
+
+#if TWIB_EPOLL_EVENT_LOOP_ENABLED == 1
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if(epoll_fd < 0) {
+		LogMessage(Fatal, "failed to create epoll instance: %s", strerror(errno));
+		exit(1);
+	}
+
+	// the notification pipe stays registered for the lifetime of the loop
+	struct epoll_event ev = {};
+	ev.events = EPOLLIN;
+	ev.data.u64 = 0;
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, notification_pipe[0], &ev) < 0) {
+		LogMessage(Fatal, "failed to register event thread notification pipe: %s", strerror(errno));
+		exit(1);
+	}
+#endif
 }
 
 EventLoop::~EventLoop() {
 	Destroy();
+#if TWIB_EPOLL_EVENT_LOOP_ENABLED == 1
+	close(epoll_fd);
+#endif
 	close(notification_pipe[0]);
 	close(notification_pipe[1]);
 }
@@ -59,7 +79,244 @@ EventLoop::Notifier &EventLoop::GetNotifier() {
 	return notifier;
 }
 
+#if TWIB_EPOLL_EVENT_LOOP_ENABLED == 1
+void EventLoop::MemberAdded(FileMember &member) {
+	uint64_t id = next_registration_id++;
+	Registration r = {&member, EPOLLPRI, false, false};
+	if(member.WantsRead()) {
+		r.events|= EPOLLIN;
+	}
+	if(member.WantsWrite()) {
+		r.events|= EPOLLOUT;
+	}
+	
+	struct epoll_event ev = {};
+	ev.events = r.events;
+	ev.data.u64 = id;
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, member.GetFile().fd, &ev) < 0) {
+		if(errno != EPERM) {
+			LogMessage(Fatal, "failed to register fd %d with epoll: %s", member.GetFile().fd, strerror(errno));
+			exit(1);
+		}
+		// regular files and the like (stdin redirected from a file or
+		// /dev/null) can't be polled, but select() would call them ready
+		LogMessage(Debug, "fd %d can't be watched by epoll, treating it as always ready", member.GetFile().fd);
+		r.always_ready = true;
+		always_ready_members.push_back(id);
+	}
+	registrations.emplace(id, r);
+	
+	{
+		std::lock_guard<std::mutex> lock(dirty_mutex);
+		member.registration_id = id;
+	}
+	member.loop = this;
+}
+
+void EventLoop::MemberRemoved(FileMember &member) {
+	member.loop = nullptr;
+	uint64_t id;
+	{
+		std::lock_guard<std::mutex> lock(dirty_mutex);
+		id = member.registration_id;
+		member.registration_id = 0;
+	}
+	
+	auto i = registrations.find(id);
+	if(i == registrations.end()) {
+		return;
+	}
+	if(i->second.always_ready) {
+		always_ready_members.erase(
+			std::find(always_ready_members.begin(), always_ready_members.end(), id));
+	} else if(!i->second.parked) {
+		// the descriptor may already have been closed (which removes it
+		// from the epoll set for us), so failure here is fine
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, member.GetFile().fd, nullptr);
+	}
+	registrations.erase(i);
+}
+
+void EventLoop::MemberInterestChanged(FileMember &member) {
+	std::lock_guard<std::mutex> lock(dirty_mutex);
+	if(member.registration_id) {
+		dirty_members.push_back(member.registration_id);
+	}
+}
+
+void EventLoop::UpdateRegistration(uint64_t id) {
+	auto i = registrations.find(id);
+	if(i == registrations.end()) {
+		return;
+	}
+	Registration &r = i->second;
+	if(r.always_ready) {
+		return;
+	}
+	
+	uint32_t events = EPOLLPRI;
+	if(r.member->WantsRead()) {
+		events|= EPOLLIN;
+	}
+	if(r.member->WantsWrite()) {
+		events|= EPOLLOUT;
+	}
+
+	int op;
+	if(r.parked) {
+		if(!(events & (EPOLLIN | EPOLLOUT))) {
+			return;
+		}
+		op = EPOLL_CTL_ADD;
+	} else if(events != r.events) {
+		op = EPOLL_CTL_MOD;
+	} else {
+		return;
+	}
+	
+	struct epoll_event ev = {};
+	ev.events = events;
+	ev.data.u64 = id;
+	if(epoll_ctl(epoll_fd, op, r.member->GetFile().fd, &ev) < 0) {
+		LogMessage(Fatal, "failed to update fd %d with epoll: %s", r.member->GetFile().fd, strerror(errno));
+		exit(1);
+	}
+	r.events = events;
+	r.parked = false;
+}
+
+void EventLoop::event_thread_func() {
+	while(!event_thread_destroy) {
+		logic.Prepare(*this);
+
+		// pick up members whose interest changed off of the event thread
+		{
+			std::lock_guard<std::mutex> lock(dirty_mutex);
+			dirty_scratch.swap(dirty_members);
+		}
+		for(uint64_t id : dirty_scratch) {
+			UpdateRegistration(id);
+		}
+		dirty_scratch.clear();
+		
+		int count = epoll_wait(epoll_fd, epoll_events, MaxEvents, AnyAlwaysReadyInterested() ? 0 : -1);
+		if(count < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			LogMessage(Fatal, "failed to wait on epoll: %s", strerror(errno));
+			exit(1);
+		}
+
+		for(int i = 0; i < count; i++) {
+			struct epoll_event &ev = epoll_events[i];
+			uint64_t id = ev.data.u64;
+			
+			if(id == 0) {
+				char buf[64];
+				ssize_t r = read(notification_pipe[0], buf, sizeof(buf));
+				if(r < 0) {
+					LogMessage(Fatal, "failed to read from event thread notification pipe: %s", strerror(errno));
+					exit(1);
+				}
+				LogMessage(Debug, "event thread notified: '%.*s'", r, buf);
+				continue;
+			}
+
+			// callbacks may add or remove members, so look the registration
+			// up again after each one
+			auto j = registrations.find(id);
+			if(j == registrations.end()) {
+				continue;
+			}
+			FileMember &member = *j->second.member;
+			uint32_t interest = j->second.events;
+			
+			uint32_t ready = ev.events;
+			if(ready & (EPOLLHUP | EPOLLERR)) {
+				if(interest & (EPOLLIN | EPOLLOUT)) {
+					// select() reports these as readable/writable, so let the
+					// member find out about them the same way
+					ready|= interest & (EPOLLIN | EPOLLOUT);
+				} else {
+					// nobody is going to read the hangup, so report it as an error
+					ready|= EPOLLERR;
+				}
+			}
+			
+			if(ready & EPOLLIN) {
+				member.SignalRead();
+			}
+			if((ready & EPOLLOUT) && registrations.count(id)) {
+				member.SignalWrite();
+			}
+			if((ready & (EPOLLPRI | EPOLLERR)) && registrations.count(id)) {
+				member.SignalError();
+			}
+
+			j = registrations.find(id);
+			if(j == registrations.end()) {
+				continue;
+			}
+			if((ev.events & (EPOLLHUP | EPOLLERR)) && !(interest & (EPOLLIN | EPOLLOUT))) {
+				// nothing is going to read the hangup out of this descriptor,
+				// so stop epoll from reporting it over and over until the
+				// member shows interest again or gets removed
+				epoll_ctl(epoll_fd, EPOLL_CTL_DEL, j->second.member->GetFile().fd, nullptr);
+				j->second.parked = true;
+			} else {
+				UpdateRegistration(id);
+			}
+		}
+
+		SignalAlwaysReady();
+	}
+}
+
+bool EventLoop::AnyAlwaysReadyInterested() {
+	for(uint64_t id : always_ready_members) {
+		FileMember &member = *registrations.at(id).member;
+		if(member.WantsRead() || member.WantsWrite()) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void EventLoop::SignalAlwaysReady() {
+	// callbacks may add or remove members, so work from a copy
+	always_ready_scratch.assign(always_ready_members.begin(), always_ready_members.end());
+	for(uint64_t id : always_ready_scratch) {
+		auto i = registrations.find(id);
+		if(i == registrations.end()) {
+			continue;
+		}
+		FileMember &member = *i->second.member;
+		if(member.WantsRead()) {
+			member.SignalRead();
+		}
+		if(registrations.count(id) && member.WantsWrite()) {
+			member.SignalWrite();
+		}
+	}
+	always_ready_scratch.clear();
+}
+#else
+void EventLoop::MemberAdded(FileMember &member) {
+	member.loop = this;
+}
+
+void EventLoop::MemberRemoved(FileMember &member) {
+	member.loop = nullptr;
+}
+
+void EventLoop::MemberInterestChanged(FileMember &) {
+	// select() looks at every member on every iteration anyway
+}
+
 void EventLoop::event_thread_func() {
+	std::vector<std::reference_wrapper<FileMember>> ready_members;
+	
 	while(!event_thread_destroy) {
 		logic.Prepare(*this);
 
@@ -105,7 +362,9 @@ void EventLoop::event_thread_func() {
 			LogMessage(Debug, "event thread notified: '%.*s'", r, buf);
 		}
 
-		for(auto i = members.begin(); i != members.end(); i++) {
+		// callbacks may add members, so work from a copy
+		ready_members.assign(members.begin(), members.end());
+		for(auto i = ready_members.begin(); i != ready_members.end(); i++) {
 			FileMember &member = i->get();
 			File &f = member.GetFile();
 			if(FD_ISSET(f.fd, &readfds)) {
@@ -120,6 +379,14 @@ void EventLoop::event_thread_func() {
 		}
 	}
 }
+#endif
+
+void EventLoopFileMember::InterestChanged() {
+	EventLoop *l = loop;
+	if(l) {
+		l->MemberInterestChanged(*this);
+	}
+}
 
 // default implementations for EventLoopFileMember
 bool EventLoopFileMember::WantsRead() {
@@ -20,16 +20,24 @@
 
 #pragma once
 
+#include<atomic>
 #include<list>
 #include<vector>
 #include<thread>
 #include<mutex>
+#include<unordered_map>
 
 #include<stdint.h>
 
+#include "common/config.hpp"
+
 #include "platform.hpp"
 #include "platform/common/EventLoop.hpp"
 
+#if TWIB_EPOLL_EVENT_LOOP_ENABLED == 1
+#include<sys/epoll.h>
+#endif
+
 namespace twili {
 namespace platform {
 namespace unix {
@@ -39,6 +47,10 @@ class EventLoop;
 
 class EventLoopFileMember {
 	friend class EventLoop;
+ public:
+	// Call this (and then wake the loop) when WantsRead or WantsWrite may
+	// have changed outside of one of our own callbacks. Safe from any thread.
+	void InterestChanged();
  protected:
 	virtual bool WantsRead();
 	virtual bool WantsWrite();
@@ -48,6 +60,8 @@ class EventLoopFileMember {
 	virtual File &GetFile() = 0;
  private:
 	size_t last_service = 0;
+	std::atomic<EventLoop*> loop = nullptr;
+	uint64_t registration_id = 0; // guarded by the loop's dirty_mutex
 };
 
 // to provide a common interface
@@ -62,6 +76,7 @@ class EventLoopSocketMember : public EventLoopFileMember {
 
 class EventLoop :
 		public platform::common::detail::EventLoopBase<EventLoop, EventLoopFileMember> {
+	friend class EventLoopFileMember;
  public:
 	using FileMember = EventLoopFileMember;
 	using SocketMember = EventLoopSocketMember;
@@ -72,9 +87,44 @@ class EventLoop :
 	virtual Notifier &GetNotifier() override;
 protected:
 	virtual void event_thread_func() override;
+	virtual void MemberAdded(FileMember &member) override;
+	virtual void MemberRemoved(FileMember &member) override;
+	void MemberInterestChanged(FileMember &member);
 
 	// TODO: use File to RAII this
 	int notification_pipe[2];
+
+#if TWIB_EPOLL_EVENT_LOOP_ENABLED == 1
+	struct Registration {
+		FileMember *member;
+		uint32_t events; // what the kernel is currently watching for
+		bool parked; // taken out of the epoll set after a hangup nobody wanted
+		bool always_ready; // epoll refused it (regular files, /dev/null)
+	};
+
+	// Members are registered with epoll when they're added and stay
+	// registered until they're removed. A wakeup only costs work for the
+	// members that had events or changed what they're interested in.
+	// Registrations are keyed by an id rather than the fd or a pointer, so
+	// stale events for a member that was removed mid-batch are ignored.
+	// Descriptors that epoll can't watch are always ready, the same as
+	// select() would report them, so they get signalled every iteration
+	// and the wait doesn't block while any of them is interested.
+	static const size_t MaxEvents = 64;
+	int epoll_fd;
+	uint64_t next_registration_id = 1; // 0 is the notification pipe
+	std::unordered_map<uint64_t, Registration> registrations;
+	std::vector<uint64_t> always_ready_members;
+	std::vector<uint64_t> always_ready_scratch;
+	std::mutex dirty_mutex;
+	std::vector<uint64_t> dirty_members; // guarded by dirty_mutex
+	std::vector<uint64_t> dirty_scratch;
+	struct epoll_event epoll_events[MaxEvents];
+
+	void UpdateRegistration(uint64_t id);
+	bool AnyAlwaysReadyInterested();
+	void SignalAlwaysReady();
+#endif
 	class EventThreadNotifier : public Notifier {
 	public:
 		EventThreadNotifier(EventLoop &loop);
@@ -151,6 +151,18 @@ ssize_t Socket::Send(const void *buf, size_t length, int flags) {
 	return send(fd, buf, length, flags);
 }
 
+ssize_t Socket::Send(const std::tuple<const uint8_t*, size_t> *buffers, size_t count, int flags) {
+	std::vector<struct iovec> iov(count);
+	for(size_t i = 0; i < count; i++) {
+		iov[i].iov_base = (void*) std::get<0>(buffers[i]);
+		iov[i].iov_len = std::get<1>(buffers[i]);
+	}
+	struct msghdr msg = {};
+	msg.msg_iov = iov.data();
+	msg.msg_iovlen = count;
+	return sendmsg(fd, &msg, flags);
+}
+
 int Socket::SetSockOpt(int level, int option_name, const void *option_value, socklen_t option_len) {
 	return setsockopt(fd, level, option_name, option_value, option_len);
 }
@@ -23,6 +23,7 @@
 #include "platform/common/fs.hpp"
 
 #include<sys/socket.h>
+#include<sys/uio.h>
 #include<sys/select.h>
 #include<sys/un.h>
 #include<netinet/in.h>
@@ -35,6 +36,8 @@
 #include<stdint.h>
 
 #include<stdexcept>
+#include<tuple>
+#include<vector>
 
 namespace twili {
 namespace platform {
@@ -91,6 +94,7 @@ class Socket : public File {
 	ssize_t Recv(void *buf, size_t length, int flags);
 	ssize_t RecvFrom(void *buf, size_t length, int flags, struct sockaddr *address, socklen_t *address_len);
 	ssize_t Send(const void *buf, size_t length, int flags);
+	ssize_t Send(const std::tuple<const uint8_t*, size_t> *buffers, size_t count, int flags); // gathers from several buffers at once
 	int SetSockOpt(int level, int option_name, const void *option_value, socklen_t option_len); // no error check
 	
 	// checks errors for you
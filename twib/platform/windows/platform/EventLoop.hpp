@@ -41,6 +41,11 @@ class EventLoop;
 
 class EventLoopNativeMember {
 	friend class EventLoop;
+public:
+	// we look at every member on every iteration, so there's nothing to do
+	// here besides waking the loop up
+	void InterestChanged() {
+	}
 protected:
 	virtual bool WantsSignal();
 	virtual void Signal();
@@ -181,6 +181,18 @@ ssize_t Socket::Send(const void *buffer, size_t length, int flags) {
 	return bytes;
 }
 
+ssize_t Socket::Send(const std::tuple<const uint8_t*, size_t> *buffers, size_t count, int flags) {
+	DWORD bytes;
+	std::vector<WSABUF> bufs(count);
+	for(size_t i = 0; i < count; i++) {
+		bufs[i] = { (ULONG) std::get<1>(buffers[i]), (CHAR*) std::get<0>(buffers[i]) };
+	}
+	if(WSASend(fd, bufs.data(), count, &bytes, flags, nullptr, nullptr) != 0) {
+		return -1;
+	}
+	return bytes;
+}
+
 int Socket::SetSockOpt(int level, int option_name, const void *option_value, socklen_t option_len) {
 	return setsockopt(fd, level, option_name, (const char*) option_value, option_len);
 }
@@ -41,6 +41,8 @@
 #include<stdint.h>
 
 #include<stdexcept>
+#include<tuple>
+#include<vector>
 
 // pls
 typedef signed long long ssize_t;
@@ -123,6 +125,7 @@ class Socket {
 	ssize_t Recv(void *buf, size_t length, int flags);
 	ssize_t RecvFrom(void *buf, size_t length, int flags, struct sockaddr *address, socklen_t *address_len);
 	ssize_t Send(const void *buf, size_t length, int flags);
+	ssize_t Send(const std::tuple<const uint8_t*, size_t> *buffers, size_t count, int flags); // gathers from several buffers at once
 	int SetSockOpt(int level, int option_name, const void *option_value, socklen_t option_len);
 
 	void Bind(const struct sockaddr *address, socklen_t address_len);
@@ -0,0 +1,228 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Round-trips data through the LZ4 encoder and decoder that twili and
+// twibd use for compressed payloads, and makes sure the decoder turns away
+// blocks that are cut short, corrupt, or decode to the wrong size.
+
+#include "Compression.hpp"
+
+#include<random>
+#include<string>
+#include<vector>
+
+#include<string.h>
+
+#include "Test.hpp"
+
+using namespace twili;
+using namespace twili::compression;
+
+namespace {
+
+std::vector<uint8_t> Zeroes(size_t size) {
+	return std::vector<uint8_t>(size, 0);
+}
+
+std::vector<uint8_t> Random(size_t size, uint32_t seed) {
+	std::mt19937 rng(seed);
+	std::vector<uint8_t> data(size);
+	for(uint8_t &b : data) {
+		b = (uint8_t) rng();
+	}
+	return data;
+}
+
+// repetitive, but not trivially so, like log output or a directory listing
+std::vector<uint8_t> Text(size_t size) {
+	std::vector<uint8_t> data;
+	for(size_t i = 0; data.size() < size; i++) {
+		std::string line = "[twili] request " + std::to_string(i) + " for object " + std::to_string(i % 7) + " finished\n";
+		data.insert(data.end(), line.begin(), line.end());
+	}
+	data.resize(size);
+	return data;
+}
+
+// like a memory dump: stretches of zeroes, code-ish words and noise, with
+// some repeats further back than an LZ4 offset can reach
+std::vector<uint8_t> Mixed(size_t size) {
+	std::vector<uint8_t> data;
+	std::vector<uint8_t> noise = Random(0x800, 1);
+	std::vector<uint8_t> text = Text(0x1000);
+	for(size_t i = 0; data.size() < size; i++) {
+		switch(i % 4) {
+		case 0: data.insert(data.end(), 0x1800, 0); break;
+		case 1: data.insert(data.end(), noise.begin(), noise.end()); break;
+		case 2: data.insert(data.end(), text.begin(), text.end()); break;
+		case 3:
+			for(uint32_t j = 0; j < 0x400; j++) {
+				uint32_t word = 0x94000000 | (j * 37);
+				data.insert(data.end(), (uint8_t*) &word, (uint8_t*) &word + 4);
+			}
+			break;
+		}
+	}
+	data.resize(size);
+	return data;
+}
+
+std::vector<uint8_t> CompressWhole(const std::vector<uint8_t> &data) {
+	// the worst case for LZ4 is a little over the input size
+	std::vector<uint8_t> block(data.size() + data.size() / 255 + 16);
+	size_t size = CompressBlock(data.data(), data.size(), block.data(), block.size());
+	TEST_CHECK(size > 0);
+	block.resize(size);
+	return block;
+}
+
+void CheckBlockRoundTrip(const std::vector<uint8_t> &data) {
+	std::vector<uint8_t> block = CompressWhole(data);
+	std::vector<uint8_t> decompressed(data.size());
+	TEST_CHECK(DecompressBlock(block.data(), block.size(), decompressed.data(), decompressed.size()));
+	TEST_CHECK(decompressed == data);
+}
+
+void TestBlockRoundTrip() {
+	// everything short enough to be all literals, and the boundaries around it
+	for(size_t size = 0; size < 64; size++) {
+		CheckBlockRoundTrip(Text(size));
+		CheckBlockRoundTrip(Zeroes(size));
+	}
+	for(size_t size : {0x100, 0x1000, 0x10000, 0x10001, 0x40000}) {
+		CheckBlockRoundTrip(Zeroes(size)); // long match lengths
+		CheckBlockRoundTrip(Random(size, size)); // long literal runs
+		CheckBlockRoundTrip(Text(size));
+		CheckBlockRoundTrip(Mixed(size));
+	}
+}
+
+void TestPayloadRoundTrip() {
+	for(size_t size : {0x100, 0x1000, 0x10000, 0x40000}) {
+		for(const std::vector<uint8_t> &data : {Zeroes(size), Text(size), Mixed(size)}) {
+			std::vector<uint8_t> compressed;
+			TEST_CHECK(CompressPayload(data.data(), data.size(), compressed));
+			TEST_CHECK(compressed.size() < data.size());
+			std::vector<uint8_t> decompressed;
+			TEST_CHECK(DecompressPayload(compressed.data(), compressed.size(), decompressed));
+			TEST_CHECK(decompressed == data);
+		}
+	}
+}
+
+// payloads that are too small or don't shrink are sent as they are
+void TestPayloadNotWorthIt() {
+	std::vector<uint8_t> out = {1, 2, 3};
+	std::vector<uint8_t> tiny = Zeroes(255);
+	TEST_CHECK(!CompressPayload(tiny.data(), tiny.size(), out));
+	std::vector<uint8_t> noise = Random(0x10000, 2);
+	TEST_CHECK(!CompressPayload(noise.data(), noise.size(), out));
+	TEST_CHECK(out.size() == 3);
+}
+
+void TestCapacity() {
+	std::vector<uint8_t> data = Text(0x1000);
+	size_t needed = CompressWhole(data).size();
+	std::vector<uint8_t> block(needed);
+	TEST_CHECK(CompressBlock(data.data(), data.size(), block.data(), needed) == needed);
+	for(size_t capacity : {(size_t) 0, (size_t) 1, needed / 2, needed - 1}) {
+		TEST_CHECK(CompressBlock(data.data(), data.size(), block.data(), capacity) == 0);
+	}
+}
+
+// a block written by hand from the LZ4 block format description
+void TestKnownBlock() {
+	const uint8_t block[] = {
+		0x11, 'a', 0x01, 0x00, // one literal, then a 5 byte match one back
+		0x50, 'b', 'c', 'd', 'e', 'f', // five literals to finish
+	};
+	const char expected[] = "aaaaaabcdef";
+	uint8_t out[11];
+	TEST_CHECK(DecompressBlock(block, sizeof(block), out, sizeof(out)));
+	TEST_CHECK(memcmp(out, expected, sizeof(out)) == 0);
+}
+
+void TestCorruptBlocks() {
+	std::vector<uint8_t> data = Mixed(0x8000);
+	std::vector<uint8_t> block = CompressWhole(data);
+	std::vector<uint8_t> out(data.size());
+
+	// wrong output size either way
+	TEST_CHECK(!DecompressBlock(block.data(), block.size(), out.data(), out.size() - 1));
+	out.resize(data.size() + 1);
+	TEST_CHECK(!DecompressBlock(block.data(), block.size(), out.data(), out.size()));
+	out.resize(data.size());
+
+	// every truncation
+	for(size_t size = 0; size < block.size(); size++) {
+		TEST_CHECK(!DecompressBlock(block.data(), size, out.data(), out.size()));
+	}
+
+	// matches that reach back before the start of the output
+	const uint8_t zero_offset[] = {0x10, 'a', 0x00, 0x00, 0x00};
+	const uint8_t far_offset[] = {0x10, 'a', 0x02, 0x00, 0x00};
+	uint8_t small[5];
+	TEST_CHECK(!DecompressBlock(zero_offset, sizeof(zero_offset), small, sizeof(small)));
+	TEST_CHECK(!DecompressBlock(far_offset, sizeof(far_offset), small, sizeof(small)));
+
+	// garbage shouldn't decode, and mustn't write out of bounds trying
+	std::mt19937 rng(3);
+	for(size_t i = 0; i < 10000; i++) {
+		std::vector<uint8_t> garbage = Random(1 + rng() % 64, i);
+		std::vector<uint8_t> guard(0x100 + 16, 0xcc);
+		DecompressBlock(garbage.data(), garbage.size(), guard.data(), 0x100);
+		for(size_t j = 0x100; j < guard.size(); j++) {
+			TEST_CHECK(guard[j] == 0xcc);
+		}
+	}
+}
+
+void TestCorruptPayloads() {
+	std::vector<uint8_t> out;
+	const uint8_t short_header[4] = {0};
+	TEST_CHECK(!DecompressPayload(short_header, sizeof(short_header), out));
+
+	// claims to expand to far more than LZ4 could
+	std::vector<uint8_t> huge(8 + 16, 0);
+	uint64_t raw_size = 1ull << 40;
+	memcpy(huge.data(), &raw_size, sizeof(raw_size));
+	TEST_CHECK(!DecompressPayload(huge.data(), huge.size(), out));
+
+	// right block, wrong size in the header
+	std::vector<uint8_t> data = Text(0x1000);
+	std::vector<uint8_t> compressed;
+	TEST_CHECK(CompressPayload(data.data(), data.size(), compressed));
+	raw_size = data.size() + 1;
+	memcpy(compressed.data(), &raw_size, sizeof(raw_size));
+	TEST_CHECK(!DecompressPayload(compressed.data(), compressed.size(), out));
+}
+
+} // anonymous namespace
+
+int main() {
+	TestBlockRoundTrip();
+	TestPayloadRoundTrip();
+	TestPayloadNotWorthIt();
+	TestCapacity();
+	TestKnownBlock();
+	TestCorruptBlocks();
+	TestCorruptPayloads();
+	return 0;
+}
@@ -0,0 +1,199 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Lays out a core dump of a fake process and reads it back the way gdb
+// would, checking that eliding zero pages didn't lose any data.
+
+#include "CoreDumpLayout.hpp"
+
+#include<map>
+#include<vector>
+
+#include<string.h>
+
+#include "Elf.hpp"
+#include "err.hpp"
+
+#include "Test.hpp"
+
+using namespace twili;
+using namespace twili::coredump;
+
+namespace {
+
+const size_t PageSize = 0x1000;
+
+class FakeProcess {
+ public:
+	// adds a mapping with the given pages filled in and the rest zero
+	void Map(uint64_t addr, size_t pages, std::vector<size_t> data_pages, bool readable=true) {
+		std::vector<uint8_t> memory(pages * PageSize, 0);
+		for(size_t page : data_pages) {
+			for(size_t i = 0; i < PageSize; i+= 0x100) {
+				memory[page * PageSize + i] = (uint8_t) (page + i / 0x100 + 1);
+			}
+		}
+		regions[addr] = {std::move(memory), readable};
+		vmas.push_back({0, addr, pages * PageSize, ELF::PF_R | ELF::PF_W, pages * PageSize});
+	}
+
+	uint32_t Read(uint64_t addr, uint8_t *buffer, size_t size) const {
+		auto i = regions.upper_bound(addr);
+		if(i == regions.begin()) {
+			return TWILI_ERR_IO_ERROR;
+		}
+		i--;
+		if(!i->second.readable || addr + size > i->first + i->second.memory.size()) {
+			return TWILI_ERR_IO_ERROR;
+		}
+		memcpy(buffer, i->second.memory.data() + (addr - i->first), size);
+		return 0;
+	}
+
+	MemoryReader Reader() const {
+		return [this](uint64_t addr, uint8_t *buffer, size_t size) {
+			return Read(addr, buffer, size);
+		};
+	}
+
+	struct Region {
+		std::vector<uint8_t> memory;
+		bool readable;
+	};
+	std::map<uint64_t, Region> regions;
+	std::vector<VMA> vmas;
+};
+
+std::vector<uint8_t> ReadAll(const CoreDumpLayout &layout, const FakeProcess &process) {
+	// read in odd-sized chunks so that reads straddle segment boundaries
+	std::vector<uint8_t> file(layout.GetSize());
+	for(size_t offset = 0; offset < file.size(); offset+= 0x3333) {
+		size_t size = std::min(file.size() - offset, (size_t) 0x3333);
+		TEST_CHECK(layout.Read(offset, file.data() + offset, size, process.Reader()) == 0);
+	}
+	return file;
+}
+
+void TestLayout() {
+	FakeProcess process;
+	// leading zeroes, data with a short gap, then trailing zeroes
+	process.Map(0x10000, 64, {4, 5, 10});
+	// a gap long enough to be worth its own program header
+	process.Map(0x100000, 40, {0, 30});
+	// nothing but zeroes
+	process.Map(0x200000, 8, {});
+
+	std::vector<VMA> vmas = ElideZeroPages(process.vmas, process.Reader());
+	TEST_CHECK(vmas.size() == 5);
+	TEST_CHECK(vmas[0].virtual_addr == 0x10000 && vmas[0].size == 4 * PageSize && vmas[0].file_size == 0);
+	TEST_CHECK(vmas[1].virtual_addr == 0x10000 + 4 * PageSize && vmas[1].size == 60 * PageSize && vmas[1].file_size == 7 * PageSize);
+	TEST_CHECK(vmas[2].virtual_addr == 0x100000 && vmas[2].size == 30 * PageSize && vmas[2].file_size == PageSize);
+	TEST_CHECK(vmas[3].virtual_addr == 0x100000 + 30 * PageSize && vmas[3].size == 10 * PageSize && vmas[3].file_size == PageSize);
+	TEST_CHECK(vmas[4].virtual_addr == 0x200000 && vmas[4].size == 8 * PageSize && vmas[4].file_size == 0);
+
+	std::vector<uint8_t> notes(44);
+	for(size_t i = 0; i < notes.size(); i++) {
+		notes[i] = (uint8_t) (0xa0 + i);
+	}
+
+	CoreDumpLayout layout;
+	layout.Build(std::move(vmas), std::vector<uint8_t>(notes));
+	TEST_CHECK(layout.GetSize() == sizeof(ELF::Elf64_Ehdr) + 9 * PageSize + notes.size() + 6 * sizeof(ELF::Elf64_Phdr));
+
+	std::vector<uint8_t> file = ReadAll(layout, process);
+
+	ELF::Elf64_Ehdr ehdr;
+	memcpy(&ehdr, file.data(), sizeof(ehdr));
+	TEST_CHECK(memcmp(ehdr.e_ident.ei_mag, "\x7f" "ELF", 4) == 0);
+	TEST_CHECK(ehdr.e_type == ELF::ET_CORE);
+	TEST_CHECK(ehdr.e_phnum == 6);
+	TEST_CHECK(ehdr.e_phoff + ehdr.e_phnum * sizeof(ELF::Elf64_Phdr) == file.size());
+
+	std::vector<ELF::Elf64_Phdr> phdrs(ehdr.e_phnum);
+	memcpy(phdrs.data(), file.data() + ehdr.e_phoff, phdrs.size() * sizeof(ELF::Elf64_Phdr));
+
+	TEST_CHECK(phdrs[0].p_type == ELF::PT_NOTE);
+	TEST_CHECK(phdrs[0].p_filesz == notes.size());
+	TEST_CHECK(memcmp(file.data() + phdrs[0].p_offset, notes.data(), notes.size()) == 0);
+
+	// every byte of every mapping has to come back, either from the file or
+	// as zero fill past p_filesz
+	for(auto &region : process.regions) {
+		std::vector<uint8_t> rebuilt(region.second.memory.size(), 0xcc);
+		for(size_t i = 1; i < phdrs.size(); i++) {
+			ELF::Elf64_Phdr &ph = phdrs[i];
+			TEST_CHECK(ph.p_type == ELF::PT_LOAD);
+			TEST_CHECK(ph.p_filesz <= ph.p_memsz);
+			TEST_CHECK(ph.p_offset + ph.p_filesz <= ehdr.e_phoff);
+			if(ph.p_vaddr < region.first || ph.p_vaddr >= region.first + rebuilt.size()) {
+				continue;
+			}
+			uint8_t *dst = rebuilt.data() + (ph.p_vaddr - region.first);
+			memcpy(dst, file.data() + ph.p_offset, ph.p_filesz);
+			memset(dst + ph.p_filesz, 0, ph.p_memsz - ph.p_filesz);
+		}
+		TEST_CHECK(rebuilt == region.second.memory);
+	}
+
+	uint8_t byte;
+	TEST_CHECK(layout.Read(file.size(), &byte, 1, process.Reader()) == TWILI_ERR_EOF);
+	TEST_CHECK(layout.Read(file.size() - 1, &byte, 2, process.Reader()) == TWILI_ERR_EOF);
+}
+
+// a VMA that can't be scanned is dumped whole, and the error shows up when
+// its data is read
+void TestUnreadable() {
+	FakeProcess process;
+	process.Map(0x10000, 4, {1});
+	process.Map(0x20000, 4, {1}, false);
+
+	std::vector<VMA> vmas = ElideZeroPages(process.vmas, process.Reader());
+	TEST_CHECK(vmas.size() == 3);
+	TEST_CHECK(vmas[2].virtual_addr == 0x20000 && vmas[2].file_size == 4 * PageSize);
+
+	CoreDumpLayout layout;
+	layout.Build(std::move(vmas), std::vector<uint8_t>());
+	const VMA &bad = layout.GetVMAs()[2];
+	std::vector<uint8_t> buffer(PageSize);
+	TEST_CHECK(layout.Read(bad.file_offset, buffer.data(), buffer.size(), process.Reader()) == TWILI_ERR_IO_ERROR);
+	const VMA &good = layout.GetVMAs()[1];
+	TEST_CHECK(layout.Read(good.file_offset, buffer.data(), buffer.size(), process.Reader()) == 0);
+	TEST_CHECK(buffer[0] == 2);
+}
+
+// once e_phnum would overflow, VMAs stop being split
+void TestProgramHeaderLimit() {
+	FakeProcess process;
+	for(size_t i = 0; i < 0x8000; i++) {
+		process.Map(0x100000000 + i * 0x100000, 2, {1});
+	}
+	std::vector<VMA> vmas = ElideZeroPages(process.vmas, process.Reader());
+	TEST_CHECK(vmas.size() <= 0xff00);
+	TEST_CHECK(vmas.size() > 0x8000);
+}
+
+} // anonymous namespace
+
+int main() {
+	TestLayout();
+	TestUnreadable();
+	TestProgramHeaderLimit();
+	return 0;
+}
@@ -0,0 +1,168 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Load generator for twibd's dispatcher. The loopback devices are set up so
+// that SendRequest blocks, which ties up whichever dispatch thread is sending
+// to them, and a few clients flood their own devices with pipelined requests.
+// Spread across N dispatch threads, the flood should finish well ahead of the
+// same flood through one, and every client should get its responses back in
+// the order it sent the requests.
+
+#include "LoopbackDaemon.hpp"
+
+#include<atomic>
+#include<chrono>
+#include<condition_variable>
+#include<memory>
+#include<mutex>
+#include<thread>
+#include<vector>
+
+#include<stdio.h>
+
+#include "SocketClient.hpp"
+#include "RemoteObject.hpp"
+#include "Protocol.hpp"
+
+#include "Test.hpp"
+
+using namespace twili;
+using namespace twili::twib;
+
+namespace {
+
+const uint32_t ListProcesses = (uint32_t) protocol::ITwibDeviceInterface::Command::LIST_PROCESSES;
+
+const size_t DispatchThreads = 4;
+const size_t DeviceCount = 16; // enough for every dispatch thread to get one
+const uint64_t SendDelayUs = 2000;
+const size_t RequestsPerDevice = 40;
+
+// sends a fixed number of requests to one device, keeping up to depth of them
+// in flight
+class Flooder {
+ public:
+	Flooder(test::LoopbackDaemon &daemon, uint32_t device_id, size_t count, size_t depth) :
+		client(daemon.Connect()),
+		device(client, device_id, 0),
+		count(count),
+		depth(depth),
+		thread(&Flooder::Run, this) {
+	}
+
+	~Flooder() {
+		thread.join();
+	}
+
+ private:
+	void Run() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while(next_expected < count) {
+			while(next_sent < count && next_sent - next_expected < depth) {
+				uint64_t sequence = next_sent++;
+				lock.unlock();
+				device.SendRequest(
+					ListProcesses, std::vector<uint8_t>(),
+					[this, sequence](tool::Response r) {
+						std::lock_guard<std::mutex> lock(mutex);
+						TEST_CHECK(r.result_code == 0);
+						// everything for one device is dispatched in order
+						TEST_CHECK(sequence == next_expected);
+						next_expected++;
+						condvar.notify_all();
+					});
+				lock.lock();
+			}
+			condvar.wait(lock);
+		}
+	}
+
+	tool::client::SocketClient client;
+	tool::RemoteObject device;
+	size_t count;
+	size_t depth;
+	uint64_t next_sent = 0;
+	uint64_t next_expected = 0;
+	std::mutex mutex;
+	std::condition_variable condvar;
+	std::thread thread;
+};
+
+// seconds it takes to get every request answered, with one client flooding
+// each of the given devices at once
+double Flood(size_t dispatch_threads, const std::vector<uint32_t> &devices) {
+	test::LoopbackDaemon::Options options;
+	options.dispatch_threads = dispatch_threads;
+	options.device_count = DeviceCount;
+	options.send_delay_us = SendDelayUs;
+	test::LoopbackDaemon daemon(options);
+
+	auto start = std::chrono::steady_clock::now();
+	{
+		std::vector<std::unique_ptr<Flooder>> flooders;
+		for(uint32_t device_id : devices) {
+			flooders.emplace_back(std::make_unique<Flooder>(daemon, device_id, RequestsPerDevice, 8));
+		}
+	}
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// one device for each dispatch thread, going by how twibd shards devices
+// across its dispatch queues
+std::vector<uint32_t> PickDevices() {
+	test::LoopbackDaemon::Options options;
+	options.dispatch_threads = DispatchThreads;
+	options.device_count = DeviceCount;
+	test::LoopbackDaemon daemon(options);
+	
+	std::vector<uint32_t> picked(DispatchThreads, 0);
+	std::vector<bool> taken(DispatchThreads, false);
+	for(uint32_t device_id : daemon.GetDeviceIds()) {
+		size_t shard = device_id % DispatchThreads;
+		if(!taken[shard]) {
+			picked[shard] = device_id;
+			taken[shard] = true;
+		}
+	}
+	for(bool t : taken) {
+		TEST_CHECK(t);
+	}
+	return picked;
+}
+
+} // anonymous namespace
+
+int main() {
+	std::vector<uint32_t> devices = PickDevices();
+
+	double serial = Flood(1, devices);
+	double parallel = Flood(DispatchThreads, devices);
+	printf(
+		"%zu devices x %zu requests, %lu us each to send: %.3f s on 1 dispatch thread, %.3f s on %zu\n",
+		devices.size(), RequestsPerDevice, SendDelayUs, serial, parallel, DispatchThreads);
+
+	// one thread has to sit through every send itself
+	TEST_CHECK(serial >= devices.size() * RequestsPerDevice * SendDelayUs / 1e6);
+	// the sends block without using the CPU, so this holds even on a single
+	// core; it only fails if the devices end up waiting on each other
+	TEST_CHECK(parallel * 2 < serial);
+
+	return 0;
+}
@@ -0,0 +1,238 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Runs twibd's side of the HELLO exchange against a fake bridge that frames
+// its answer the way twili's ITwibDeviceInterface::Hello does and negotiates
+// with the same common code, and checks that what the backends end up using
+// (transfer sizes, the limit on outstanding requests) is what both ends
+// agreed to.
+
+#include "Device.hpp"
+#include "RequestQueue.hpp"
+
+#include<algorithm>
+#include<string>
+#include<vector>
+
+#include<msgpack11.hpp>
+
+#include "Buffer.hpp"
+#include "Hello.hpp"
+#include "Protocol.hpp"
+#include "err.hpp"
+
+#include "Test.hpp"
+
+using namespace twili;
+using namespace twili::twib::daemon;
+
+namespace {
+
+class TestDevice : public Device {
+ public:
+	virtual void SendRequest(const Request &&) override {
+	}
+	virtual int GetPriority() override {
+		return 0;
+	}
+	virtual std::string GetBridgeType() override {
+		return "test";
+	}
+
+	using Device::HelloTag;
+	using Device::MakeHelloRequest;
+	using Device::ApplyHelloResponse;
+};
+
+// what a bridge can do
+struct FakeBridge {
+	size_t transfer_limit; // most it can move at once
+	size_t default_transfer_size; // what it uses until told otherwise
+	uint32_t max_outstanding_requests;
+	size_t link_transfer_size = 0; // agreed to in HELLO, 0 for the default
+
+	size_t GetMaxTransferSize() {
+		return link_transfer_size ? link_transfer_size : default_transfer_size;
+	}
+
+	Response Hello(const Request &rq) {
+		TEST_CHECK(rq.command_id == (uint32_t) protocol::ITwibDeviceInterface::Command::HELLO);
+		TEST_CHECK(rq.tag == TestDevice::HelloTag);
+
+		util::Buffer in;
+		in.Write(rq.payload.data(), rq.payload.size());
+		uint64_t size;
+		std::string packed;
+		TEST_CHECK(in.Read(size));
+		TEST_CHECK(in.Read(packed, size));
+		TEST_CHECK(in.ReadAvailable() == 0);
+
+		std::string err;
+		msgpack11::MsgPack obj = msgpack11::MsgPack::parse(packed, err);
+		TEST_CHECK(err.empty());
+		TEST_CHECK(obj["version"].uint32_value() == protocol::HELLO_VERSION);
+
+		hello::Agreement agreement = hello::Negotiate(
+			obj["features"].uint32_value(),
+			obj["max_transfer_size"].uint32_value(),
+			transfer_limit);
+		link_transfer_size = agreement.max_transfer_size;
+
+		std::string response = msgpack11::MsgPack(msgpack11::MsgPack::object {
+				{"version", protocol::HELLO_VERSION},
+				{"features", agreement.features},
+				{"max_transfer_size", (uint32_t) GetMaxTransferSize()},
+				{"max_outstanding_requests", max_outstanding_requests},
+			}).dump();
+		util::Buffer out;
+		out.Write<uint64_t>(response.size());
+		out.Write(response);
+		return Response(protocol::META_CLIENT_ID, 0, 0, 0, rq.tag, out.GetData());
+	}
+
+	// splits a response payload into the chunks the bridge would send it in
+	std::vector<size_t> Chunks(size_t size) {
+		std::vector<size_t> chunks;
+		for(size_t sent = 0; sent < size; sent+= chunks.back()) {
+			chunks.push_back(std::min(size - sent, GetMaxTransferSize()));
+		}
+		return chunks;
+	}
+};
+
+// the whole exchange, as a backend runs it when a device connects
+bool Negotiate(TestDevice &device, FakeBridge &bridge, uint32_t proposed) {
+	Response r = bridge.Hello(TestDevice::MakeHelloRequest(proposed));
+	return device.ApplyHelloResponse(r);
+}
+
+// splits a response into the transfers the USB backend would read it with
+std::vector<size_t> InTransfers(size_t size, size_t transfer_size) {
+	std::vector<size_t> transfers;
+	for(size_t requested = 0; requested < size; requested+= transfers.back()) {
+		transfers.push_back(std::min(size - requested, transfer_size));
+	}
+	return transfers;
+}
+
+const size_t USBTransferLimit = 0x40000; // TWIBD_LIBUSB_TRANSFER_SIZE's default
+
+// the USB backend proposes its own transfer size and the bridge cuts it down
+void TestUSB() {
+	TestDevice device;
+	FakeBridge bridge = {64 * 1024, 64 * 1024, 256};
+
+	TEST_CHECK(Negotiate(device, bridge, USBTransferLimit));
+	TEST_CHECK(device.features == protocol::FEATURE_COMPRESSION);
+	TEST_CHECK(device.max_transfer_size == 64 * 1024);
+	TEST_CHECK(device.max_outstanding_requests == 256);
+
+	size_t transfer_size = device.GetTransferSize(USBTransferLimit);
+	TEST_CHECK(transfer_size == 64 * 1024);
+
+	// every in transfer has to be filled by exactly one of the bridge's
+	// chunks, since the bridge doesn't end short of a packet boundary
+	for(size_t size : {1, 0x200, 0x10000, 0x10001, 0x1ffff, 0x30000, 0x123456}) {
+		TEST_CHECK(bridge.Chunks(size) == InTransfers(size, transfer_size));
+	}
+}
+
+// a host that asks for less than the bridge can do gets what it asked for
+void TestSmallerHost() {
+	TestDevice device;
+	FakeBridge bridge = {256 * 1024, 16384, 256};
+
+	TEST_CHECK(Negotiate(device, bridge, 0x10000));
+	TEST_CHECK(device.max_transfer_size == 0x10000);
+	TEST_CHECK(device.GetTransferSize(USBTransferLimit) == 0x10000);
+	TEST_CHECK(bridge.Chunks(0x28000) == InTransfers(0x28000, 0x10000));
+}
+
+// a proposal the bridge won't take leaves it on its default, which it
+// reports back
+void TestSillyProposal() {
+	TestDevice device;
+	FakeBridge bridge = {64 * 1024, 16384, 256};
+
+	TEST_CHECK(Negotiate(device, bridge, 0x100));
+	TEST_CHECK(bridge.link_transfer_size == 0);
+	TEST_CHECK(device.max_transfer_size == 16384);
+	TEST_CHECK(device.GetTransferSize(USBTransferLimit) == 16384);
+}
+
+// features the device doesn't know about are dropped from the agreement,
+// whatever the host offered
+void TestUnknownFeatures() {
+	hello::Agreement agreement = hello::Negotiate(0xffffffff, 0x10000, 64 * 1024);
+	TEST_CHECK(agreement.features == hello::SupportedFeatures);
+	TEST_CHECK(agreement.max_transfer_size == 0x10000);
+}
+
+// bridges from before HELLO reject it, and everything stays on defaults
+void TestOldBridge() {
+	TestDevice device;
+	WeakRequest rq = TestDevice::MakeHelloRequest(USBTransferLimit).Weak();
+	Response rejected = rq.RespondError(TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION);
+	TEST_CHECK(!device.ApplyHelloResponse(rejected));
+	TEST_CHECK(device.features == 0);
+	TEST_CHECK(device.max_transfer_size == 0);
+	TEST_CHECK(device.max_outstanding_requests == 0);
+	TEST_CHECK(device.GetTransferSize(USBTransferLimit) == USBTransferLimit);
+
+	Response truncated = rq.RespondOk();
+	truncated.payload = std::vector<uint8_t>(4, 0);
+	TEST_CHECK(!device.ApplyHelloResponse(truncated));
+	TEST_CHECK(device.max_transfer_size == 0);
+}
+
+// the limit the bridge reports is what the backends hold requests back with
+void TestOutstandingLimit() {
+	TestDevice device;
+	FakeBridge bridge = {64 * 1024, 64 * 1024, 3};
+	TEST_CHECK(Negotiate(device, bridge, USBTransferLimit));
+	TEST_CHECK(device.max_outstanding_requests == 3);
+
+	RequestQueue queue;
+	for(uint32_t tag = 0; tag < 5; tag++) {
+		queue.Push(WeakRequest(1, 1, 0, 0, tag));
+	}
+	WeakRequest r;
+	size_t sent = 0;
+	while(queue.Pop(r, device.max_outstanding_requests)) {
+		sent++;
+	}
+	TEST_CHECK(sent == 3);
+	TEST_CHECK(queue.Complete(1, 0));
+	TEST_CHECK(queue.Pop(r, device.max_outstanding_requests));
+	TEST_CHECK(r.tag == 3);
+	TEST_CHECK(!queue.Pop(r, device.max_outstanding_requests));
+}
+
+} // anonymous namespace
+
+int main() {
+	TestUSB();
+	TestSmallerHost();
+	TestSillyProposal();
+	TestUnknownFeatures();
+	TestOldBridge();
+	TestOutstandingLimit();
+	return 0;
+}
@@ -0,0 +1,132 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "LoopbackDaemon.hpp"
+
+#include<atomic>
+#include<thread>
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+
+#include "Daemon.hpp"
+#include "SocketFrontend.hpp"
+
+namespace twili {
+namespace twib {
+namespace test {
+
+class LoopbackDaemon::Impl {
+ public:
+	Impl(Options options) :
+		socket_path(MakeSocketPath()),
+		daemon(ConfigureEnvironment(options).dispatch_threads),
+		frontend(CreateFrontend(daemon, socket_path)),
+		running(true),
+		thread([this]() {
+				while(running) {
+					daemon.Process();
+				}
+			}) {
+	}
+
+	~Impl() {
+		// clients go first, so their objects get closed while the devices
+		// are still around to hear about it
+		frontend.reset();
+		running = false;
+		daemon.Awaken();
+		thread.join();
+	}
+
+	std::string socket_path;
+	daemon::Daemon daemon;
+	std::unique_ptr<daemon::frontend::SocketFrontend> frontend;
+	std::atomic_bool running;
+	std::thread thread;
+	
+ private:
+	static std::string MakeSocketPath() {
+		static std::atomic<int> counter(0);
+		const char *dir = getenv("TMPDIR");
+		std::string path =
+			std::string(dir ? dir : "/tmp") + "/twibd-test-" +
+			std::to_string(getpid()) + "-" + std::to_string(counter++) + ".sock";
+		unlink(path.c_str());
+		return path;
+	}
+
+	// the loopback backend reads its settings from the environment
+	static Options &ConfigureEnvironment(Options &options) {
+		setenv("TWIBD_LOOPBACK_DEVICES", std::to_string(options.device_count).c_str(), 1);
+		setenv("TWIBD_LOOPBACK_LATENCY_US", std::to_string(options.latency_us).c_str(), 1);
+		setenv("TWIBD_LOOPBACK_BANDWIDTH", std::to_string(options.bandwidth).c_str(), 1);
+		setenv("TWIBD_LOOPBACK_SEND_DELAY_US", std::to_string(options.send_delay_us).c_str(), 1);
+		return options;
+	}
+
+	static std::unique_ptr<daemon::frontend::SocketFrontend> CreateFrontend(daemon::Daemon &daemon, std::string path) {
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path)-1);
+		return std::make_unique<daemon::frontend::SocketFrontend>(daemon, AF_UNIX, SOCK_STREAM, (struct sockaddr*) &addr, sizeof(addr));
+	}
+};
+
+LoopbackDaemon::LoopbackDaemon(Options options) :
+	impl(std::make_unique<Impl>(options)) {
+}
+
+LoopbackDaemon::~LoopbackDaemon() {
+}
+
+platform::Socket LoopbackDaemon::Connect() {
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, impl->socket_path.c_str(), sizeof(addr.sun_path)-1);
+	platform::Socket socket(AF_UNIX, SOCK_STREAM, 0);
+	socket.Connect((struct sockaddr*) &addr, sizeof(addr));
+	return socket;
+}
+
+std::vector<uint32_t> LoopbackDaemon::GetDeviceIds() {
+	std::vector<uint32_t> ids;
+	for(auto &device : impl->daemon.GetLoopbackBackend().GetDevices()) {
+		ids.push_back(device->device_id);
+	}
+	return ids;
+}
+
+size_t LoopbackDaemon::GetObjectCount(uint32_t device_id) {
+	for(auto &device : impl->daemon.GetLoopbackBackend().GetDevices()) {
+		if(device->device_id == device_id) {
+			return device->GetObjectCount();
+		}
+	}
+	return 0;
+}
+
+} // namespace test
+} // namespace twib
+} // namespace twili
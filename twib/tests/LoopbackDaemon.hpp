@@ -0,0 +1,64 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include "platform/platform.hpp"
+#include "common/config.hpp"
+
+#include<memory>
+#include<string>
+#include<vector>
+
+#include<stdint.h>
+
+namespace twili {
+namespace twib {
+namespace test {
+
+// Runs a whole twibd inside the calling process, with a UNIX socket frontend
+// and loopback devices only, so that tests and benchmarks can talk to it
+// through the same socket protocol the twib tool uses. The daemon's own
+// headers stay out of this one, since they clash with the tool's.
+class LoopbackDaemon {
+ public:
+	struct Options {
+		size_t dispatch_threads = TWIBD_DISPATCH_THREADS;
+		size_t device_count = 1;
+		uint64_t latency_us = 0;
+		uint64_t bandwidth = 0; // bytes per second, 0 for unlimited
+		uint64_t send_delay_us = 0; // how long SendRequest blocks
+	};
+	
+	LoopbackDaemon(Options options);
+	~LoopbackDaemon();
+
+	platform::Socket Connect();
+	std::vector<uint32_t> GetDeviceIds();
+	// objects open on a loopback device, not counting object 0
+	size_t GetObjectCount(uint32_t device_id);
+ private:
+	class Impl;
+	std::unique_ptr<Impl> impl;
+};
+
+} // namespace test
+} // namespace twib
+} // namespace twili
@@ -0,0 +1,160 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Round-trips QUERY_MEMORY_MAP responses through the encoder twili uses and
+// the decoder twib uses, and checks that the decoder turns away responses
+// that are cut short or don't line up.
+
+#include "MemoryMap.hpp"
+
+#include<vector>
+
+#include<string.h>
+
+#include "Buffer.hpp"
+
+#include "Test.hpp"
+
+using namespace twili;
+using namespace twili::memory_map;
+
+namespace {
+
+// roughly what a small homebrew looks like, ending with the reserved region
+// that runs to the top of the address space
+const std::vector<Region> sample_regions = {
+	{0x0, 0x8000000, 0x00, 0, 0, 0, 0, 0},
+	{0x8000000, 0x4000, 0x03, 0, 5, 0, 0, 0},
+	{0x8004000, 0x1000, 0x03, 0, 1, 0, 0, 0},
+	{0x8005000, 0x2000, 0x04, 0, 3, 0, 0, 0},
+	{0x8007000, 0x7ff9000, 0x00, 0, 0, 0, 0, 0},
+	{0x10000000, 0x200000, 0x05, 1, 3, 2, 1, 0},
+	{0x10200000, 0x1000, 0x01, 4, 3, 0, 0, 0},
+	{0x10201000, 0 - (uint64_t) 0x10201000, 0x10, 0, 0, 0, 0, 0},
+};
+
+std::vector<uint32_t> SamplePageInfos() {
+	std::vector<uint32_t> page_infos;
+	for(size_t i = 0; i < sample_regions.size(); i++) {
+		page_infos.push_back((uint32_t) i * 3);
+	}
+	return page_infos;
+}
+
+std::vector<uint8_t> EncodeSample() {
+	util::Buffer buffer;
+	Encode(sample_regions, SamplePageInfos(), buffer);
+	return buffer.GetData();
+}
+
+bool DecodeBytes(std::vector<uint8_t> bytes, std::vector<Region> &regions, std::vector<uint32_t> &page_infos) {
+	util::Buffer buffer(bytes);
+	return Decode(buffer, regions, page_infos);
+}
+
+bool SameRegions(const std::vector<Region> &a, const std::vector<Region> &b) {
+	return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(Region)) == 0;
+}
+
+void TestRoundTrip() {
+	std::vector<Region> regions;
+	std::vector<uint32_t> page_infos;
+	TEST_CHECK(DecodeBytes(EncodeSample(), regions, page_infos));
+	TEST_CHECK(SameRegions(regions, sample_regions));
+	TEST_CHECK(page_infos == SamplePageInfos());
+}
+
+void TestEmpty() {
+	util::Buffer buffer;
+	Encode(std::vector<Region>(), std::vector<uint32_t>(), buffer);
+	std::vector<Region> regions = sample_regions;
+	std::vector<uint32_t> page_infos = SamplePageInfos();
+	TEST_CHECK(Decode(buffer, regions, page_infos));
+	TEST_CHECK(regions.empty());
+	TEST_CHECK(page_infos.empty());
+}
+
+// same bytes as the generic vector packing older twib and twili builds use
+void TestWireFormat() {
+	std::vector<uint8_t> bytes = EncodeSample();
+	size_t count = sample_regions.size();
+	TEST_CHECK(bytes.size() == 8 + count * 0x28 + 8 + count * 4);
+
+	uint64_t region_count, page_info_count;
+	memcpy(&region_count, bytes.data(), 8);
+	memcpy(&page_info_count, bytes.data() + 8 + count * 0x28, 8);
+	TEST_CHECK(region_count == count);
+	TEST_CHECK(page_info_count == count);
+
+	// third region, permission field
+	uint32_t permission;
+	memcpy(&permission, bytes.data() + 8 + 2 * 0x28 + 0x18, 4);
+	TEST_CHECK(permission == 1);
+}
+
+void TestTruncated() {
+	std::vector<uint8_t> bytes = EncodeSample();
+	for(size_t size = 0; size < bytes.size(); size++) {
+		std::vector<Region> regions;
+		std::vector<uint32_t> page_infos;
+		TEST_CHECK(!DecodeBytes(std::vector<uint8_t>(bytes.begin(), bytes.begin() + size), regions, page_infos));
+	}
+}
+
+void TestTrailingBytes() {
+	std::vector<uint8_t> bytes = EncodeSample();
+	bytes.push_back(0);
+	std::vector<Region> regions;
+	std::vector<uint32_t> page_infos;
+	TEST_CHECK(!DecodeBytes(bytes, regions, page_infos));
+}
+
+void TestMismatchedCounts() {
+	util::Buffer buffer;
+	std::vector<uint32_t> page_infos = SamplePageInfos();
+	page_infos.pop_back();
+	Encode(sample_regions, page_infos, buffer);
+
+	std::vector<Region> regions;
+	TEST_CHECK(!Decode(buffer, regions, page_infos));
+}
+
+// a corrupt count shouldn't make the decoder try to allocate it
+void TestHugeCount() {
+	util::Buffer buffer;
+	buffer.Write<uint64_t>(UINT64_MAX / sizeof(Region));
+	buffer.Write(sample_regions);
+	std::vector<Region> regions;
+	std::vector<uint32_t> page_infos;
+	TEST_CHECK(!Decode(buffer, regions, page_infos));
+}
+
+} // anonymous namespace
+
+int main() {
+	TestRoundTrip();
+	TestEmpty();
+	TestWireFormat();
+	TestTruncated();
+	TestTrailingBytes();
+	TestMismatchedCounts();
+	TestHugeCount();
+	return 0;
+}
@@ -0,0 +1,188 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Stress test for the objects twibd keeps on behalf of its clients. One
+// client opens and closes 100k file accessors on a loopback device, keeping
+// a thousand open at a time and closing them in a shuffled order, so closes
+// hit every part of its ownership table. Another opens thousands and hangs
+// up without closing any, and twibd has to close them all for it. The device
+// has to end up with exactly the objects it started with either way.
+
+#include "LoopbackDaemon.hpp"
+
+#include<algorithm>
+#include<chrono>
+#include<random>
+#include<string>
+#include<thread>
+#include<vector>
+
+#include<stdio.h>
+#include<stdlib.h>
+
+#include "Buffer.hpp"
+#include "SocketClient.hpp"
+#include "RemoteObject.hpp"
+#include "Protocol.hpp"
+#include "interfaces/ITwibDeviceInterface.hpp"
+#include "interfaces/ITwibFilesystemAccessor.hpp"
+#include "interfaces/ITwibFileAccessor.hpp"
+
+#include "Test.hpp"
+
+using namespace twili;
+using namespace twili::twib;
+
+namespace {
+
+const char *FilePath = "/churn";
+
+void TestChurn(test::LoopbackDaemon &daemon, uint32_t device_id, size_t total, size_t open_at_once) {
+	tool::client::SocketClient client(daemon.Connect());
+	std::shared_ptr<tool::RemoteObject> device = std::make_shared<tool::RemoteObject>(client, device_id, 0);
+	tool::ITwibDeviceInterface itdi(device);
+	tool::ITwibFilesystemAccessor fs = itdi.OpenFilesystemAccessor("sd");
+	fs.CreateFile(0, 0, FilePath);
+	size_t baseline = daemon.GetObjectCount(device_id);
+
+	std::mt19937 rng(1234);
+	std::vector<tool::ITwibFileAccessor> files;
+	auto start = std::chrono::steady_clock::now();
+	for(size_t opened = 0; opened < total; opened+= open_at_once) {
+		for(size_t i = 0; i < open_at_once; i++) {
+			files.push_back(fs.OpenFile(1, FilePath));
+		}
+		TEST_CHECK(daemon.GetObjectCount(device_id) == baseline + open_at_once);
+
+		// each one closes its object as it goes
+		std::shuffle(files.begin(), files.end(), rng);
+		while(!files.empty()) {
+			files.pop_back();
+		}
+		TEST_CHECK(daemon.GetObjectCount(device_id) == baseline);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("opened and closed %zu objects (%zu at a time): %6.2f us per object\n", total, open_at_once, seconds * 1e6 / total);
+
+	fs.DeleteFile(FilePath);
+}
+
+// talks to twibd directly, so that nothing closes objects behind our back
+class RawClient {
+ public:
+	RawClient(platform::Socket &&socket) : socket(std::move(socket)) {
+	}
+
+	void Send(uint32_t device_id, uint32_t object_id, uint32_t command_id, uint32_t tag, util::Buffer &payload) {
+		protocol::MessageHeader mh = {};
+		mh.device_id = device_id;
+		mh.object_id = object_id;
+		mh.command_id = command_id;
+		mh.tag = tag;
+		mh.payload_size = payload.ReadAvailable();
+		util::Buffer message;
+		message.Write(mh);
+		message.Write(payload.Read(), payload.ReadAvailable());
+		while(message.ReadAvailable() > 0) {
+			ssize_t r = socket.Send(message.Read(), message.ReadAvailable(), 0);
+			TEST_CHECK(r > 0);
+			message.MarkRead(r);
+		}
+	}
+
+	// returns the ID of the one object the response carries
+	uint32_t ReceiveObject(uint32_t tag) {
+		protocol::MessageHeader mh;
+		RecvExactly((uint8_t*) &mh, sizeof(mh));
+		TEST_CHECK(mh.result_code == 0);
+		TEST_CHECK(mh.tag == tag);
+		TEST_CHECK(mh.object_count == 1);
+		std::vector<uint8_t> payload(mh.payload_size);
+		RecvExactly(payload.data(), payload.size());
+		uint32_t object_id;
+		RecvExactly((uint8_t*) &object_id, sizeof(object_id));
+		return object_id;
+	}
+
+	platform::Socket socket;
+ private:
+	void RecvExactly(uint8_t *data, size_t size) {
+		while(size > 0) {
+			ssize_t r = socket.Recv(data, size, 0);
+			TEST_CHECK(r > 0);
+			data+= r;
+			size-= r;
+		}
+	}
+};
+
+void WriteString(util::Buffer &buffer, std::string str) {
+	buffer.Write<uint64_t>(str.size());
+	buffer.Write(str);
+}
+
+void TestReleaseOnDisconnect(test::LoopbackDaemon &daemon, uint32_t device_id, size_t count) {
+	size_t baseline = daemon.GetObjectCount(device_id);
+	{
+		tool::client::SocketClient client(daemon.Connect());
+		tool::ITwibDeviceInterface itdi(std::make_shared<tool::RemoteObject>(client, device_id, 0));
+		itdi.OpenFilesystemAccessor("sd").CreateFile(0, 0, FilePath);
+	}
+
+	RawClient raw(daemon.Connect());
+	util::Buffer payload;
+	WriteString(payload, "sd");
+	raw.Send(device_id, 0, (uint32_t) protocol::ITwibDeviceInterface::Command::OPEN_FILESYSTEM_ACCESSOR, 0, payload);
+	uint32_t fs = raw.ReceiveObject(0);
+
+	// pipelined. twibd keeps reading while its responses queue up, so
+	// sending everything first can't deadlock.
+	for(uint32_t tag = 1; tag <= count; tag++) {
+		payload.Clear();
+		payload.Write<uint32_t>(1);
+		WriteString(payload, FilePath);
+		raw.Send(device_id, fs, (uint32_t) protocol::ITwibFilesystemAccessor::Command::OPEN_FILE, tag, payload);
+	}
+	for(uint32_t tag = 1; tag <= count; tag++) {
+		raw.ReceiveObject(tag);
+	}
+	TEST_CHECK(daemon.GetObjectCount(device_id) == baseline + 1 + count);
+
+	auto start = std::chrono::steady_clock::now();
+	raw.socket.Close();
+	while(daemon.GetObjectCount(device_id) != baseline) {
+		TEST_CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(30));
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("released %zu objects on disconnect: %8.1f ms\n", count + 1, ms);
+}
+
+} // anonymous namespace
+
+int main() {
+	test::LoopbackDaemon daemon(test::LoopbackDaemon::Options {});
+	uint32_t device_id = daemon.GetDeviceIds()[0];
+
+	TestChurn(daemon, device_id, 100000, 1000);
+	TestReleaseOnDisconnect(daemon, device_id, 10000);
+
+	return 0;
+}
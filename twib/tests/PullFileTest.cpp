@@ -0,0 +1,254 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Pulls files through twib's PullFile from a fake file accessor, which
+// answers reads out of order and, like the bridge does when the filesystem
+// comes up short, with less than was asked for, and checks that what lands
+// in the destination is the file.
+
+#include "FileTransfer.hpp"
+
+#include<algorithm>
+#include<condition_variable>
+#include<deque>
+#include<functional>
+#include<mutex>
+#include<thread>
+#include<vector>
+
+#include<stdio.h>
+#include<unistd.h>
+
+#include "Buffer.hpp"
+#include "Client.hpp"
+#include "Protocol.hpp"
+#include "RemoteObject.hpp"
+#include "common/ResultError.hpp"
+#include "err.hpp"
+
+#include "interfaces/ITwibFileAccessor.hpp"
+
+#include "Test.hpp"
+
+using namespace twili;
+using namespace twili::twib;
+using namespace twili::twib::tool;
+
+namespace {
+
+const uint32_t FileObjectId = 1;
+
+// Plays an ITwibFileAccessor on the other end of the client. Requests are
+// answered on their own thread, newest first, so that with several in
+// flight the responses come back out of order.
+class FakeFileClient : public client::Client {
+ public:
+	// how many bytes to answer a read with, given what was asked for and
+	// what's left of the file
+	using ReadPolicy = std::function<size_t(uint64_t offset, uint64_t size, size_t available)>;
+	
+	FakeFileClient(std::vector<uint8_t> file, ReadPolicy policy) :
+		file(std::move(file)),
+		policy(policy),
+		thread(&FakeFileClient::Run, this) {
+	}
+
+	~FakeFileClient() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		cv.notify_all();
+		thread.join();
+	}
+
+	uint32_t fail_at = 0; // answer reads starting here with an error
+	size_t reads = 0;
+ protected:
+	virtual void SendRequestImpl(const Request &rq) override {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back(rq);
+		}
+		cv.notify_all();
+	}
+ private:
+	void Run() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while(true) {
+			cv.wait(lock, [this]() { return stopping || !queue.empty(); });
+			if(queue.empty()) {
+				return;
+			}
+			Request rq = std::move(queue.back());
+			queue.pop_back();
+			lock.unlock();
+			Handle(rq);
+			lock.lock();
+		}
+	}
+
+	void Handle(Request &rq) {
+		protocol::MessageHeader mh = {};
+		mh.device_id = rq.device_id;
+		mh.object_id = rq.object_id;
+		mh.tag = rq.tag;
+		util::Buffer payload;
+		util::Buffer object_ids;
+
+		if(rq.command_id == (uint32_t) protocol::ITwibFileAccessor::Command::READ) {
+			TEST_CHECK(rq.object_id == FileObjectId);
+			util::Buffer in(rq.payload);
+			uint64_t offset, size;
+			TEST_CHECK(in.Read(offset) && in.Read(size));
+			TEST_CHECK(size > 0);
+			reads++;
+			
+			if(fail_at && offset >= fail_at) {
+				mh.result_code = TWILI_ERR_PROTOCOL_BAD_REQUEST;
+			} else {
+				size_t available = offset < file.size() ? file.size() - offset : 0;
+				size_t actual = policy(offset, size, available);
+				TEST_CHECK(actual <= std::min(size, available));
+				payload.Write<uint64_t>(actual);
+				payload.Write(file.data() + offset, actual);
+			}
+		} else {
+			TEST_CHECK(rq.command_id == 0xffffffff); // close
+		}
+		mh.payload_size = payload.ReadAvailable();
+		PostResponse(mh, payload, object_ids);
+	}
+
+	std::vector<uint8_t> file;
+	ReadPolicy policy;
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<Request> queue;
+	bool stopping = false;
+	std::thread thread;
+};
+
+std::vector<uint8_t> MakeFile(size_t size) {
+	std::vector<uint8_t> file(size);
+	for(size_t i = 0; i < size; i++) {
+		file[i] = (uint8_t) (i * 31 + (i >> 12));
+	}
+	return file;
+}
+
+struct Pulled {
+	bool ok;
+	std::vector<uint8_t> data;
+	size_t reads;
+};
+
+// pulls total_size bytes of file, answering reads according to policy
+Pulled Pull(const std::vector<uint8_t> &file, size_t total_size, size_t window, FakeFileClient::ReadPolicy policy, uint32_t fail_at=0) {
+	FILE *tmp = tmpfile();
+	TEST_CHECK(tmp != nullptr);
+	platform::File dst(fileno(tmp), false);
+
+	Pulled p;
+	FakeFileClient client(file, policy);
+	client.fail_at = fail_at;
+	{
+		ITwibFileAccessor itfa(std::make_shared<RemoteObject>(client, 1, FileObjectId));
+		p.ok = PullFile(itfa, dst, total_size, window);
+	}
+	p.reads = client.reads;
+
+	off_t size = lseek(dst.fd, 0, SEEK_END);
+	p.data.resize(size);
+	TEST_CHECK(pread(dst.fd, p.data.data(), p.data.size(), 0) == size);
+	fclose(tmp);
+	return p;
+}
+
+size_t Everything(uint64_t, uint64_t size, size_t available) {
+	return std::min((size_t) size, available);
+}
+
+// whole chunks, however many are in flight
+void TestWholeChunks() {
+	std::vector<uint8_t> file = MakeFile(ChunkSize * 3 + 123);
+	for(size_t window : {1, 4}) {
+		Pulled p = Pull(file, file.size(), window, Everything);
+		TEST_CHECK(p.ok);
+		TEST_CHECK(p.data == file);
+		TEST_CHECK(p.reads == 4);
+	}
+}
+
+// a read that comes back short is picked up where it left off
+void TestShortReads() {
+	std::vector<uint8_t> file = MakeFile(ChunkSize * 2 + 0x4321);
+	auto uneven = [](uint64_t offset, uint64_t size, size_t available) {
+		// anywhere from 0x300 bytes to everything, depending on the offset
+		size_t actual = 0x300 + (offset * 7919) % ChunkSize;
+		return std::min({actual, (size_t) size, available});
+	};
+	for(size_t window : {1, 4}) {
+		Pulled p = Pull(file, file.size(), window, uneven);
+		TEST_CHECK(p.ok);
+		TEST_CHECK(p.data == file);
+		TEST_CHECK(p.reads > 3);
+	}
+
+	// a byte at a time still gets there
+	std::vector<uint8_t> small = MakeFile(0x80);
+	Pulled p = Pull(small, small.size(), 4, [](uint64_t, uint64_t, size_t available) { return std::min(available, (size_t) 1); });
+	TEST_CHECK(p.ok);
+	TEST_CHECK(p.data == small);
+	TEST_CHECK(p.reads == small.size());
+}
+
+// a file that turns out shorter than it said it was fails the pull, without
+// writing anything that isn't in the file
+void TestEarlyEof() {
+	std::vector<uint8_t> file = MakeFile(ChunkSize + 0x100);
+	Pulled p = Pull(file, ChunkSize * 3, 4, Everything);
+	TEST_CHECK(!p.ok);
+	TEST_CHECK(p.data.size() <= file.size());
+	TEST_CHECK(std::equal(p.data.begin(), p.data.end(), file.begin()));
+}
+
+// errors from the bridge are thrown once nothing references the pull anymore
+void TestReadError() {
+	std::vector<uint8_t> file = MakeFile(ChunkSize * 4);
+	bool thrown = false;
+	try {
+		Pull(file, file.size(), 4, Everything, ChunkSize * 2);
+	} catch(ResultError &e) {
+		TEST_CHECK(e.code == TWILI_ERR_PROTOCOL_BAD_REQUEST);
+		thrown = true;
+	}
+	TEST_CHECK(thrown);
+}
+
+} // anonymous namespace
+
+int main() {
+	TestWholeChunks();
+	TestShortReads();
+	TestEarlyEof();
+	TestReadError();
+	return 0;
+}
@@ -0,0 +1,152 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Drives RequestQueue the way the USB backend does, with a fake link in
+// place of libusb: requests go out one at a time, and the fake device
+// answers whatever it is holding in an arbitrary order.
+
+#include "RequestQueue.hpp"
+
+#include<algorithm>
+#include<random>
+#include<vector>
+
+#include "Test.hpp"
+
+using namespace twili::twib::daemon;
+
+namespace {
+
+WeakRequest MakeRequest(uint32_t client_id, uint32_t tag, uint32_t command_id=0) {
+	return WeakRequest(client_id, 1, 0, command_id, tag, std::vector<uint8_t>(16, (uint8_t) tag));
+}
+
+class FakeLink {
+ public:
+	FakeLink(RequestQueue &queue, size_t max_outstanding) : queue(queue), max_outstanding(max_outstanding) {
+	}
+
+	// sends requests until the queue runs dry or the device is full
+	void Pump() {
+		WeakRequest r;
+		while(queue.Pop(r, max_outstanding)) {
+			TEST_CHECK(r.payload.size() == 16);
+			held.push_back(r);
+			TEST_CHECK(max_outstanding == 0 || queue.Outstanding() <= max_outstanding);
+		}
+	}
+
+	// the device answers one request it's holding
+	WeakRequest Respond(size_t index) {
+		WeakRequest r = held[index];
+		held.erase(held.begin() + index);
+		TEST_CHECK(queue.Complete(r.client_id, r.tag));
+		return r;
+	}
+	
+	RequestQueue &queue;
+	size_t max_outstanding;
+	std::vector<WeakRequest> held;
+};
+
+// two clients using the same tags must not clobber each other
+void TestSameTagDifferentClients() {
+	RequestQueue queue;
+	FakeLink link(queue, 0);
+
+	queue.Push(MakeRequest(1, 7, 100));
+	queue.Push(MakeRequest(2, 7, 200));
+	link.Pump();
+	TEST_CHECK(link.held.size() == 2);
+	TEST_CHECK(queue.Outstanding() == 2);
+
+	// answer client 2 first
+	WeakRequest r = link.Respond(1);
+	TEST_CHECK(r.client_id == 2 && r.command_id == 200);
+	TEST_CHECK(queue.Outstanding() == 1);
+	TEST_CHECK(!queue.Complete(2, 7)); // already answered
+
+	std::vector<WeakRequest> left = queue.TakePending();
+	TEST_CHECK(left.size() == 1);
+	TEST_CHECK(left[0].client_id == 1 && left[0].tag == 7 && left[0].command_id == 100);
+	TEST_CHECK(left[0].payload.size() == 0);
+}
+
+// a response for something we never sent shouldn't disturb the accounting
+void TestUnknownResponse() {
+	RequestQueue queue;
+	FakeLink link(queue, 1);
+
+	queue.Push(MakeRequest(1, 1));
+	queue.Push(MakeRequest(1, 2));
+	link.Pump();
+	TEST_CHECK(link.held.size() == 1);
+	TEST_CHECK(!queue.Complete(3, 1));
+	TEST_CHECK(queue.Outstanding() == 1);
+
+	link.Respond(0);
+	link.Pump();
+	TEST_CHECK(link.held.size() == 1);
+	TEST_CHECK(link.held[0].tag == 2);
+}
+
+// Lots of clients reusing a small set of tags with a limit on outstanding
+// requests. The queue has to drain completely without ever exceeding the
+// limit or stalling.
+void TestNoStall(size_t max_outstanding) {
+	std::mt19937 rng(1234 + max_outstanding);
+	RequestQueue queue;
+	FakeLink link(queue, max_outstanding);
+
+	const uint32_t clients = 8;
+	const uint32_t tags = 4;
+	size_t answered = 0;
+	size_t sent = 0;
+	for(int round = 0; round < 2000; round++) {
+		// every client has all of its tags in flight at once
+		for(uint32_t c = 0; c < clients; c++) {
+			for(uint32_t t = 0; t < tags; t++) {
+				queue.Push(MakeRequest(c, t));
+				sent++;
+			}
+		}
+		link.Pump();
+		while(!link.held.empty()) {
+			link.Respond(std::uniform_int_distribution<size_t>(0, link.held.size() - 1)(rng));
+			answered++;
+			link.Pump();
+		}
+		TEST_CHECK(queue.Empty());
+		TEST_CHECK(queue.Outstanding() == 0);
+	}
+	TEST_CHECK(answered == sent);
+	TEST_CHECK(queue.TakePending().empty());
+}
+
+} // anonymous namespace
+
+int main() {
+	TestSameTagDifferentClients();
+	TestUnknownResponse();
+	TestNoStall(0);
+	TestNoStall(1);
+	TestNoStall(3);
+	return 0;
+}
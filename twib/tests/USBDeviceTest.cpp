@@ -0,0 +1,454 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Drives USBBackend's device logic over a fake transport in place of
+// libusb. The test plays the bridge: it reads requests off the out
+// endpoints and writes responses to the in endpoints, in short transfers
+// and out of order, and checks what the device hands back to the daemon.
+
+#include "USBDevice.hpp"
+#include "USBTransport.hpp"
+
+#include<algorithm>
+#include<deque>
+#include<string>
+#include<vector>
+
+#include<string.h>
+
+#include<msgpack11.hpp>
+
+#include "Buffer.hpp"
+#include "Compression.hpp"
+#include "Protocol.hpp"
+#include "err.hpp"
+
+#include "Test.hpp"
+
+using namespace twili;
+using namespace twili::twib::daemon;
+using namespace twili::twib::daemon::backend;
+
+namespace {
+
+using Endpoint = USBTransport::Endpoint;
+
+const size_t TransferSize = 0x4000;
+const size_t TransferCount = 4;
+
+// Holds on to submitted transfers until the test completes them.
+class FakeTransport : public USBTransport {
+ public:
+	struct Pending {
+		Transfer *t;
+		uint8_t *buffer;
+		size_t size;
+	};
+	
+	virtual std::unique_ptr<Transfer> AllocTransfer() override {
+		return std::make_unique<Transfer>();
+	}
+	
+	virtual bool Submit(Transfer &t, Endpoint endpoint, uint8_t *buffer, size_t size, Transfer::Callback cb, unsigned int) override {
+		if(fail_submits) {
+			return false;
+		}
+		t.callback = cb;
+		t.length = size;
+		t.actual_length = 0;
+		Queue(endpoint).push_back({&t, buffer, size});
+		return true;
+	}
+	
+	virtual void Cancel(Transfer &t) override {
+		for(auto &queue : queues) {
+			auto i = std::find_if(queue.begin(), queue.end(), [&t](Pending &p) { return p.t == &t; });
+			if(i != queue.end()) {
+				queue.erase(i);
+				cancelled.push_back(&t);
+			}
+		}
+	}
+
+	std::deque<Pending> &Queue(Endpoint endpoint) {
+		return queues[(int) endpoint];
+	}
+	
+	Pending Take(Endpoint endpoint) {
+		TEST_CHECK(!Queue(endpoint).empty());
+		Pending p = Queue(endpoint).front();
+		Queue(endpoint).pop_front();
+		return p;
+	}
+
+	void Complete(Pending p, size_t actual_length, Status status=Status::Completed) {
+		p.t->status = status;
+		p.t->actual_length = actual_length;
+		p.t->callback(*p.t);
+	}
+
+	// runs the callbacks for cancelled transfers, the way libusb does once
+	// the cancellation goes through
+	void FlushCancelled() {
+		while(!cancelled.empty()) {
+			Transfer *t = cancelled.front();
+			cancelled.pop_front();
+			t->status = Status::Failed;
+			t->actual_length = 0;
+			t->callback(*t);
+		}
+	}
+
+	bool fail_submits = false;
+ private:
+	std::deque<Pending> queues[4];
+	std::deque<Transfer*> cancelled;
+};
+
+class TestDevice : public USBDevice {
+ public:
+	TestDevice(FakeTransport *transport, std::vector<Response> &responses) :
+		USBDevice(std::unique_ptr<USBTransport>(transport), TransferSize, TransferCount),
+		responses(responses) {
+	}
+	~TestDevice() {
+		FailPendingRequests();
+	}
+
+	std::vector<uint32_t> object_ids;
+ protected:
+	virtual void PostResponse(Response &&r) override {
+		responses.push_back(std::move(r));
+	}
+	virtual std::shared_ptr<BridgeObject> MakeObject(uint32_t object_id) override {
+		object_ids.push_back(object_id);
+		return nullptr; // a real one would need a daemon to close it through
+	}
+ private:
+	std::vector<Response> &responses;
+};
+
+class TestClient : public Client {
+ public:
+	TestClient(uint32_t id) {
+		client_id = id;
+	}
+	virtual void PostResponse(Response &) override {
+	}
+};
+
+// a device on a fake link, torn down the way the backend does it
+struct Harness {
+	Harness() :
+		transport(new FakeTransport()),
+		device(std::make_shared<TestDevice>(transport, responses)) {
+	}
+	~Harness() {
+		if(device) {
+			Close();
+		}
+	}
+
+	void Close() {
+		device->Destroy();
+		transport->FlushCancelled();
+		// nothing in flight should be holding on to the device anymore
+		TEST_CHECK(device.use_count() == 1);
+		device.reset();
+	}
+
+	std::vector<Response> responses;
+	FakeTransport *transport; // owned by the device
+	std::shared_ptr<TestDevice> device;
+};
+
+struct Received {
+	protocol::MessageHeader hdr;
+	std::vector<uint8_t> payload;
+	size_t largest_transfer = 0;
+};
+
+// reads the next request off the out endpoints, as the bridge would
+Received ReadRequest(FakeTransport &transport) {
+	Received r;
+	FakeTransport::Pending meta = transport.Take(Endpoint::MetaOut);
+	TEST_CHECK(meta.size == sizeof(r.hdr));
+	memcpy(&r.hdr, meta.buffer, sizeof(r.hdr));
+	transport.Complete(meta, meta.size);
+
+	size_t size = r.hdr.payload_size & ~protocol::PAYLOAD_COMPRESSED;
+	while(r.payload.size() < size) {
+		FakeTransport::Pending data = transport.Take(Endpoint::DataOut);
+		r.payload.insert(r.payload.end(), data.buffer, data.buffer + data.size);
+		r.largest_transfer = std::max(r.largest_transfer, data.size);
+		transport.Complete(data, data.size);
+	}
+	TEST_CHECK(r.payload.size() == size);
+	TEST_CHECK(transport.Queue(Endpoint::DataOut).empty());
+
+	if(r.hdr.payload_size & protocol::PAYLOAD_COMPRESSED) {
+		std::vector<uint8_t> decompressed;
+		TEST_CHECK(compression::DecompressPayload(r.payload.data(), r.payload.size(), decompressed));
+		r.payload = std::move(decompressed);
+		r.hdr.payload_size = r.payload.size();
+	}
+	return r;
+}
+
+// writes a response to the in endpoints, filling no transfer with more than
+// chunk bytes, the way a bridge that ends its transfers early would
+void WriteResponse(FakeTransport &transport, uint32_t client_id, uint32_t tag, std::vector<uint8_t> payload, size_t chunk, std::vector<uint32_t> object_ids={}, bool compress=false) {
+	protocol::MessageHeader hdr = {};
+	hdr.client_id = client_id;
+	hdr.tag = tag;
+	hdr.object_count = object_ids.size();
+	
+	std::vector<uint8_t> compressed;
+	if(compress) {
+		TEST_CHECK(compression::CompressPayload(payload.data(), payload.size(), compressed));
+		payload = std::move(compressed);
+		hdr.payload_size = payload.size() | protocol::PAYLOAD_COMPRESSED;
+	} else {
+		hdr.payload_size = payload.size();
+	}
+
+	FakeTransport::Pending meta = transport.Take(Endpoint::MetaIn);
+	TEST_CHECK(meta.size == sizeof(hdr));
+	memcpy(meta.buffer, &hdr, sizeof(hdr));
+	transport.Complete(meta, meta.size);
+
+	std::vector<uint8_t> data = payload;
+	data.insert(data.end(), (uint8_t*) object_ids.data(), (uint8_t*) (object_ids.data() + object_ids.size()));
+	size_t sent = 0;
+	while(sent < data.size()) {
+		// the bridge doesn't end responses with a zero-length packet, so the
+		// host must never ask for more than the response has left
+		size_t asked = 0;
+		for(FakeTransport::Pending &p : transport.Queue(Endpoint::DataIn)) {
+			asked+= p.size;
+		}
+		TEST_CHECK(asked <= data.size() - sent);
+		
+		FakeTransport::Pending in = transport.Take(Endpoint::DataIn);
+		size_t size = std::min({chunk, in.size, data.size() - sent});
+		memcpy(in.buffer, data.data() + sent, size);
+		sent+= size;
+		transport.Complete(in, size);
+	}
+	TEST_CHECK(transport.Queue(Endpoint::DataIn).empty());
+}
+
+std::vector<uint8_t> Framed(const msgpack11::MsgPack &obj) {
+	std::string packed = obj.dump();
+	util::Buffer buffer;
+	buffer.Write<uint64_t>(packed.size());
+	buffer.Write(packed);
+	return buffer.GetData();
+}
+
+// HELLO and IDENTIFY, answered the way twili would
+void Handshake(Harness &h, uint32_t features, uint32_t max_transfer_size, uint32_t max_outstanding_requests) {
+	h.device->Begin();
+
+	Received hello = ReadRequest(*h.transport);
+	TEST_CHECK(hello.hdr.client_id == protocol::META_CLIENT_ID);
+	TEST_CHECK(hello.hdr.command_id == (uint32_t) protocol::ITwibDeviceInterface::Command::HELLO);
+	// IDENTIFY goes out right behind it, without waiting for the response
+	Received identify = ReadRequest(*h.transport);
+	TEST_CHECK(identify.hdr.client_id == protocol::META_CLIENT_ID);
+	TEST_CHECK(identify.hdr.command_id == (uint32_t) protocol::ITwibDeviceInterface::Command::IDENTIFY);
+	TEST_CHECK(identify.hdr.tag != hello.hdr.tag);
+
+	WriteResponse(
+		*h.transport, protocol::META_CLIENT_ID, hello.hdr.tag,
+		Framed(msgpack11::MsgPack::object {
+				{"version", protocol::HELLO_VERSION},
+				{"features", features},
+				{"max_transfer_size", max_transfer_size},
+				{"max_outstanding_requests", max_outstanding_requests},
+			}), TransferSize);
+	TEST_CHECK(!h.device->ready_flag);
+	WriteResponse(
+		*h.transport, protocol::META_CLIENT_ID, identify.hdr.tag,
+		Framed(msgpack11::MsgPack::object {
+				{"device_nickname", "test"},
+				{"serial_number", "0123456789"},
+			}), TransferSize);
+	TEST_CHECK(h.device->ready_flag);
+	TEST_CHECK(h.device->serial_number == "0123456789");
+	TEST_CHECK(h.device->device_id == (uint32_t) std::hash<std::string>()("0123456789"));
+	TEST_CHECK(h.responses.empty()); // the daemon doesn't hear about these
+}
+
+Request MakeRequest(std::shared_ptr<Client> client, uint32_t command_id, uint32_t tag, size_t size=0) {
+	std::vector<uint8_t> payload(size);
+	for(size_t i = 0; i < size; i++) {
+		payload[i] = (uint8_t) (i * 7 + tag);
+	}
+	return Request(client, 1, 0, command_id, tag, std::move(payload));
+}
+
+// the transfer size agreed to in HELLO splits payloads both ways
+void TestHandshake() {
+	Harness h;
+	Handshake(h, 0, 0x1000, 0);
+	TEST_CHECK(h.device->max_transfer_size == 0x1000);
+
+	auto client = std::make_shared<TestClient>(1);
+	h.device->SendRequest(MakeRequest(client, 10, 1, 0x2800));
+	Received r = ReadRequest(*h.transport);
+	TEST_CHECK(r.hdr.client_id == 1 && r.hdr.command_id == 10 && r.hdr.tag == 1);
+	TEST_CHECK(r.largest_transfer == 0x1000);
+	TEST_CHECK(r.payload == MakeRequest(client, 10, 1, 0x2800).payload.GetVector());
+
+	WriteResponse(*h.transport, 1, 1, std::vector<uint8_t>(0x2345, 0x5a), 0x1000);
+	TEST_CHECK(h.responses.size() == 1);
+	TEST_CHECK(h.responses[0].payload.GetVector() == std::vector<uint8_t>(0x2345, 0x5a));
+}
+
+// Requests go out back to back, and responses come back in whatever order
+// the bridge likes. Tags are only unique per client.
+void TestTagDemultiplexing() {
+	Harness h;
+	Handshake(h, 0, TransferSize, 0);
+
+	auto a = std::make_shared<TestClient>(1);
+	auto b = std::make_shared<TestClient>(2);
+	h.device->SendRequest(MakeRequest(a, 100, 7, 0x100));
+	h.device->SendRequest(MakeRequest(b, 200, 7, 0x5000));
+	h.device->SendRequest(MakeRequest(a, 300, 8));
+
+	Received ra = ReadRequest(*h.transport);
+	Received rb = ReadRequest(*h.transport);
+	Received ra2 = ReadRequest(*h.transport);
+	TEST_CHECK(ra.hdr.client_id == 1 && ra.hdr.tag == 7 && ra.hdr.command_id == 100);
+	TEST_CHECK(rb.hdr.client_id == 2 && rb.hdr.tag == 7 && rb.hdr.command_id == 200);
+	TEST_CHECK(rb.payload.size() == 0x5000);
+	TEST_CHECK(ra2.hdr.client_id == 1 && ra2.hdr.tag == 8 && ra2.payload.empty());
+	TEST_CHECK(h.transport->Queue(Endpoint::MetaOut).empty());
+
+	WriteResponse(*h.transport, 2, 7, std::vector<uint8_t>(0x10, 2), 0x200);
+	WriteResponse(*h.transport, 1, 8, std::vector<uint8_t>(), 0x200);
+	WriteResponse(*h.transport, 1, 7, std::vector<uint8_t>(0x9000, 1), 0x200, {0x11, 0x22});
+	TEST_CHECK(h.responses.size() == 3);
+	TEST_CHECK(h.responses[0].client_id == 2 && h.responses[0].tag == 7);
+	TEST_CHECK(h.responses[0].payload.GetVector() == std::vector<uint8_t>(0x10, 2));
+	TEST_CHECK(h.responses[1].client_id == 1 && h.responses[1].tag == 8);
+	TEST_CHECK(h.responses[1].payload.size() == 0);
+	TEST_CHECK(h.responses[2].client_id == 1 && h.responses[2].tag == 7);
+	TEST_CHECK(h.responses[2].payload.GetVector() == std::vector<uint8_t>(0x9000, 1));
+	TEST_CHECK(h.responses[2].objects.size() == 2);
+	TEST_CHECK(h.device->object_ids == std::vector<uint32_t>({0x11, 0x22}));
+
+	// nothing is left pending, so tearing down doesn't fail anything
+	h.Close();
+	TEST_CHECK(h.responses.size() == 3);
+}
+
+// the limit from HELLO holds requests back until responses free up room
+void TestOutstandingLimit() {
+	Harness h;
+	Handshake(h, 0, TransferSize, 2);
+
+	auto client = std::make_shared<TestClient>(1);
+	for(uint32_t tag = 0; tag < 4; tag++) {
+		h.device->SendRequest(MakeRequest(client, 10, tag, 0x10));
+	}
+	TEST_CHECK(ReadRequest(*h.transport).hdr.tag == 0);
+	TEST_CHECK(ReadRequest(*h.transport).hdr.tag == 1);
+	TEST_CHECK(h.transport->Queue(Endpoint::MetaOut).empty());
+
+	WriteResponse(*h.transport, 1, 1, std::vector<uint8_t>(4, 0), TransferSize);
+	TEST_CHECK(ReadRequest(*h.transport).hdr.tag == 2);
+	TEST_CHECK(h.transport->Queue(Endpoint::MetaOut).empty());
+
+	// a response nobody asked for doesn't make room
+	WriteResponse(*h.transport, 3, 0, std::vector<uint8_t>(), TransferSize);
+	TEST_CHECK(h.transport->Queue(Endpoint::MetaOut).empty());
+
+	WriteResponse(*h.transport, 1, 0, std::vector<uint8_t>(), TransferSize);
+	TEST_CHECK(ReadRequest(*h.transport).hdr.tag == 3);
+}
+
+// once both ends agree to it, payloads are compressed both ways
+void TestCompression() {
+	Harness h;
+	Handshake(h, protocol::FEATURE_COMPRESSION, TransferSize, 0);
+	TEST_CHECK(h.device->features == protocol::FEATURE_COMPRESSION);
+
+	auto client = std::make_shared<TestClient>(1);
+	std::vector<uint8_t> payload(0x20000, 0);
+	h.device->SendRequest(Request(client, 1, 0, 10, 1, std::vector<uint8_t>(payload)));
+	
+	FakeTransport::Pending meta = h.transport->Queue(Endpoint::MetaOut).front();
+	protocol::MessageHeader hdr;
+	memcpy(&hdr, meta.buffer, sizeof(hdr));
+	TEST_CHECK(hdr.payload_size & protocol::PAYLOAD_COMPRESSED);
+	TEST_CHECK((hdr.payload_size & ~protocol::PAYLOAD_COMPRESSED) < payload.size());
+	TEST_CHECK(ReadRequest(*h.transport).payload == payload);
+
+	WriteResponse(*h.transport, 1, 1, payload, 0x1000, {}, true);
+	TEST_CHECK(h.responses.size() == 1);
+	TEST_CHECK(h.responses[0].payload.GetVector() == payload);
+}
+
+// a failed transfer kills the device, and whatever was waiting on it gets
+// an error once the device goes away
+void TestTransferError() {
+	Harness h;
+	Handshake(h, 0, 0x1000, 0);
+
+	auto client = std::make_shared<TestClient>(1);
+	h.device->SendRequest(MakeRequest(client, 10, 1, 0x3000));
+	h.device->SendRequest(MakeRequest(client, 10, 2));
+	
+	FakeTransport::Pending meta = h.transport->Take(Endpoint::MetaOut);
+	h.transport->Complete(meta, meta.size);
+	FakeTransport::Pending data = h.transport->Take(Endpoint::DataOut);
+	h.transport->Complete(data, 0, USBTransport::Status::Failed);
+	TEST_CHECK(h.device->deletion_flag);
+	
+	// a dead device doesn't take new requests or submit anything more
+	h.device->SendRequest(MakeRequest(client, 10, 3));
+	h.transport->FlushCancelled();
+	for(Endpoint e : {Endpoint::MetaOut, Endpoint::DataOut, Endpoint::MetaIn, Endpoint::DataIn}) {
+		TEST_CHECK(h.transport->Queue(e).empty());
+	}
+	TEST_CHECK(h.responses.empty());
+
+	h.Close();
+	TEST_CHECK(h.responses.size() == 2);
+	for(Response &r : h.responses) {
+		TEST_CHECK(r.client_id == 1);
+		TEST_CHECK(r.result_code == TWILI_ERR_PROTOCOL_TRANSFER_ERROR);
+	}
+	TEST_CHECK(h.responses[0].tag != h.responses[1].tag);
+}
+
+} // anonymous namespace
+
+int main() {
+	TestHandshake();
+	TestTagDemultiplexing();
+	TestOutstandingLimit();
+	TestCompression();
+	TestTransferError();
+	return 0;
+}
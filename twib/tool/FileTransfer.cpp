@@ -0,0 +1,146 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "FileTransfer.hpp"
+
+#include<algorithm>
+#include<condition_variable>
+#include<deque>
+#include<map>
+#include<mutex>
+#include<utility>
+#include<vector>
+
+#include "common/Logger.hpp"
+#include "common/ResultError.hpp"
+
+namespace twili {
+namespace twib {
+namespace tool {
+
+bool PullFile(ITwibFileAccessor &itfa, platform::File &dst, size_t total_size, size_t window, std::function<void(size_t)> progress) {
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::map<size_t, std::vector<uint8_t>> completed;
+	// the bridge reads as much as the filesystem gives it, which can be
+	// less than was asked for; what's left of those chunks is read again
+	std::deque<std::pair<size_t, size_t>> remainders;
+	size_t requested = 0;
+	size_t written = 0;
+	size_t outstanding = 0;
+	uint32_t error = 0;
+	bool eof = false;
+	bool write_failed = false;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while(written < total_size && !error && !eof && !write_failed) {
+		while(outstanding < std::max(window, (size_t) 1) && (!remainders.empty() || requested < total_size) && !error && !eof) {
+			size_t offset, size;
+			if(!remainders.empty()) {
+				std::tie(offset, size) = remainders.front();
+				remainders.pop_front();
+			} else {
+				offset = requested;
+				size = std::min(total_size - requested, ChunkSize);
+				requested+= size;
+			}
+			outstanding++;
+
+			lock.unlock();
+			try {
+				itfa.ReadAsync(
+					offset, size,
+					[&, offset, size](uint32_t r, std::vector<uint8_t> data) {
+						std::lock_guard<std::mutex> guard(mutex);
+						if(r) {
+							error = r;
+						} else if(data.empty()) {
+							eof = true;
+						} else {
+							if(data.size() < size) {
+								remainders.emplace_back(offset + data.size(), size - data.size());
+							} else {
+								data.resize(size);
+							}
+							completed.emplace(offset, std::move(data));
+						}
+						outstanding--;
+						cv.notify_all();
+					});
+			} catch(...) {
+				// this callback will never run, but the others still
+				// reference our locals
+				lock.lock();
+				outstanding--;
+				while(outstanding > 0) {
+					cv.wait(lock);
+				}
+				throw;
+			}
+			lock.lock();
+		}
+
+		auto i = completed.find(written);
+		if(i == completed.end()) {
+			if(!error && !eof) {
+				cv.wait(lock);
+			}
+			continue;
+		}
+
+		std::vector<uint8_t> data = std::move(i->second);
+		completed.erase(i);
+		lock.unlock();
+		bool ok = dst.Write(data.data(), data.size()) == data.size();
+		lock.lock();
+		if(!ok) {
+			write_failed = true;
+			break;
+		}
+		written+= data.size();
+		if(progress) {
+			lock.unlock();
+			progress(written);
+			lock.lock();
+		}
+	}
+	
+	// callbacks still reference our locals
+	while(outstanding > 0) {
+		cv.wait(lock);
+	}
+
+	if(error) {
+		throw ResultError(error);
+	}
+	if(eof) {
+		LogMessage(Error, "hit EoF unexpectedly at 0x%zx of 0x%zx", written, total_size);
+		return false;
+	}
+	if(write_failed) {
+		LogMessage(Error, "failed to write pulled data");
+		return false;
+	}
+	return true;
+}
+
+} // namespace tool
+} // namespace twib
+} // namespace twili
@@ -0,0 +1,47 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include<functional>
+
+#include<stddef.h>
+
+#include "platform/platform.hpp"
+
+#include "interfaces/ITwibFileAccessor.hpp"
+
+namespace twili {
+namespace twib {
+namespace tool {
+
+// matches the largest read the bridge will service in one request
+static const size_t ChunkSize = 0x40000;
+
+// Reads total_size bytes from itfa into dst, keeping up to window reads in
+// flight and writing them out in offset order as they come back. Memory use
+// is bounded by window * ChunkSize no matter how big the file is. Returns
+// false if the file ends early or dst can't be written, and throws
+// ResultError if a read fails.
+bool PullFile(ITwibFileAccessor &itfa, platform::File &dst, size_t total_size, size_t window, std::function<void(size_t)> progress = nullptr);
+
+} // namespace tool
+} // namespace twib
+} // namespace twili
@@ -20,6 +20,7 @@
 
 #include "GdbStub.hpp"
 
+#include<algorithm>
 #include<functional>
 
 #include "common/Logger.hpp"
@@ -61,6 +62,7 @@ GdbStub::~GdbStub() {
 
 void GdbStub::Run() {
 	std::unique_lock<std::mutex> lock(connection.mutex);
+	loop.AddMember(connection.in_member);
 	loop.Begin();
 	while(!connection.error_flag) {
 		connection.error_condvar.wait(lock);
@@ -225,9 +227,18 @@ void GdbStub::HandleDetach(util::Buffer &packet) {
 			current_thread = nullptr;
 		}
 		get_thread_info.valid = false;
-		attached_processes.erase(pid);
+		auto i = attached_processes.find(pid);
+		if(i != attached_processes.end()) {
+			i->second.FlushRegisters();
+			i->second.RemoveAllBreakpoints();
+			attached_processes.erase(i);
+		}
 	} else { // detach all
 		LogMessage(Debug, "detaching from all");
+		for(auto &p : attached_processes) {
+			p.second.FlushRegisters();
+			p.second.RemoveAllBreakpoints();
+		}
 		current_thread = nullptr;
 		get_thread_info.valid = false;
 		attached_processes.clear();
@@ -248,10 +259,7 @@ void GdbStub::HandleReadGeneralRegisters() {
 		ThreadContext tc = current_thread->GetRegisters();
 		GdbConnection::Encode((uint8_t*)&tc.x, 268, response);
 		GdbConnection::Encode((uint8_t*)&tc.fpr, 520, response);
-		std::string str;
-		size_t sz = response.ReadAvailable();
-		response.Read(str, sz);
-		response.MarkRead(-sz);
+		std::string str = response.GetString();
 		LogMessage(Debug, "responding with '%s'", str.c_str());
 		connection.Respond(response);
 	} catch(ResultError &e) {
@@ -290,6 +298,130 @@ void GdbStub::HandleWriteGeneralRegisters(util::Buffer &packet) {
 	}
 }
 
+void GdbStub::HandleInsertBreakpoint(util::Buffer &packet) {
+	uint64_t type, address, kind;
+	GdbConnection::DecodeWithSeparator(type, ',', packet);
+	GdbConnection::DecodeWithSeparator(address, ',', packet);
+	GdbConnection::Decode(kind, packet);
+
+	if(type != 0) { // only software breakpoints
+		connection.RespondEmpty();
+		return;
+	}
+	
+	if(!current_thread || kind != 4 || address % 4 != 0) {
+		connection.RespondError(1);
+		return;
+	}
+
+	LogMessage(Debug, "adding breakpoint at 0x%lx", address);
+	try {
+		current_thread->process.AddBreakpoint(address);
+	} catch(ResultError &e) {
+		LogMessage(Debug, "failed to add breakpoint: 0x%x", e.code);
+		connection.RespondError(e.code);
+		return;
+	}
+	connection.RespondOk();
+}
+
+void GdbStub::HandleRemoveBreakpoint(util::Buffer &packet) {
+	uint64_t type, address, kind;
+	GdbConnection::DecodeWithSeparator(type, ',', packet);
+	GdbConnection::DecodeWithSeparator(address, ',', packet);
+	GdbConnection::Decode(kind, packet);
+
+	if(type != 0) {
+		connection.RespondEmpty();
+		return;
+	}
+	
+	if(!current_thread) {
+		connection.RespondError(1);
+		return;
+	}
+
+	LogMessage(Debug, "removing breakpoint at 0x%lx", address);
+	current_thread->process.RemoveBreakpoint(address);
+	connection.RespondOk();
+}
+
+// finds register n (in gdb's aarch64 numbering) inside a ThreadContext
+static bool LocateRegister(ThreadContext &tc, uint64_t n, uint8_t *&ptr, size_t &size) {
+	if(n <= 32) { // x0-x30, sp, pc
+		ptr = (uint8_t*) &tc.x[0] + (n * 8);
+		size = 8;
+	} else if(n == 33) { // cpsr
+		ptr = (uint8_t*) &tc.psr;
+		size = 4;
+	} else if(n <= 65) { // v0-v31
+		ptr = (uint8_t*) &tc.fpr[n - 34];
+		size = 16;
+	} else if(n <= 67) { // same order as the 'g' packet
+		ptr = (uint8_t*) &tc.fpcr + ((n - 66) * 4);
+		size = 4;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+void GdbStub::HandleReadRegister(util::Buffer &packet) {
+	uint64_t n;
+	GdbConnection::Decode(n, packet);
+
+	if(current_thread == nullptr) {
+		LogMessage(Warning, "attempt to read register with no selected thread");
+		connection.RespondError(1);
+		return;
+	}
+
+	try {
+		ThreadContext tc = current_thread->GetRegisters();
+		uint8_t *ptr;
+		size_t size;
+		if(!LocateRegister(tc, n, ptr, size)) {
+			connection.RespondError(1);
+			return;
+		}
+		util::Buffer response;
+		GdbConnection::Encode(ptr, size, response);
+		connection.Respond(response);
+	} catch(ResultError &e) {
+		LogMessage(Debug, "failed to read register: 0x%x", e.code);
+		connection.RespondError(e.code);
+	}
+}
+
+void GdbStub::HandleWriteRegister(util::Buffer &packet) {
+	uint64_t n;
+	GdbConnection::DecodeWithSeparator(n, '=', packet);
+	std::vector<uint8_t> value;
+	GdbConnection::Decode(value, packet);
+
+	if(current_thread == nullptr) {
+		LogMessage(Warning, "attempt to write register with no selected thread");
+		connection.RespondError(1);
+		return;
+	}
+
+	try {
+		ThreadContext tc = current_thread->GetRegisters();
+		uint8_t *ptr;
+		size_t size;
+		if(!LocateRegister(tc, n, ptr, size) || value.size() != size) {
+			connection.RespondError(1);
+			return;
+		}
+		memcpy(ptr, value.data(), size);
+		current_thread->SetRegisters(tc);
+		connection.RespondOk();
+	} catch(ResultError &e) {
+		LogMessage(Debug, "failed to write register: 0x%x", e.code);
+		connection.RespondError(e.code);
+	}
+}
+
 void GdbStub::HandleSetCurrentThread(util::Buffer &packet) {
 	if(packet.ReadAvailable() < 2) {
 		LogMessage(Warning, "invalid thread id");
@@ -359,7 +491,7 @@ void GdbStub::HandleReadMemory(util::Buffer &packet) {
 
 	try {
 		util::Buffer response;
-		std::vector<uint8_t> mem = current_thread->process.debugger.ReadMemory(address, size);
+		std::vector<uint8_t> mem = current_thread->process.ReadMemory(address, size, memory_readahead);
 		GdbConnection::Encode(mem.data(), mem.size(), response);
 		connection.Respond(response);
 	} catch(ResultError &e) {
@@ -392,7 +524,7 @@ void GdbStub::HandleWriteMemory(util::Buffer &packet) {
 	
 	try {
 		util::Buffer response;
-		current_thread->process.debugger.WriteMemory(address, bytes);
+		current_thread->process.WriteMemory(address, bytes);
 		connection.RespondOk();
 	} catch(ResultError &e) {
 		connection.RespondError(e.code);
@@ -439,7 +571,7 @@ void GdbStub::HandleVAttach(util::Buffer &packet) {
 
 void GdbStub::HandleVContQuery(util::Buffer &packet) {
 	util::Buffer response;
-	response.Write(std::string("vCont;c;C"));
+	response.Write(std::string("vCont;c;C;s;S"));
 	connection.Respond(response);
 }
 
@@ -586,20 +718,8 @@ void GdbStub::HandleVFile(util::Buffer &packet) {
             util::Buffer response;
             fake_mappings_buffer.clear();
 
-            uint64_t query_addr = 0;
-            const uint64_t max_query_count = 10000;
             char line_buf[0x100];
-            for (int i = 0; i < max_query_count; i++) {
-                std::tuple<nx::MemoryInfo, nx::PageInfo> ans = p.debugger.QueryMemory(query_addr);
-                nx::MemoryInfo &m_info = std::get<0>(ans);
-                query_addr = m_info.base_addr + m_info.size;
-                if (m_info.memory_type == nx::MemoryType::MemType_Unmapped) {
-                    continue;
-                }
-                if (m_info.memory_type == nx::MemoryType::MemType_Reserved) {
-                    break;
-                }
-
+            for (const nx::MemoryInfo &m_info : p.GetMemoryMap()) {
                 uint64_t start_addr = m_info.base_addr;
                 uint64_t end_addr = m_info.base_addr + m_info.size;
                 uint64_t perm = m_info.permission;
@@ -765,7 +885,8 @@ void GdbStub::HandleVCont(util::Buffer &packet) {
 	struct Action {
 		enum class Type {
 			Invalid,
-			Continue
+			Continue,
+			Step
 		} type = Type::Invalid;
 	};
 
@@ -788,6 +909,12 @@ void GdbStub::HandleVCont(util::Buffer &packet) {
 			case 'c':
 				action.type = Action::Type::Continue;
 				break;
+			case 'S':
+				LogMessage(Warning, "vCont 'S' action not well supported");
+				// fall-through
+			case 's':
+				action.type = Action::Type::Step;
+				break;
 			default:
 				LogMessage(Warning, "unsupported vCont action: %c", ch);
 			}
@@ -855,6 +982,7 @@ void GdbStub::HandleVCont(util::Buffer &packet) {
 		}
 
 		proc.running_thread_ids.clear();
+		std::vector<uint64_t> step_thread_ids;
 		for(auto &t : p.second) {
 			auto t_i = proc.threads.find(t.first);
 			if(t_i == proc.threads.end()) {
@@ -862,12 +990,21 @@ void GdbStub::HandleVCont(util::Buffer &packet) {
 				continue;
 			}
 			proc.running_thread_ids.push_back(t.first);
+			if(t.second.type == Action::Type::Step) {
+				step_thread_ids.push_back(t.first);
+			}
 		}
 		LogMessage(Debug, "continuing process");
 		for(auto &t : proc.running_thread_ids) {
 			LogMessage(Debug, "  tid 0x%lx", t);
 		}
-		proc.debugger.ContinueDebugEvent(7, proc.running_thread_ids);
+		try {
+			proc.ContinueDebugEvent(7, proc.running_thread_ids, step_thread_ids);
+		} catch(ResultError &e) {
+			LogMessage(Warning, "caught 0x%x continuing process", e.code);
+			connection.RespondError(e.code);
+			return;
+		}
 		proc.running = true;
 	}
 	waiting_for_stop = true;
@@ -919,6 +1056,9 @@ void GdbStub::QueryGetCurrentThread(util::Buffer &packet) {
 }
 
 void GdbStub::QueryGetFThreadInfo(util::Buffer &packet) {
+	for(auto &p : attached_processes) {
+		p.second.RefreshThreads();
+	}
 	get_thread_info.process_iterator = attached_processes.begin();
 	get_thread_info.thread_iterator = get_thread_info.process_iterator->second.threads.begin();
 	get_thread_info.valid = true;
@@ -985,32 +1125,8 @@ void GdbStub::QueryGetThreadExtraInfo(util::Buffer &packet) {
 
 	Thread &t = j->second;
 
-	std::string extra_info;
-
-	try {
-		std::vector<uint8_t> tls_ctx_ptr_u8 = p.debugger.ReadMemory(t.tls_addr + 0x1f8, 8);
-		uint64_t tls_ctx_addr = *(uint64_t*) tls_ctx_ptr_u8.data();
-		std::vector<uint8_t> name_ptr_u8 = p.debugger.ReadMemory(tls_ctx_addr + 0x1a8, 8);
-		uint64_t name_addr = *(uint64_t*) name_ptr_u8.data();
-	
-		if(name_addr != 0) {
-			std::vector<uint8_t> name = p.debugger.ReadMemory(name_addr, 0x40);
-			for(size_t i = 0; i < name.size(); i++) {
-				if(name[i] == 0) {
-					break;
-				}
-				extra_info.push_back(name[i]);
-				if(i == name.size()-1) {
-					name_addr+= name.size();
-					name = p.debugger.ReadMemory(name_addr, 0x40);
-					i = 0;
-				}
-			}
-			extra_info = (char*) name.data();
-		}
-	} catch(ResultError &e) {
-		LogMessage(Warning, "caught 0x%x reading thread name", e.code);
-	}
+	p.ResolveThreadNames();
+	std::string extra_info = t.name.value_or("");
 
 	if(extra_info.empty()) {
 		extra_info = "?";
@@ -1187,7 +1303,7 @@ bool GdbStub::Process::IngestEvents(GdbStub &stub) {
 	util::Buffer stop_info;
 	bool stopped = false;
 	
-	while(!stopped && (event = debugger.GetDebugEvent())) {
+	while(!stopped && (event = NextDebugEvent())) {
 		LogMessage(Debug, "got event: %d", event->event_type);
 
 		running = false;
@@ -1213,6 +1329,7 @@ bool GdbStub::Process::IngestEvents(GdbStub &stub) {
 			break; }
 		case nx::DebugEvent::EventType::ExitProcess: {
 			LogMessage(Warning, "process exited");
+			stepping_thread_ids.clear();
 			style = 'W';
 			signal = 0;
 			stopped = true;
@@ -1231,6 +1348,11 @@ bool GdbStub::Process::IngestEvents(GdbStub &stub) {
 						running_thread_ids.begin(),
 						running_thread_ids.end(),
 						thread_id), running_thread_ids.end());
+				stepping_thread_ids.erase(
+					std::remove(
+						stepping_thread_ids.begin(),
+						stepping_thread_ids.end(),
+						thread_id), stepping_thread_ids.end());
 				stub.get_thread_info.valid = false;
 			} else {
 				LogMessage(Warning, "  no such thread 0x%x", thread_id);
@@ -1245,6 +1367,7 @@ bool GdbStub::Process::IngestEvents(GdbStub &stub) {
 		case nx::DebugEvent::EventType::Exception: {
 			LogMessage(Warning, "hit exception");
 			stopped = true;
+			stepping_thread_ids.clear(); // twili takes the step breakpoints out
 			switch(event->exception.exception_type) {
 			case nx::DebugEvent::ExceptionType::Trap:
 				LogMessage(Warning, "trap");
@@ -1320,6 +1443,8 @@ bool GdbStub::Process::IngestEvents(GdbStub &stub) {
 		}
 		stub.stop_reason = stop_reason.GetString();
 		LogMessage(Debug, "set stop reason: \"%s\"", stub.stop_reason.c_str());
+
+		threads_stale = style != 'W';
 	}
 
 	if(!stub.has_async_wait) {
@@ -1340,13 +1465,201 @@ bool GdbStub::Process::IngestEvents(GdbStub &stub) {
 
 	if(was_running && !running && !stopped) { // if we're not running but we should be...
 		LogMessage(Debug, "got debug events but didn't stop, so continuing...");
-		debugger.ContinueDebugEvent(7, running_thread_ids);
+		ContinueDebugEvent(7, running_thread_ids);
 		running = true;
 	}
 	
 	return stopped;
 }
 
+void GdbStub::Process::RefreshThreads() {
+	if(!threads_stale || running) {
+		return;
+	}
+	threads_stale = false;
+	
+	std::vector<std::tuple<uint64_t, std::optional<ThreadContext>>> list;
+	try {
+		list = debugger.ListThreads(true);
+	} catch(ResultError &e) {
+		// older twili doesn't implement this; contexts get fetched one at a time
+		LogMessage(Debug, "caught 0x%x listing threads", e.code);
+		return;
+	}
+
+	for(auto &entry : list) {
+		uint64_t thread_id = std::get<0>(entry);
+		auto i = threads.find(thread_id);
+		if(i == threads.end()) {
+			LogMessage(Debug, "  found unseen thread: 0x%x", thread_id);
+			i = threads.emplace(thread_id, Thread(*this, thread_id, 0)).first;
+		}
+		if(!i->second.context_dirty) {
+			i->second.context = std::get<1>(entry);
+		}
+	}
+}
+
+void GdbStub::Process::ResolveThreadNames() {
+	std::vector<Thread*> pending;
+	for(auto &t : threads) {
+		if(t.second.name) {
+			continue;
+		}
+		if(t.second.tls_addr == 0) {
+			t.second.name = ""; // didn't see this one attach, so no way to find it
+			continue;
+		}
+		pending.push_back(&t.second);
+	}
+	if(pending.empty()) {
+		return;
+	}
+
+	// reads size bytes at each nonzero address, all in one request
+	auto read_all = [this](const std::vector<uint64_t> &addresses, uint64_t size) {
+		std::vector<std::tuple<uint64_t, uint64_t>> ranges;
+		std::vector<size_t> indices;
+		for(size_t i = 0; i < addresses.size(); i++) {
+			if(addresses[i] != 0) {
+				ranges.emplace_back(addresses[i], size);
+				indices.push_back(i);
+			}
+		}
+		std::vector<std::vector<uint8_t>> results(addresses.size());
+		if(!ranges.empty()) {
+			std::vector<std::tuple<uint32_t, std::vector<uint8_t>>> fetched = debugger.ReadMemoryMulti(ranges);
+			for(size_t i = 0; i < fetched.size(); i++) {
+				if(std::get<0>(fetched[i]) == 0) {
+					results[indices[i]] = std::move(std::get<1>(fetched[i]));
+				}
+			}
+		}
+		return results;
+	};
+	auto follow = [&read_all](const std::vector<uint64_t> &addresses) {
+		std::vector<std::vector<uint8_t>> pointers = read_all(addresses, sizeof(uint64_t));
+		std::vector<uint64_t> targets(addresses.size(), 0);
+		for(size_t i = 0; i < pointers.size(); i++) {
+			if(pointers[i].size() == sizeof(uint64_t)) {
+				targets[i] = *(uint64_t*) pointers[i].data();
+			}
+		}
+		return targets;
+	};
+
+	// tls -> thread context -> name, one request per step for all threads
+	try {
+		std::vector<uint64_t> addresses;
+		for(Thread *t : pending) {
+			addresses.push_back(t->tls_addr + 0x1f8);
+		}
+		std::vector<uint64_t> contexts = follow(addresses);
+		for(size_t i = 0; i < pending.size(); i++) {
+			addresses[i] = contexts[i] ? contexts[i] + 0x1a8 : 0;
+		}
+		std::vector<uint64_t> name_addresses = follow(addresses);
+		std::vector<std::vector<uint8_t>> names = read_all(name_addresses, 0x40);
+
+		for(size_t i = 0; i < pending.size(); i++) {
+			if(contexts[i] == 0) {
+				continue; // thread hasn't finished starting up; try again later
+			}
+			std::vector<uint8_t> &name = names[i];
+			pending[i]->name = std::string(name.begin(), std::find(name.begin(), name.end(), 0));
+		}
+	} catch(ResultError &e) {
+		LogMessage(Warning, "caught 0x%x reading thread names", e.code);
+	}
+}
+
+void GdbStub::Process::AddBreakpoint(uint64_t addr) {
+	auto i = breakpoints.find(addr);
+	if(i != breakpoints.end()) {
+		i->second.wanted = true;
+		return;
+	}
+
+	// read what's underneath now, so gdb hears about bad addresses
+	Breakpoint bp;
+	bp.original = FetchMemory(addr, sizeof(BreakpointInstruction), 0);
+	breakpoints.emplace(addr, std::move(bp));
+}
+
+void GdbStub::Process::RemoveBreakpoint(uint64_t addr) {
+	auto i = breakpoints.find(addr);
+	if(i == breakpoints.end()) {
+		return;
+	}
+	if(i->second.inserted) {
+		i->second.wanted = false; // taken out when the process resumes
+	} else {
+		breakpoints.erase(i);
+	}
+}
+
+void GdbStub::Process::SyncBreakpoints() {
+	// patch in every new breakpoint and restore every removed one in one request
+	const uint8_t *brk = (const uint8_t*) &BreakpointInstruction;
+	std::vector<std::tuple<uint64_t, std::vector<uint8_t>>> writes;
+	for(auto &bp : breakpoints) {
+		if(bp.second.wanted && !bp.second.inserted) {
+			writes.emplace_back(bp.first, std::vector<uint8_t>(brk, brk + sizeof(BreakpointInstruction)));
+		} else if(!bp.second.wanted && bp.second.inserted) {
+			writes.emplace_back(bp.first, bp.second.original);
+		}
+	}
+	std::vector<uint32_t> results;
+	if(!writes.empty()) {
+		results = debugger.WriteMemoryMulti(writes);
+	}
+
+	for(size_t i = 0; i < writes.size(); i++) {
+		uint64_t addr = std::get<0>(writes[i]);
+		Breakpoint &bp = breakpoints[addr];
+		if(results[i] != 0) {
+			LogMessage(Warning, "caught 0x%x %s breakpoint at 0x%lx", results[i], bp.wanted ? "inserting" : "removing", addr);
+			continue;
+		}
+		bp.inserted = bp.wanted;
+	}
+
+	// breakpoints that couldn't be taken out stay, so they're tried again
+	for(auto i = breakpoints.begin(); i != breakpoints.end(); ) {
+		if(i->second.wanted || i->second.inserted) {
+			i++;
+		} else {
+			i = breakpoints.erase(i);
+		}
+	}
+}
+
+void GdbStub::Process::RemoveAllBreakpoints() {
+	for(auto &bp : breakpoints) {
+		bp.second.wanted = false;
+	}
+	SyncBreakpoints();
+}
+
+void GdbStub::Process::FlushRegisters() {
+	for(auto &t : threads) {
+		t.second.FlushRegisters();
+	}
+}
+
+std::optional<nx::DebugEvent> GdbStub::Process::NextDebugEvent() {
+	if(pending_events.empty()) {
+		std::vector<nx::DebugEvent> events = debugger.GetDebugEvents();
+		pending_events.insert(pending_events.end(), events.begin(), events.end());
+	}
+	if(pending_events.empty()) {
+		return std::nullopt;
+	}
+	nx::DebugEvent event = pending_events.front();
+	pending_events.pop_front();
+	return event;
+}
+
 std::string GdbStub::Process::BuildLibraryList() {
 	std::stringstream ss;
 	ss << "<library-list>" << std::endl;
@@ -1400,15 +1713,199 @@ std::string GdbStub::Process::BuildLibraryList() {
 	return ss.str();
 }
 
+std::vector<uint8_t> GdbStub::Process::ReadMemory(uint64_t addr, uint64_t size, uint64_t readahead) {
+	std::vector<uint8_t> bytes = FetchMemory(addr, size, readahead);
+
+	// hide our breakpoints from gdb
+	for(auto i = breakpoints.lower_bound(addr > 3 ? addr - 3 : 0); i != breakpoints.end() && i->first < addr + bytes.size(); i++) {
+		if(!i->second.inserted) {
+			continue;
+		}
+		for(size_t j = 0; j < i->second.original.size(); j++) {
+			uint64_t byte_addr = i->first + j;
+			if(byte_addr >= addr && byte_addr < addr + bytes.size()) {
+				bytes[byte_addr - addr] = i->second.original[j];
+			}
+		}
+	}
+
+	return bytes;
+}
+
+std::vector<uint8_t> GdbStub::Process::FetchMemory(uint64_t addr, uint64_t size, uint64_t readahead) {
+	if(running || size == 0) {
+		return debugger.ReadMemory(addr, size);
+	}
+
+	uint64_t first_page = addr & ~(PageSize - 1);
+	uint64_t end_page = (addr + size + PageSize - 1) & ~(PageSize - 1);
+	uint64_t readahead_end = (addr + size + readahead + PageSize - 1) & ~(PageSize - 1);
+	if((end_page - first_page) / PageSize > MaxCachedPages) {
+		return debugger.ReadMemory(addr, size);
+	}
+
+	// collect every run of missing pages, plus the read-ahead window as its
+	// own range so that running off the end of a mapping doesn't fail the
+	// pages that were actually asked for, and fetch them all in one request
+	std::vector<std::tuple<uint64_t, uint64_t>> ranges;
+	for(uint64_t page = first_page; page < readahead_end; page+= PageSize) {
+		if(memory_cache.find(page) != memory_cache.end()) {
+			continue;
+		}
+		uint64_t run_end = page < end_page ? end_page : readahead_end;
+		auto next_cached = memory_cache.lower_bound(page);
+		if(next_cached != memory_cache.end() && next_cached->first < run_end) {
+			run_end = next_cached->first;
+		}
+		ranges.emplace_back(page, run_end - page);
+		page = run_end - PageSize;
+	}
+
+	if(!ranges.empty()) {
+		std::vector<std::tuple<uint32_t, std::vector<uint8_t>>> fetched = debugger.ReadMemoryMulti(ranges);
+		for(size_t i = 0; i < ranges.size(); i++) {
+			uint32_t code = std::get<0>(fetched[i]);
+			if(code != 0 && std::get<0>(ranges[i]) < end_page) {
+				throw ResultError(code);
+			}
+		}
+
+		if(memory_cache.size() + (readahead_end - first_page) / PageSize > MaxCachedPages) {
+			memory_cache.clear();
+		}
+
+		for(size_t i = 0; i < ranges.size(); i++) {
+			uint64_t base = std::get<0>(ranges[i]);
+			std::vector<uint8_t> &bytes = std::get<1>(fetched[i]);
+			for(uint64_t offset = 0; offset + PageSize <= bytes.size(); offset+= PageSize) {
+				memory_cache.emplace(
+					base + offset,
+					std::vector<uint8_t>(bytes.begin() + offset, bytes.begin() + offset + PageSize));
+			}
+		}
+	}
+
+	std::vector<uint8_t> bytes;
+	bytes.reserve(size);
+	for(uint64_t page = first_page; page < end_page; page+= PageSize) {
+		auto i = memory_cache.find(page);
+		if(i == memory_cache.end()) {
+			// evicted to make room for this read
+			return debugger.ReadMemory(addr, size);
+		}
+		uint64_t begin = std::max(addr, page) - page;
+		uint64_t end = std::min(addr + size, page + PageSize) - page;
+		bytes.insert(bytes.end(), i->second.begin() + begin, i->second.begin() + end);
+	}
+	
+	return bytes;
+}
+
+void GdbStub::Process::WriteMemory(uint64_t addr, std::vector<uint8_t> &bytes) {
+	// if gdb writes over one of our breakpoints, keep the breakpoint and
+	// remember what it wrote as the new original instruction
+	for(auto i = breakpoints.lower_bound(addr > 3 ? addr - 3 : 0); i != breakpoints.end() && i->first < addr + bytes.size(); i++) {
+		const uint8_t *brk = (const uint8_t*) &BreakpointInstruction;
+		for(size_t j = 0; j < i->second.original.size(); j++) {
+			uint64_t byte_addr = i->first + j;
+			if(byte_addr >= addr && byte_addr < addr + bytes.size()) {
+				i->second.original[j] = bytes[byte_addr - addr];
+				if(i->second.inserted) {
+					bytes[byte_addr - addr] = brk[j];
+				}
+			}
+		}
+	}
+	
+	uint64_t first_page = addr & ~(PageSize - 1);
+	memory_cache.erase(
+		memory_cache.lower_bound(first_page),
+		memory_cache.lower_bound(addr + bytes.size()));
+	debugger.WriteMemory(addr, bytes);
+}
+
+void GdbStub::Process::ContinueDebugEvent(uint32_t flags, std::vector<uint64_t> &thread_ids, const std::vector<uint64_t> &step_thread_ids) {
+	InvalidateMemoryCache();
+	FlushRegisters();
+	SyncBreakpoints();
+	for(uint64_t thread_id : step_thread_ids) {
+		debugger.StepThread(thread_id);
+		if(std::find(stepping_thread_ids.begin(), stepping_thread_ids.end(), thread_id) == stepping_thread_ids.end()) {
+			stepping_thread_ids.push_back(thread_id);
+		}
+	}
+	for(auto &t : threads) {
+		t.second.context.reset();
+	}
+	threads_stale = false;
+	if(stepping_thread_ids.empty()) {
+		debugger.ContinueDebugEvent(flags, thread_ids);
+	} else {
+		// any thread could run into the step breakpoints, so only the
+		// stepping threads run until the step is over
+		debugger.ContinueDebugEvent(flags & ~ContinueAllFlag, stepping_thread_ids);
+	}
+}
+
+void GdbStub::Process::InvalidateMemoryCache() {
+	memory_cache.clear();
+	memory_map.reset(); // mappings can only change while the process runs
+}
+
+const std::vector<nx::MemoryInfo> &GdbStub::Process::GetMemoryMap() {
+	if(memory_map && !running) {
+		return *memory_map;
+	}
+	
+	memory_map.emplace();
+	for(auto &region : debugger.QueryMemoryMap()) {
+		nx::MemoryInfo &info = std::get<0>(region);
+		if(info.memory_type == nx::MemoryType::MemType_Reserved) {
+			break;
+		}
+		if(info.memory_type != nx::MemoryType::MemType_Unmapped) {
+			memory_map->push_back(info);
+		}
+	}
+	
+	return *memory_map;
+}
+
 GdbStub::Thread::Thread(Process &process, uint64_t thread_id, uint64_t tls_addr) : process(process), thread_id(thread_id), tls_addr(tls_addr) {
 }
 
 ThreadContext GdbStub::Thread::GetRegisters() {
-	return process.debugger.GetThreadContext(thread_id);
+	if(process.running) {
+		return process.debugger.GetThreadContext(thread_id);
+	}
+	if(!context) {
+		process.RefreshThreads();
+	}
+	if(!context) {
+		context = process.debugger.GetThreadContext(thread_id);
+	}
+	return *context;
 }
 
 void GdbStub::Thread::SetRegisters(const ThreadContext &registers) {
-	return process.debugger.SetThreadContext(thread_id, registers);
+	if(process.running) {
+		process.debugger.SetThreadContext(thread_id, registers);
+		return;
+	}
+	context = registers;
+	context_dirty = true;
+}
+
+void GdbStub::Thread::FlushRegisters() {
+	if(!context_dirty) {
+		return;
+	}
+	context_dirty = false;
+	try {
+		process.debugger.SetThreadContext(thread_id, *context);
+	} catch(ResultError &e) {
+		LogMessage(Warning, "caught 0x%x writing back registers for thread 0x%lx", e.code, thread_id);
+	}
 }
 
 GdbStub::Process::Process(uint64_t pid, ITwibDebugger debugger) : pid(pid), debugger(debugger) {
@@ -1419,7 +1916,6 @@ GdbStub::Logic::Logic(GdbStub &stub) : stub(stub) {
 }
 
 void GdbStub::Logic::Prepare(platform::EventLoop &loop) {
-	loop.Clear();
 	util::Buffer *buffer;
 	bool interrupted;
 	while((buffer = stub.connection.Process(interrupted)) != nullptr) {
@@ -1450,12 +1946,24 @@ void GdbStub::Logic::Prepare(platform::EventLoop &loop) {
 		case 'H': // set current thread
 			stub.HandleSetCurrentThread(*buffer);
 			break;
+		case 'p': // read register
+			stub.HandleReadRegister(*buffer);
+			break;
+		case 'P': // write register
+			stub.HandleWriteRegister(*buffer);
+			break;
 		case 'm': // read memory
 			stub.HandleReadMemory(*buffer);
 			break;
 		case 'M': // write memory
 			stub.HandleWriteMemory(*buffer);
 			break;
+		case 'Z': // insert breakpoint
+			stub.HandleInsertBreakpoint(*buffer);
+			break;
+		case 'z': // remove breakpoint
+			stub.HandleRemoveBreakpoint(*buffer);
+			break;
 		case 'q': // general get query
 			stub.HandleGeneralGetQuery(*buffer);
 			break;
@@ -1488,8 +1996,6 @@ void GdbStub::Logic::Prepare(platform::EventLoop &loop) {
 			}
 		}
 	}
-	
-	loop.AddMember(stub.connection.in_member);
 }
 
 bool GdbStub::XferObject::AdvertiseRead() {
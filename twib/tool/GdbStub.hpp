@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include<deque>
+#include<map>
 #include<optional>
 #include<unordered_map>
 
@@ -88,24 +90,80 @@ class GdbStub {
 	class Thread {
 	 public:
 		Thread(Process &process, uint64_t thread_id, uint64_t tls_addr);
+		// while the process is stopped, registers are read once and written
+		// back only when it resumes
 		ThreadContext GetRegisters();
 		void SetRegisters(const ThreadContext &regs);
+		void FlushRegisters();
 		Process &process;
 		uint64_t thread_id = 0;
 		uint64_t tls_addr = 0;
+		std::optional<ThreadContext> context;
+		bool context_dirty = false;
+		std::optional<std::string> name; // resolved once, by Process::ResolveThreadNames
 	};
 
 	class Process {
 	 public:
 		Process(uint64_t pid, ITwibDebugger debugger);
 		bool IngestEvents(GdbStub &stub); // returns whether process is stopped
+		// after a stop, picks up threads we didn't see attach and fetches every
+		// thread's context in one request. does nothing until the next stop.
+		void RefreshThreads();
+		void FlushRegisters();
+		// looks up the names of every thread that doesn't have one yet
+		void ResolveThreadNames();
+
+		// software breakpoints requested with Z0. they stay in memory while the
+		// process is stopped, hidden from memory reads, and are only inserted or
+		// removed when it resumes. AddBreakpoint reads the original instruction
+		// right away, and throws if it can't.
+		void AddBreakpoint(uint64_t addr);
+		void RemoveBreakpoint(uint64_t addr);
+		void SyncBreakpoints();
+		void RemoveAllBreakpoints();
 		std::string BuildLibraryList();
+
+		// reads through a page-granular cache while the process is stopped,
+		// fetching up to readahead extra bytes past each miss
+		std::vector<uint8_t> ReadMemory(uint64_t addr, uint64_t size, uint64_t readahead);
+		void WriteMemory(uint64_t addr, std::vector<uint8_t> &bytes);
+		// flushes registers and breakpoints, arms single steps, and continues
+		void ContinueDebugEvent(uint32_t flags, std::vector<uint64_t> &thread_ids, const std::vector<uint64_t> &step_thread_ids = {});
+		void InvalidateMemoryCache();
+		// mapped regions, queried once per stop
+		const std::vector<nx::MemoryInfo> &GetMemoryMap();
+		
 		uint64_t pid;
 		ITwibDebugger debugger;
 		std::map<uint64_t, Thread> threads;
 		std::vector<uint64_t> running_thread_ids;
 		std::shared_ptr<bool> has_events;
 		bool running = false;
+		bool threads_stale = false;
+	 private:
+		// events fetched from the device but not yet ingested, because an
+		// earlier event in the same batch stopped the process
+		std::deque<nx::DebugEvent> pending_events;
+		std::optional<nx::DebugEvent> NextDebugEvent();
+		std::vector<uint8_t> FetchMemory(uint64_t addr, uint64_t size, uint64_t readahead);
+		static const uint64_t PageSize = 0x1000;
+		static const size_t MaxCachedPages = 1024;
+		std::map<uint64_t, std::vector<uint8_t>> memory_cache;
+		std::optional<std::vector<nx::MemoryInfo>> memory_map;
+		
+		static const uint32_t ContinueAllFlag = 4;
+		// threads with step breakpoints armed for them on the device. these
+		// stay in until the next exception.
+		std::vector<uint64_t> stepping_thread_ids;
+		
+		struct Breakpoint {
+			bool wanted = true;
+			bool inserted = false;
+			std::vector<uint8_t> original;
+		};
+		static const uint32_t BreakpointInstruction = 0xd4200000; // brk #0
+		std::map<uint64_t, Breakpoint> breakpoints;
 	};
 	
 	Thread *current_thread = nullptr;
@@ -121,6 +179,7 @@ class GdbStub {
 	bool waiting_for_stop = false;
 	bool has_async_wait = false;
 	bool multiprocess_enabled = false;
+	uint64_t memory_readahead = 0x4000;
 
 	void Stop();
 	
@@ -160,9 +219,13 @@ class GdbStub {
 	void HandleDetach(util::Buffer &packet);
 	void HandleReadGeneralRegisters();
 	void HandleWriteGeneralRegisters(util::Buffer &packet);
+	void HandleReadRegister(util::Buffer &packet);
+	void HandleWriteRegister(util::Buffer &packet);
 	void HandleSetCurrentThread(util::Buffer &packet);
 	void HandleReadMemory(util::Buffer &packet);
 	void HandleWriteMemory(util::Buffer &packet);
+	void HandleInsertBreakpoint(util::Buffer &packet);
+	void HandleRemoveBreakpoint(util::Buffer &packet);
 	
 	// multiletter packets
 	void HandleVAttach(util::Buffer &packet);
@@ -32,6 +32,8 @@ NamedPipeClient::NamedPipeClient(platform::windows::Pipe &&pipe) :
 	pipe_logic(*this),
 	event_loop(pipe_logic),
 	connection(std::move(pipe), event_loop.GetNotifier()) {
+	event_loop.AddMember(connection.input_member);
+	event_loop.AddMember(connection.output_member);
 	event_loop.Begin();
 }
 
@@ -57,15 +59,13 @@ NamedPipeClient::Logic::Logic(NamedPipeClient &client) : client(client) {
 }
 
 void NamedPipeClient::Logic::Prepare(platform::EventLoop &loop) {
-	loop.Clear();
 	common::MessageConnection::Request *rq;
 	while((rq = client.connection.Process()) != nullptr) {
 		client.PostResponse(rq->mh, rq->payload, rq->object_ids);
 	}
-	if(!client.connection.error_flag) {
-		loop.AddMember(client.connection.input_member);
-		loop.AddMember(client.connection.output_member);
-	} else {
+	if(client.connection.error_flag) {
+		loop.RemoveMember(client.connection.input_member);
+		loop.RemoveMember(client.connection.output_member);
 		client.FailAllRequests(TWILI_ERR_IO_ERROR);
 	}
 }
@@ -28,6 +28,7 @@ namespace tool {
 namespace client {
 
 SocketClient::SocketClient(platform::Socket &&socket) : server_logic(*this), event_loop(server_logic), connection(std::move(socket), event_loop.GetNotifier()) {
+	event_loop.AddMember(connection.member);
 	event_loop.Begin();
 }
 
@@ -53,14 +54,12 @@ SocketClient::Logic::Logic(SocketClient &client) : client(client) {
 }
 
 void SocketClient::Logic::Prepare(platform::EventLoop &loop) {
-	loop.Clear();
 	common::MessageConnection::Request *rq;
 	while((rq = client.connection.Process()) != nullptr) {
 		client.PostResponse(rq->mh, rq->payload, rq->object_ids);
 	}
-	if(!client.connection.error_flag) {
-		loop.AddMember(client.connection.member);
-	} else {
+	if(client.connection.error_flag) {
+		loop.RemoveMember(client.connection.member);
 		client.FailAllRequests(TWILI_ERR_IO_ERROR);
 	}
 }
@@ -22,6 +22,12 @@
 
 #include<iomanip>
 #include<array>
+#include<map>
+#include<mutex>
+#include<condition_variable>
+#include<thread>
+#include<chrono>
+#include<exception>
 
 #include<string.h>
 #include<inttypes.h>
@@ -37,6 +43,7 @@
 #include "platform/InputPump.hpp"
 
 #include "Protocol.hpp"
+#include "FileTransfer.hpp"
 #include "interfaces/ITwibMetaInterface.hpp"
 #include "interfaces/ITwibDeviceInterface.hpp"
 
@@ -145,10 +152,14 @@ class FSCommands {
 		pull = subcommand->add_subcommand("pull", "Pulls files from device filesystem to host filesystem");
 		pull->add_option("from", pull_from, "Path(s) to pull from (on device)")->expected(-1);
 		pull->add_option("to", pull_to, "Path to write to (on host)");
+		pull->add_option("-w,--window", window, "Number of outstanding requests per file (default 8)");
+		pull->add_option("-j,--jobs", jobs, "Number of files to transfer concurrently (default 4)");
 
 		push = subcommand->add_subcommand("push", "Pushes files from host filesystem to device filesystem");
 		push->add_option("from", push_from, "Path(s) to read from (on host)")->expected(-1);
 		push->add_option("to", push_to, "Path to write to (on device)");
+		push->add_option("-w,--window", window, "Number of outstanding requests per file (default 8)");
+		push->add_option("-j,--jobs", jobs, "Number of files to transfer concurrently (default 4)");
 
 		ls = subcommand->add_subcommand("ls", "Lists files on device filesystem");
 		ls->add_flag("-l", ls_details, "Show more details");
@@ -218,39 +229,36 @@ class FSCommands {
 
 		tool::ITwibFilesystemAccessor itfsa = itdi.OpenFilesystemAccessor(fsname);
 		
-		for(std::string &src : pull_from) {
-			tool::ITwibFileAccessor itfa = itfsa.OpenFile(1, "/" + src);
+		return RunJobs(
+			pull_from.size(), pull_to == "-" ? 1 : jobs,
+			[&](size_t i) -> size_t {
+				std::string &src = pull_from[i];
+				tool::ITwibFileAccessor itfa = itfsa.OpenFile(1, "/" + src);
 			
-			std::string dst_path;
-			platform::File dst;
-			if(pull_to == "-") {
-				dst_path = "<stdout>";
-				dst = platform::File::BorrowStdout();
-			} else {
-				if(is_target_directory) {
-					dst_path = pull_to + src;
+				std::string dst_path;
+				platform::File dst;
+				if(pull_to == "-") {
+					dst_path = "<stdout>";
+					dst = platform::File::BorrowStdout();
 				} else {
-					dst_path = pull_to;
+					if(is_target_directory) {
+						dst_path = pull_to + src;
+					} else {
+						dst_path = pull_to;
+					}
+					dst = platform::File::OpenForClobberingWrite(dst_path.c_str());
 				}
-				dst = platform::File::OpenForClobberingWrite(dst_path.c_str());
-			}
 
-			size_t total_size = itfa.GetSize();
-			size_t offset = 0;
-			while(offset < total_size) {
-				std::vector<uint8_t> data = itfa.Read(offset, total_size - offset);
-				if(data.size() == 0 || dst.Write(data.data(), data.size()) < data.size()) {
-					LogMessage(Error, "hit EoF/IO error unexpectedly?");
-					return 1;
+				size_t total_size = itfa.GetSize();
+				if(!PullFile(itfa, dst, total_size, window)) {
+					return SIZE_MAX;
 				}
-				offset+= data.size();
-			}
 
-			if(pull_to != "-") {
-				fprintf(stderr, "%s -> %s\n", src.c_str(), dst_path.c_str());
-			}
-		}
-		return 0;
+				if(pull_to != "-") {
+					fprintf(stderr, "%s -> %s\n", src.c_str(), dst_path.c_str());
+				}
+				return total_size;
+			});
 	}
 
 	int DoPush(tool::ITwibDeviceInterface &itdi) {
@@ -284,43 +292,35 @@ class FSCommands {
 			}
 		}
 		
-		for(std::string &src_path : push_from) {
-			std::string dst_path;
-			platform::File src = platform::File::OpenForRead(src_path.c_str());
+		return RunJobs(
+			push_from.size(), jobs,
+			[&](size_t i) -> size_t {
+				std::string &src_path = push_from[i];
+				std::string dst_path;
+				platform::File src = platform::File::OpenForRead(src_path.c_str());
 			
-			if(is_target_directory) {
-				dst_path = push_to + platform::fs::BaseName(src_path.c_str()); // lmao super dangerous don't ever do this
-			} else {
-				dst_path = push_to;
-			}
+				if(is_target_directory) {
+					dst_path = push_to + platform::fs::BaseName(src_path.c_str()); // lmao super dangerous don't ever do this
+				} else {
+					dst_path = push_to;
+				}
 
-			size_t total_size = src.GetSize();
+				size_t total_size = src.GetSize();
 
-			LogMessage(Debug, "creating %s", dst_path.c_str());
-			itfsa.CreateFile(0, total_size, dst_path);
-			LogMessage(Debug, "opening %s", dst_path.c_str());
-			tool::ITwibFileAccessor itfa = itfsa.OpenFile(6, dst_path);
-			LogMessage(Debug, "setting size");
-			itfa.SetSize(total_size);
+				LogMessage(Debug, "creating %s", dst_path.c_str());
+				itfsa.CreateFile(0, total_size, dst_path);
+				LogMessage(Debug, "opening %s", dst_path.c_str());
+				tool::ITwibFileAccessor itfa = itfsa.OpenFile(6, dst_path);
+				LogMessage(Debug, "setting size");
+				itfa.SetSize(total_size);
 
-			size_t offset = 0;
-			std::vector<uint8_t> data;
-			while(offset < total_size) {
-				data.resize(std::min(total_size - offset, (size_t) 0x10000));
-				size_t r;
-				if((r = src.Read(data.data(), data.size())) < data.size()) {
-					LogMessage(Error, "hit EoF unexpectedly? expected 0x%lx, got 0x%lx", data.size(), r);
-					return 1;
+				if(!PushFile(itfa, src, total_size)) {
+					return SIZE_MAX;
 				}
-				
-				itfa.Write(offset, data);
-				offset+= data.size();
-			}
 
-			fprintf(stderr, "%s -> %s\n", src_path.c_str(), dst_path.c_str());
-		}
-
-		return 0;
+				fprintf(stderr, "%s -> %s\n", src_path.c_str(), dst_path.c_str());
+				return total_size;
+			});
 	}
 
 	int DoLs(tool::ITwibDeviceInterface &itdi) {
@@ -412,6 +412,144 @@ class FSCommands {
 	CLI::App *subcommand;
 	
  private:
+	// Runs func for each of count files, with up to max_jobs files in
+	// flight at once. func returns the number of bytes it transferred, or
+	// SIZE_MAX if it failed and already said why.
+	int RunJobs(size_t count, size_t max_jobs, std::function<size_t(size_t)> func) {
+		std::mutex mutex;
+		size_t next = 0;
+		size_t total_bytes = 0;
+		bool failed = false;
+		std::exception_ptr exception;
+
+		auto start = std::chrono::steady_clock::now();
+		
+		auto worker = [&]() {
+			while(true) {
+				size_t i;
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					if(next >= count || failed) {
+						return;
+					}
+					i = next++;
+				}
+
+				size_t r;
+				try {
+					r = func(i);
+				} catch(...) {
+					std::lock_guard<std::mutex> lock(mutex);
+					if(!exception) {
+						exception = std::current_exception();
+					}
+					failed = true;
+					return;
+				}
+
+				std::lock_guard<std::mutex> lock(mutex);
+				if(r == SIZE_MAX) {
+					failed = true;
+				} else {
+					total_bytes+= r;
+				}
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for(size_t i = 1; i < std::min(count, std::max(max_jobs, (size_t) 1)); i++) {
+			threads.emplace_back(worker);
+		}
+		worker();
+		for(auto &t : threads) {
+			t.join();
+		}
+
+		if(exception) {
+			std::rethrow_exception(exception);
+		}
+		if(failed) {
+			return 1;
+		}
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		fprintf(stderr, "transferred %zu bytes in %zu file(s) in %.2fs (%.2f MiB/s)\n",
+						total_bytes, count, seconds,
+						seconds > 0 ? (total_bytes / (1024.0 * 1024.0)) / seconds : 0.0);
+		return 0;
+	}
+
+	// Keeps up to `window` writes in flight.
+	bool PushFile(tool::ITwibFileAccessor &itfa, platform::File &src, size_t total_size) {
+		std::mutex mutex;
+		std::condition_variable cv;
+		size_t offset = 0;
+		size_t outstanding = 0;
+		uint32_t error = 0;
+		bool ok = true;
+
+		std::unique_lock<std::mutex> lock(mutex);
+		while(offset < total_size && !error) {
+			if(outstanding >= std::max(window, (size_t) 1)) {
+				cv.wait(lock);
+				continue;
+			}
+			lock.unlock();
+			
+			std::vector<uint8_t> data(std::min(total_size - offset, tool::ChunkSize));
+			size_t r;
+			if((r = src.Read(data.data(), data.size())) < data.size()) {
+				LogMessage(Error, "hit EoF unexpectedly? expected 0x%lx, got 0x%lx", data.size(), r);
+				lock.lock();
+				ok = false;
+				break;
+			}
+
+			size_t size = data.size();
+			{
+				std::lock_guard<std::mutex> guard(mutex);
+				outstanding++;
+			}
+			try {
+				itfa.WriteAsync(
+					offset, data,
+					[&](uint32_t r) {
+						std::lock_guard<std::mutex> guard(mutex);
+						if(r) {
+							error = r;
+						}
+						outstanding--;
+						cv.notify_all();
+					});
+			} catch(...) {
+				// this callback will never run, but the others still
+				// reference our locals
+				lock.lock();
+				outstanding--;
+				while(outstanding > 0) {
+					cv.wait(lock);
+				}
+				throw;
+			}
+			
+			lock.lock();
+			offset+= size;
+		}
+
+		// callbacks still reference our locals
+		while(outstanding > 0) {
+			cv.wait(lock);
+		}
+
+		if(error) {
+			throw ResultError(error);
+		}
+		return ok;
+	}
+	
+	size_t window = 8;
+	size_t jobs = 4;
+	
 	CLI::App *pull;
 	std::vector<std::string> pull_from;
 	std::string pull_to = ".";
@@ -556,6 +694,8 @@ int main(int argc, char *argv[]) {
 
 #if TWIB_GDB_ENABLED == 1
 	CLI::App *gdb = app.add_subcommand("gdb", "Opens an enhanced GDB stub for the device");
+	uint64_t gdb_readahead = 0x4000;
+	gdb->add_option("--readahead", gdb_readahead, "Bytes of memory to read ahead of each gdb memory request, 0 to disable (default 16384)");
 #endif
 
 	CLI::App *launch = app.add_subcommand("launch", "Launches an installed title");
@@ -714,10 +854,9 @@ int main(int argc, char *argv[]) {
 		
 			Logic logic(
 				[&](platform::EventLoop &l) {
-					l.Clear();
-					l.AddMember(input_pump);
 				});
 			platform::EventLoop stdin_loop(logic);
+			stdin_loop.AddMember(input_pump);
 			stdin_loop.Begin();
 		
 			stdout_pump.join();
@@ -746,22 +885,48 @@ int main(int argc, char *argv[]) {
 		}
 
 		if(coredump->parsed()) {
-			FILE *f = fopen(core_file.c_str(), "wb");
-			if(!f) {
-				LogMessage(Fatal, "could not open '%s': %s", core_file.c_str(), strerror(errno));
-				return 1;
+			std::optional<tool::ITwibFileAccessor> itfa;
+			try {
+				itfa.emplace(itdi.OpenCoreDump(core_process_id));
+			} catch(ResultError &e) {
+				if(e.code != TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION) {
+					throw;
+				}
 			}
-			std::vector<uint8_t> core = itdi.CoreDump(core_process_id);
-			size_t written = 0;
-			while(written < core.size()) {
-				ssize_t r = fwrite(core.data() + written, 1, core.size() - written, f);
-				if(r <= 0 || ferror(f)) {
-					LogMessage(Fatal, "write error on '%s'");
-				} else {
-					written+= r;
+
+			if(!itfa) {
+				// older twili; have the whole core sent in one response
+				LogMessage(Warning, "device does not support streaming coredumps");
+				FILE *f = fopen(core_file.c_str(), "wb");
+				if(!f) {
+					LogMessage(Fatal, "could not open '%s': %s", core_file.c_str(), strerror(errno));
+					return 1;
 				}
+				std::vector<uint8_t> core = itdi.CoreDump(core_process_id);
+				size_t written = 0;
+				while(written < core.size()) {
+					ssize_t r = fwrite(core.data() + written, 1, core.size() - written, f);
+					if(r <= 0 || ferror(f)) {
+						LogMessage(Fatal, "write error on '%s'", core_file.c_str());
+						fclose(f);
+						return 1;
+					} else {
+						written+= r;
+					}
+				}
+				fclose(f);
+				return 0;
 			}
-			fclose(f);
+
+			platform::File f = platform::File::OpenForClobberingWrite(core_file.c_str());
+			size_t total_size = itfa->GetSize();
+			bool ok = PullFile(
+				*itfa, f, total_size, 8,
+				[total_size](size_t written) {
+					fprintf(stderr, "\rdumping core: %zu / %zu KiB", written / 1024, total_size / 1024);
+				});
+			fprintf(stderr, "\n");
+			return ok ? 0 : 1;
 		}
 	
 		if(terminate->parsed()) {
@@ -857,6 +1022,7 @@ int main(int argc, char *argv[]) {
 #if TWIB_GDB_ENABLED == 1
 		if(gdb->parsed()) {
 			tool::gdb::GdbStub stub(itdi);
+			stub.memory_readahead = gdb_readahead;
 			stub.Run();
 			return 0;
 		}
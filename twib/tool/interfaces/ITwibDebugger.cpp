@@ -23,6 +23,8 @@
 #include "Protocol.hpp"
 #include "common/Logger.hpp"
 #include "common/ResultError.hpp"
+#include "err.hpp"
+#include "MemoryMap.hpp"
 
 #include<cstring>
 
@@ -58,6 +60,51 @@ std::tuple<nx::MemoryInfo, nx::PageInfo> ITwibDebugger::QueryMemory(uint64_t add
 	return std::make_tuple(mi, pi);
 }
 
+std::vector<std::tuple<nx::MemoryInfo, nx::PageInfo>> ITwibDebugger::QueryMemoryMap() {
+	std::vector<memory_map::Region> regions;
+	std::vector<uint32_t> page_infos;
+	std::vector<std::tuple<nx::MemoryInfo, nx::PageInfo>> map;
+
+	LogMessage(Debug, "ITwibDebugger::QueryMemoryMap()");
+
+	Response r = obj->SendSyncRequestWithoutAssert((uint32_t) CommandID::QUERY_MEMORY_MAP);
+	if(r.result_code == TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION) {
+		// older twili; walk the address space ourselves
+		LogMessage(Debug, " => unsupported, walking with QueryMemory");
+		uint64_t addr = 0;
+		nx::MemoryInfo mi;
+		do {
+			map.push_back(QueryMemory(addr));
+			mi = std::get<0>(map.back());
+			addr = mi.base_addr + mi.size;
+		} while(addr > mi.base_addr);
+		return map;
+	}
+	if(r.result_code != 0) {
+		LogMessage(Debug, " => error (0x%x)", r.result_code);
+		throw ResultError(r.result_code);
+	}
+	util::Buffer payload(r.payload);
+	if(!memory_map::Decode(payload, regions, page_infos)) {
+		LogMessage(Error, "malformed memory map response (0x%zx bytes)", r.payload.size());
+		throw ResultError(TWILI_ERR_PROTOCOL_BAD_RESPONSE);
+	}
+
+	map.reserve(regions.size());
+	for(size_t i = 0; i < regions.size(); i++) {
+		const memory_map::Region &region = regions[i];
+		nx::MemoryInfo mi = {
+			region.base_addr, region.size,
+			region.memory_type, region.memory_attribute, region.permission,
+			region.device_ref_count, region.ipc_ref_count, region.padding};
+		map.emplace_back(mi, page_infos[i]);
+	}
+	
+	LogMessage(Debug, " => %zd regions", map.size());
+	
+	return map;
+}
+
 std::vector<uint8_t> ITwibDebugger::ReadMemory(uint64_t addr, uint64_t size) {
 	std::vector<uint8_t> bytes;
 
@@ -74,6 +121,66 @@ std::vector<uint8_t> ITwibDebugger::ReadMemory(uint64_t addr, uint64_t size) {
 	return bytes;
 }
 
+std::vector<std::tuple<uint32_t, std::vector<uint8_t>>> ITwibDebugger::ReadMemoryMulti(const std::vector<std::tuple<uint64_t, uint64_t>> &ranges) {
+	std::vector<uint64_t> addresses;
+	std::vector<uint64_t> sizes;
+	std::vector<uint8_t> data;
+	std::vector<uint32_t> codes;
+	std::vector<std::tuple<uint32_t, std::vector<uint8_t>>> results;
+
+	LogMessage(Debug, "ITwibDebugger::ReadMemoryMulti(%zd ranges)", ranges.size());
+
+	uint64_t total_size = 0;
+	for(auto &range : ranges) {
+		addresses.push_back(std::get<0>(range));
+		sizes.push_back(std::get<1>(range));
+		total_size+= std::get<1>(range);
+	}
+	
+	uint32_t r = obj->SendSmartSyncRequestWithoutAssert(
+		CommandID::READ_MEMORY_MULTI,
+		in<std::vector<uint64_t>>(std::move(addresses)),
+		in<std::vector<uint64_t>>(std::move(sizes)),
+		out(data),
+		out(codes));
+	if(r == TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION) {
+		// older twili; one request per range
+		LogMessage(Debug, " => unsupported, reading ranges one at a time");
+		for(auto &range : ranges) {
+			try {
+				results.emplace_back(0, ReadMemory(std::get<0>(range), std::get<1>(range)));
+			} catch(ResultError &e) {
+				results.emplace_back(e.code, std::vector<uint8_t>());
+			}
+		}
+		return results;
+	}
+	if(r != 0) {
+		LogMessage(Debug, " => error (0x%x)", r);
+		throw ResultError(r);
+	}
+	if(data.size() != total_size || codes.size() != ranges.size()) {
+		LogMessage(Error, "mismatched multi-read response (0x%zx bytes, %zd results)", data.size(), codes.size());
+		throw ResultError(TWILI_ERR_PROTOCOL_BAD_RESPONSE);
+	}
+
+	results.reserve(ranges.size());
+	auto data_i = data.begin();
+	for(size_t i = 0; i < ranges.size(); i++) {
+		uint64_t size = std::get<1>(ranges[i]);
+		if(codes[i] == 0) {
+			results.emplace_back(0, std::vector<uint8_t>(data_i, data_i + size));
+		} else {
+			results.emplace_back(codes[i], std::vector<uint8_t>());
+		}
+		data_i+= size;
+	}
+
+	LogMessage(Debug, " => OK");
+	
+	return results;
+}
+
 void ITwibDebugger::WriteMemory(uint64_t addr, std::vector<uint8_t> &bytes) {
 	LogMessage(Debug, "ITwibDebugger::WriteMemory(0x%lx, 0x%lx)", bytes.size());
 	
@@ -85,6 +192,56 @@ void ITwibDebugger::WriteMemory(uint64_t addr, std::vector<uint8_t> &bytes) {
 	LogMessage(Debug, " => OK");
 }
 
+std::vector<uint32_t> ITwibDebugger::WriteMemoryMulti(const std::vector<std::tuple<uint64_t, std::vector<uint8_t>>> &writes) {
+	std::vector<uint64_t> addresses;
+	std::vector<uint64_t> sizes;
+	std::vector<uint8_t> data;
+	std::vector<uint32_t> codes;
+
+	LogMessage(Debug, "ITwibDebugger::WriteMemoryMulti(%zd ranges)", writes.size());
+
+	for(auto &write : writes) {
+		const std::vector<uint8_t> &bytes = std::get<1>(write);
+		addresses.push_back(std::get<0>(write));
+		sizes.push_back(bytes.size());
+		data.insert(data.end(), bytes.begin(), bytes.end());
+	}
+
+	uint32_t r = obj->SendSmartSyncRequestWithoutAssert(
+		CommandID::WRITE_MEMORY_MULTI,
+		in<std::vector<uint64_t>>(std::move(addresses)),
+		in<std::vector<uint64_t>>(std::move(sizes)),
+		in<std::vector<uint8_t>>(std::move(data)),
+		out(codes));
+	if(r == TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION) {
+		// older twili; one request per range
+		LogMessage(Debug, " => unsupported, writing ranges one at a time");
+		codes.clear();
+		for(auto &write : writes) {
+			std::vector<uint8_t> bytes = std::get<1>(write);
+			try {
+				WriteMemory(std::get<0>(write), bytes);
+				codes.push_back(0);
+			} catch(ResultError &e) {
+				codes.push_back(e.code);
+			}
+		}
+		return codes;
+	}
+	if(r != 0) {
+		LogMessage(Debug, " => error (0x%x)", r);
+		throw ResultError(r);
+	}
+	if(codes.size() != writes.size()) {
+		LogMessage(Error, "mismatched multi-write response (%zd results)", codes.size());
+		throw ResultError(TWILI_ERR_PROTOCOL_BAD_RESPONSE);
+	}
+
+	LogMessage(Debug, " => OK");
+
+	return codes;
+}
+
 std::optional<nx::DebugEvent> ITwibDebugger::GetDebugEvent() {
 	nx::DebugEvent event;
 	
@@ -112,6 +269,68 @@ std::optional<nx::DebugEvent> ITwibDebugger::GetDebugEvent() {
 	return event;
 }
 
+std::vector<nx::DebugEvent> ITwibDebugger::GetDebugEvents(bool wait) {
+	std::vector<nx::DebugEvent> events;
+
+	LogMessage(Debug, "ITwibDebugger::GetDebugEvents(%s)", wait ? "true" : "false");
+
+	uint32_t r = obj->SendSmartSyncRequestWithoutAssert(
+		CommandID::GET_DEBUG_EVENTS,
+		in<bool>(wait),
+		out(events));
+	if(r == TWILI_ERR_PROTOCOL_UNRECOGNIZED_FUNCTION) {
+		// older twili; one request per event
+		LogMessage(Debug, " => unsupported, draining one at a time");
+		std::optional<nx::DebugEvent> event;
+		while((event = GetDebugEvent())) {
+			events.push_back(*event);
+		}
+		return events;
+	}
+	if(r != 0) {
+		LogMessage(Debug, " => error (0x%x)", r);
+		throw ResultError(r);
+	}
+
+	LogMessage(Debug, " => %zd events", events.size());
+	
+	return events;
+}
+
+std::vector<std::tuple<uint64_t, std::optional<ThreadContext>>> ITwibDebugger::ListThreads(bool with_contexts) {
+	std::vector<uint64_t> thread_ids;
+	std::vector<uint32_t> results;
+	std::vector<ThreadContext> contexts;
+	std::vector<std::tuple<uint64_t, std::optional<ThreadContext>>> threads;
+
+	LogMessage(Debug, "ITwibDebugger::ListThreads(%s)", with_contexts ? "true" : "false");
+
+	obj->SendSmartSyncRequest(
+		CommandID::LIST_THREADS,
+		in<bool>(with_contexts),
+		out(thread_ids),
+		out(results),
+		out(contexts));
+
+	if(with_contexts && (results.size() != thread_ids.size() || contexts.size() != thread_ids.size())) {
+		LogMessage(Error, "mismatched thread list response (%zd threads, %zd results, %zd contexts)", thread_ids.size(), results.size(), contexts.size());
+		throw ResultError(TWILI_ERR_PROTOCOL_BAD_RESPONSE);
+	}
+
+	threads.reserve(thread_ids.size());
+	for(size_t i = 0; i < thread_ids.size(); i++) {
+		if(with_contexts && results[i] == 0) {
+			threads.emplace_back(thread_ids[i], contexts[i]);
+		} else {
+			threads.emplace_back(thread_ids[i], std::nullopt);
+		}
+	}
+	
+	LogMessage(Debug, " => %zd threads", threads.size());
+	
+	return threads;
+}
+
 ThreadContext ITwibDebugger::GetThreadContext(uint64_t thread_id) {
 	ThreadContext tc;
 	
@@ -138,6 +357,16 @@ void ITwibDebugger::SetThreadContext(uint64_t thread_id, ThreadContext tc) {
 	LogMessage(Debug, " => OK");
 }
 
+void ITwibDebugger::StepThread(uint64_t thread_id) {
+	LogMessage(Debug, "ITwibDebugger::StepThread(0x%lx)", thread_id);
+	
+	obj->SendSmartSyncRequest(
+		CommandID::STEP_THREAD,
+		in<uint64_t>(thread_id));
+
+	LogMessage(Debug, " => OK");
+}
+
 void ITwibDebugger::ContinueDebugEvent(uint32_t flags, std::vector<uint64_t> thread_ids) {
 	LogMessage(Debug, "ITwibDebugger::ContinueDebugEvent(0x%x) {", flags);
 	for(uint64_t tid : thread_ids) {
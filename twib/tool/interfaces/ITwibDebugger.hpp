@@ -49,13 +49,30 @@ class ITwibDebugger {
 	using CommandID = protocol::ITwibDebugger::Command;
 
 	std::tuple<nx::MemoryInfo, nx::PageInfo> QueryMemory(uint64_t addr);
+	// every region in the address space, in one request if the device supports it
+	std::vector<std::tuple<nx::MemoryInfo, nx::PageInfo>> QueryMemoryMap();
 	std::vector<uint8_t> ReadMemory(uint64_t addr, uint64_t size);
+	// reads each (address, size) range in a single request. each range gets
+	// its own result code, and ranges that failed come back empty.
+	std::vector<std::tuple<uint32_t, std::vector<uint8_t>>> ReadMemoryMulti(const std::vector<std::tuple<uint64_t, uint64_t>> &ranges);
 	void WriteMemory(uint64_t addr, std::vector<uint8_t> &bytes);
+	// writes each (address, bytes) pair in a single request, returning a
+	// result code for each
+	std::vector<uint32_t> WriteMemoryMulti(const std::vector<std::tuple<uint64_t, std::vector<uint8_t>>> &writes);
 	std::optional<nx::DebugEvent> GetDebugEvent();
+	// drains every pending event. if wait is set and nothing is pending, blocks
+	// until something is (older twili ignores wait).
+	std::vector<nx::DebugEvent> GetDebugEvents(bool wait = false);
+	// lists every thread in the process, and optionally fetches all of their
+	// contexts in the same request. threads whose context couldn't be read
+	// get std::nullopt.
+	std::vector<std::tuple<uint64_t, std::optional<ThreadContext>>> ListThreads(bool with_contexts);
 	ThreadContext GetThreadContext(uint64_t thread_id);
 	void SetThreadContext(uint64_t thread_id, ThreadContext tc);
 	void ContinueDebugEvent(uint32_t flags, std::vector<uint64_t> thread_ids);
 	void BreakProcess();
+	// arms a one-shot single step; the thread still has to be continued
+	void StepThread(uint64_t thread_id);
 	void AsyncWait(std::function<void(uint32_t)> &&cb);
 	uint64_t GetTargetEntry();
 	void LaunchDebugProcess();
@@ -55,6 +55,15 @@ std::vector<uint8_t> ITwibDeviceInterface::CoreDump(uint64_t process_id) {
 	return dump;
 }
 
+ITwibFileAccessor ITwibDeviceInterface::OpenCoreDump(uint64_t process_id) {
+	std::optional<ITwibFileAccessor> accessor;
+	obj->SendSmartSyncRequest(
+		CommandID::OPEN_COREDUMP,
+		in<uint64_t>(process_id),
+		out_object<ITwibFileAccessor>(accessor));
+	return *accessor;
+}
+
 void ITwibDeviceInterface::Terminate(uint64_t process_id) {
 	uint8_t *process_id_bytes = (uint8_t*) &process_id;
 	obj->SendSmartSyncRequest(
@@ -30,6 +30,7 @@
 #include "ITwibProcessMonitor.hpp"
 #include "ITwibDebugger.hpp"
 #include "ITwibFilesystemAccessor.hpp"
+#include "ITwibFileAccessor.hpp"
 
 namespace twili {
 namespace twib {
@@ -52,6 +53,7 @@ class ITwibDeviceInterface {
 	ITwibProcessMonitor CreateMonitoredProcess(std::string type);
 	void Reboot();
 	std::vector<uint8_t> CoreDump(uint64_t process_id);
+	ITwibFileAccessor OpenCoreDump(uint64_t process_id);
 	void Terminate(uint64_t process_id);
 	std::vector<ProcessListEntry> ListProcesses();
 	msgpack11::MsgPack Identify();
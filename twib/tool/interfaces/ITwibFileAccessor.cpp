@@ -49,6 +49,40 @@ void ITwibFileAccessor::Write(uint64_t offset, std::vector<uint8_t> &vec) {
 		in<std::vector<uint8_t>>(vec));
 }
 
+void ITwibFileAccessor::ReadAsync(uint64_t offset, uint64_t size, std::function<void(uint32_t, std::vector<uint8_t>)> &&func) {
+	util::Buffer input_buffer;
+	detail::PackingHelper<uint64_t>::Pack(std::move(offset), input_buffer);
+	detail::PackingHelper<uint64_t>::Pack(std::move(size), input_buffer);
+	obj->SendRequest(
+		(uint32_t) CommandID::READ,
+		input_buffer.GetData(),
+		[func{std::move(func)}](Response r) {
+			std::vector<uint8_t> vec;
+			if(r.result_code) {
+				func(r.result_code, std::move(vec));
+				return;
+			}
+			util::Buffer output_buffer(r.payload);
+			if(!detail::PackingHelper<std::vector<uint8_t>>::Unpack(std::move(vec), output_buffer)) {
+				func(TWILI_ERR_PROTOCOL_BAD_RESPONSE, std::move(vec));
+				return;
+			}
+			func(0, std::move(vec));
+		});
+}
+
+void ITwibFileAccessor::WriteAsync(uint64_t offset, std::vector<uint8_t> &vec, std::function<void(uint32_t)> &&func) {
+	util::Buffer input_buffer;
+	detail::PackingHelper<uint64_t>::Pack(std::move(offset), input_buffer);
+	detail::PackingHelper<std::vector<uint8_t>>::Pack(std::move(vec), input_buffer);
+	obj->SendRequest(
+		(uint32_t) CommandID::WRITE,
+		input_buffer.GetData(),
+		[func{std::move(func)}](Response r) {
+			func(r.result_code);
+		});
+}
+
 void ITwibFileAccessor::Flush() {
 	obj->SendSmartSyncRequest(CommandID::FLUSH);
 }
@@ -23,6 +23,7 @@
 #include<vector>
 #include<optional>
 #include<tuple>
+#include<functional>
 
 #include "../RemoteObject.hpp"
 
@@ -38,6 +39,9 @@ class ITwibFileAccessor {
 
 	std::vector<uint8_t> Read(uint64_t offset, uint64_t size);
 	void Write(uint64_t offset, std::vector<uint8_t> &vec);
+	// these don't wait for the response, so several can be in flight at once
+	void ReadAsync(uint64_t offset, uint64_t size, std::function<void(uint32_t, std::vector<uint8_t>)> &&func);
+	void WriteAsync(uint64_t offset, std::vector<uint8_t> &vec, std::function<void(uint32_t)> &&func);
 	void Flush();
 	void SetSize(size_t size);
 	size_t GetSize();
@@ -25,9 +25,11 @@
 
 #include<vector>
 #include<string>
+#include<algorithm>
 
 #include "twili.hpp"
 #include "process/Process.hpp"
+#include "err.hpp"
 
 using trn::ResultCode;
 
@@ -37,7 +39,11 @@ ELFCrashReport::ELFCrashReport() {
 }
 
 void ELFCrashReport::AddVMA(uint64_t virtual_addr, uint64_t size, uint32_t flags) {
-	vmas.push_back({0, virtual_addr, size, flags});
+	vmas.push_back({0, virtual_addr, size, flags, size});
+}
+
+uint32_t ELFCrashReport::ReadMemory(uint64_t virtual_addr, uint8_t *buffer, size_t size) {
+	return twili::Unwrap(trn::svc::ReadDebugProcessMemory(buffer, *debug, virtual_addr, size)).code;
 }
 
 void ELFCrashReport::AddNote(std::string name, uint32_t type, std::vector<uint8_t> desc) {
@@ -61,18 +67,19 @@ ELFCrashReport::Thread *ELFCrashReport::GetThread(uint64_t thread_id) {
 	return &threads.find(thread_id)->second;
 }
 
-void ELFCrashReport::Generate(process::Process &process, twili::bridge::ResponseOpener ro) {
+trn::ResultCode ELFCrashReport::Prepare(process::Process &process) {
 	process.AddNotes(*this);
 	
-	trn::KDebug debug = ({
-			auto r = trn::svc::DebugActiveProcess(process.GetPid());
-			if(!r) { ro.RespondError(r.error()); return; }
-			std::move(*r); });
+	{
+		auto r = trn::svc::DebugActiveProcess(process.GetPid());
+		if(!r) { return r.error(); }
+		debug.emplace(std::move(*r));
+	}
 	
-	printf("  opened debug: 0x%x\n", debug.handle);
+	printf("  opened debug: 0x%x\n", debug->handle);
 
 	while(1) {
-		auto r = trn::svc::GetDebugEvent(debug);
+		auto r = trn::svc::GetDebugEvent(*debug);
 		if(!r) {
 			if(r.error().code == 0x8c01) {
 				break;
@@ -209,7 +216,7 @@ void ELFCrashReport::Generate(process::Process &process, twili::bridge::Response
 	uint64_t vaddr = 0;
 	do {
 		std::tuple<memory_info_t, uint32_t> r = twili::Assert(
-			trn::svc::QueryDebugProcessMemory(debug, vaddr));
+			trn::svc::QueryDebugProcessMemory(*debug, vaddr));
 		memory_info_t mi = std::get<0>(r);
 
 		// skip I/O mappings; these are volatile and reading them might hang or break things
@@ -225,65 +232,15 @@ void ELFCrashReport::Generate(process::Process &process, twili::bridge::Response
 		vaddr = ((uint64_t) mi.base_addr) + mi.size;
 	} while(vaddr > 0);
 
+	auto read = [this](uint64_t virtual_addr, uint8_t *buffer, size_t size) {
+		return ReadMemory(virtual_addr, buffer, size);
+	};
+	vmas = coredump::ElideZeroPages(vmas, read);
+
 	for(auto i = threads.begin(); i != threads.end(); i++) {
-		AddNote<ELF::Note::elf_prstatus>("CORE", ELF::NT_PRSTATUS, i->second.GeneratePRSTATUS(debug));
-	}
-	
-	size_t total_size = 0;
-	total_size+= sizeof(ELF::Elf64_Ehdr);
-	for(auto i = vmas.begin(); i != vmas.end(); i++) {
-		i->file_offset = total_size;
-		total_size+= i->size;
+		AddNote<ELF::Note::elf_prstatus>("CORE", ELF::NT_PRSTATUS, i->second.GeneratePRSTATUS(*debug));
 	}
 	
-	size_t notes_offset = total_size;
-	for(auto i = notes.begin(); i != notes.end(); i++) {
-		total_size+=
-			4 + // namesz
-			4 + // descsz
-			4 + // type
-			i->name.size() +
-			i->desc.size();
-	}
-	
-	size_t ph_offset = total_size;
-	total_size+= sizeof(ELF::Elf64_Phdr) * (1 + vmas.size());
-
-	bridge::ResponseWriter r = ro.BeginOk(sizeof(uint64_t) + total_size);
-	r.Write<uint64_t>(total_size);
-	r.Write<ELF::Elf64_Ehdr>({
-			.e_ident = {
-				.ei_class = ELF::ELFCLASS64,
-				.ei_data = ELF::ELFDATALSB,
-				.ei_version = 1,
-				.ei_osabi = 3 // pretend to be a Linux core dump
-			},
-			.e_type = ELF::ET_CORE,
-			.e_machine = ELF::EM_AARCH64,
-			.e_version = 1,
-			.e_entry = 0,
-			.e_phoff = ph_offset,
-			.e_shoff = 0,
-			.e_flags = 0,
-			.e_phnum = static_cast<uint16_t>(1 + vmas.size()),
-			.e_shnum = 0,
-			.e_shstrndx = 0,
-		});
-
-	// write VMAs
-	std::vector<uint8_t> transfer_buffer(r.GetMaxTransferSize(), 0);
-	for(auto i = vmas.begin(); i != vmas.end(); i++) {
-		for(size_t offset = 0; offset < i->size; offset+= transfer_buffer.size()) {
-			size_t size = transfer_buffer.size();
-			if(size > i->size - offset) {
-				size = i->size - offset;
-			}
-			twili::Assert(trn::svc::ReadDebugProcessMemory(transfer_buffer.data(), debug, i->virtual_addr + offset, size));
-			r.Write(transfer_buffer.data(), size);
-		}
-	}
-			
-	// write notes
 	std::vector<uint8_t> notes_bytes;
 	for(auto i = notes.begin(); i != notes.end(); i++) {
 		struct NoteHeader {
@@ -296,39 +253,43 @@ void ELFCrashReport::Generate(process::Process &process, twili::bridge::Response
 			.descsz = i->descsz,
 			.type = i->type
 		};
-		std::vector<uint8_t> note(sizeof(note_header), 0);
-		memcpy(note.data(), &note_header, sizeof(note_header)); // this is terrible
-		note.insert(note.end(), i->name.begin(), i->name.end());
-		note.insert(note.end(), i->desc.begin(), i->desc.end());
-		notes_bytes.insert(notes_bytes.end(), note.begin(), note.end());
+		uint8_t *note_header_bytes = (uint8_t*) &note_header;
+		notes_bytes.insert(notes_bytes.end(), note_header_bytes, note_header_bytes + sizeof(note_header));
+		notes_bytes.insert(notes_bytes.end(), i->name.begin(), i->name.end());
+		notes_bytes.insert(notes_bytes.end(), i->desc.begin(), i->desc.end());
 	}
-	r.Write(notes_bytes);
-			
-	// write phdrs
-	std::vector<ELF::Elf64_Phdr> phdrs;
-	phdrs.push_back({
-			.p_type = ELF::PT_NOTE,
-			.p_flags = ELF::PF_R,
-			.p_offset = notes_offset,
-			.p_vaddr = 0,
-			.p_paddr = 0,
-			.p_filesz = notes_bytes.size(),
-			.p_memsz = 0,
-			.p_align = 4
-		});
-	for(auto i = vmas.begin(); i != vmas.end(); i++) {
-		phdrs.push_back({
-				.p_type = ELF::PT_LOAD,
-				.p_flags = i->flags,
-				.p_offset = i->file_offset,
-				.p_vaddr = i->virtual_addr,
-				.p_paddr = 0,
-				.p_filesz = i->size,
-				.p_memsz = i->size,
-				.p_align = 0x1000
-			});
+
+	layout.Build(std::move(vmas), std::move(notes_bytes));
+
+	return RESULT_OK;
+}
+
+size_t ELFCrashReport::GetSize() {
+	return layout.GetSize();
+}
+
+trn::ResultCode ELFCrashReport::Read(uint64_t offset, uint8_t *buffer, size_t size) {
+	return trn::ResultCode(
+		layout.Read(
+			offset, buffer, size,
+			[this](uint64_t virtual_addr, uint8_t *buffer, size_t size) {
+				return ReadMemory(virtual_addr, buffer, size);
+			}));
+}
+
+void ELFCrashReport::Generate(process::Process &process, twili::bridge::ResponseOpener opener) {
+	TWILI_BRIDGE_CHECK(Prepare(process));
+
+	size_t total_size = layout.GetSize();
+	bridge::ResponseWriter r = opener.BeginOk(sizeof(uint64_t) + total_size);
+	r.Write<uint64_t>(total_size);
+
+	std::vector<uint8_t> transfer_buffer(r.GetMaxTransferSize(), 0);
+	for(size_t offset = 0; offset < total_size; offset+= transfer_buffer.size()) {
+		size_t size = std::min(transfer_buffer.size(), total_size - offset);
+		twili::Assert(Read(offset, transfer_buffer.data(), size));
+		r.Write(transfer_buffer.data(), size);
 	}
-	r.Write(phdrs);
 	r.Finalize();
 }
 
@@ -27,8 +27,10 @@
 #include<vector>
 #include<string>
 #include<map>
+#include<optional>
 
 #include "Elf.hpp"
+#include "CoreDumpLayout.hpp"
 #include "bridge/ResponseOpener.hpp"
 
 namespace twili {
@@ -37,13 +39,6 @@ class Process;
 }
 
 class ELFCrashReport {
-	struct VMA {
-		uint64_t file_offset;
-		uint64_t virtual_addr;
-		size_t size;
-		uint32_t flags;
-	};
-
 	struct Note {
 		uint32_t namesz;
 		uint32_t descsz;
@@ -75,6 +70,13 @@ class ELFCrashReport {
 		AddNote(name, type, bytes);
 	}
 	
+	// Attaches to the process and lays out the core file. Process memory
+	// isn't read until it's asked for, and the process stays attached
+	// until the report is destroyed.
+	trn::ResultCode Prepare(process::Process &process);
+	size_t GetSize();
+	trn::ResultCode Read(uint64_t offset, uint8_t *buffer, size_t size);
+	
 	void Generate(process::Process &process, bridge::ResponseOpener opener);
 	void AddNote(std::string name, uint32_t type, std::vector<uint8_t> desc);
 
@@ -87,11 +89,15 @@ class ELFCrashReport {
 	}
 	
  private:
-	std::vector<VMA> vmas;
+	std::vector<coredump::VMA> vmas;
 	std::vector<Note> notes;
 	std::map<uint64_t, Thread> threads;
 
+	std::optional<trn::KDebug> debug;
+	coredump::CoreDumpLayout layout;
+
 	void AddVMA(uint64_t virtual_addr, uint64_t size, uint32_t flags);
+	uint32_t ReadMemory(uint64_t virtual_addr, uint8_t *buffer, size_t size);
 	void AddThread(uint64_t thread_id, uint64_t tls_pointer, uint64_t entrypoint);
 	Thread *GetThread(uint64_t thread_id);
 };
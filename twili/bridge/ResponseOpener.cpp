@@ -29,6 +29,10 @@ namespace bridge {
 using trn::ResultCode;
 using trn::ResultError;
 
+// responses this size or smaller are buffered and compressed whole
+static const size_t MaxCompressedResponseSize = 256 * 1024;
+static const size_t MinCompressedResponseSize = 256;
+
 ResponseOpener::ResponseOpener(std::shared_ptr<detail::ResponseState> state) : state(state) {
 }
 
@@ -50,7 +54,13 @@ ResponseWriter ResponseOpener::BeginError(ResultCode code, size_t payload_size,
 	state->total_size = payload_size;
 	state->object_count = object_count;
 
-	state->SendHeader(hdr);
+	if(state->link.compression && payload_size >= MinCompressedResponseSize && payload_size <= MaxCompressedResponseSize) {
+		state->compressing = true;
+		state->compressed_header = hdr;
+		state->uncompressed_payload.reserve(payload_size);
+	} else {
+		state->SendHeader(hdr);
+	}
 
 	ResponseWriter writer(state);
 	return writer;
@@ -64,5 +74,21 @@ void ResponseOpener::RespondError(ResultCode code) const {
 	BeginError(code).Finalize();
 }
 
+uint32_t ResponseOpener::GetClientId() const {
+	return state->client_id;
+}
+
+detail::LinkSettings &ResponseOpener::GetLinkSettings() const {
+	return state->link;
+}
+
+size_t ResponseOpener::GetMaxTransferSize() const {
+	return state->GetMaxTransferSize();
+}
+
+size_t ResponseOpener::GetTransferSizeLimit() const {
+	return state->GetTransferSizeLimit();
+}
+
 } // namespace bridge
 } // namespace twili
@@ -52,6 +52,11 @@ class ResponseOpener {
 	}
 
 	void RespondError(trn::ResultCode code) const;
+
+	uint32_t GetClientId() const;
+	detail::LinkSettings &GetLinkSettings() const;
+	size_t GetMaxTransferSize() const;
+	size_t GetTransferSizeLimit() const;
 	
 	template<typename T, typename... Args>
 	std::shared_ptr<T> MakeObject(Args &&... args) const {
@@ -20,6 +20,8 @@
 
 #include "ResponseOpener.hpp"
 
+#include "../twili.hpp"
+#include "Compression.hpp"
 #include "err.hpp"
 
 namespace twili {
@@ -32,7 +34,11 @@ ResponseWriter::ResponseWriter(std::shared_ptr<detail::ResponseState> state) : s
 }
 
 void ResponseWriter::Write(uint8_t *data, size_t size) {
-	state->SendData(data, size);
+	if(state->compressing) {
+		state->uncompressed_payload.insert(state->uncompressed_payload.end(), data, data + size);
+	} else {
+		state->SendData(data, size);
+	}
 }
 
 void ResponseWriter::Write(std::string str) {
@@ -46,6 +52,23 @@ uint32_t ResponseWriter::Object(std::shared_ptr<bridge::Object> object) {
 }
 
 void ResponseWriter::Finalize() {
+	if(state->compressing) {
+		state->compressing = false;
+		protocol::MessageHeader &hdr = state->compressed_header;
+		std::vector<uint8_t> payload = std::move(state->uncompressed_payload);
+		if(payload.size() != hdr.payload_size) {
+			twili::Abort(TWILI_ERR_BAD_RESPONSE);
+		}
+		
+		std::vector<uint8_t> compressed;
+		if(compression::CompressPayload(payload.data(), payload.size(), compressed)) {
+			payload = std::move(compressed);
+			hdr.payload_size = payload.size() | protocol::PAYLOAD_COMPRESSED;
+		}
+		state->total_size = payload.size();
+		state->SendHeader(hdr);
+		state->SendData(payload.data(), payload.size());
+	}
 	state->Finalize();
 }
 
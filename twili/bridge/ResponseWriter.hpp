@@ -37,10 +37,23 @@ class Object;
 
 namespace detail {
 
+// per-connection settings agreed on with twibd through HELLO
+struct LinkSettings {
+	// reported to twibd in HELLO. Every request that hasn't been answered
+	// yet holds a ResponseState (and anything it's buffering) on the bridge,
+	// so twibd holds the rest back instead of letting them pile up here.
+	static const uint32_t MaxOutstandingRequests = 256;
+	
+	bool compression = false;
+	size_t max_transfer_size = 0; // 0 means the bridge's default
+	bool said_hello = false; // since twibd last identified the device
+};
+
 class ResponseState {
  public:
-	inline ResponseState(uint32_t client_id, uint32_t tag) : client_id(client_id), tag(tag) {}
+	inline ResponseState(uint32_t client_id, uint32_t tag, LinkSettings &link) : client_id(client_id), tag(tag), link(link) {}
 	virtual size_t GetMaxTransferSize() = 0;
+	virtual size_t GetTransferSizeLimit() = 0; // most the bridge can agree to in HELLO
 	virtual void SendHeader(protocol::MessageHeader &hdr) = 0;
 	virtual void SendData(uint8_t *data, size_t size) = 0;
 	virtual void Finalize() = 0;
@@ -49,12 +62,19 @@ class ResponseState {
 
 	const uint32_t client_id;
 	const uint32_t tag;
+	LinkSettings &link;
 	
 	std::vector<std::shared_ptr<bridge::Object>> objects;
 	size_t transferred_size = 0;
 	size_t total_size = 0;
 	uint32_t object_count = 0;
 	bool has_begun = false;
+
+	// when compressing, the payload is collected here and the header is held
+	// back until Finalize, since we don't know the compressed size until then
+	bool compressing = false;
+	protocol::MessageHeader compressed_header;
+	std::vector<uint8_t> uncompressed_payload;
 };
 
 } // namespace detail
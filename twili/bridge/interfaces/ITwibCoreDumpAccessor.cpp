@@ -0,0 +1,58 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "ITwibCoreDumpAccessor.hpp"
+
+#include "../../ELFCrashReport.hpp"
+
+using namespace trn;
+
+namespace twili {
+namespace bridge {
+
+ITwibCoreDumpAccessor::ITwibCoreDumpAccessor(uint32_t object_id, std::unique_ptr<ELFCrashReport> &&report) : ObjectDispatcherProxy(*this, object_id), report(std::move(report)), dispatcher(*this) {
+	
+}
+
+ITwibCoreDumpAccessor::~ITwibCoreDumpAccessor() {
+}
+
+void ITwibCoreDumpAccessor::Read(bridge::ResponseOpener opener, uint64_t offset, uint64_t size) {
+	const size_t limit = 0x40000;
+
+	size_t total_size = report->GetSize();
+	if(offset > total_size) {
+		offset = total_size;
+	}
+	
+	// short reads at the end, like a regular file
+	std::vector<uint8_t> buffer(std::min(std::min(size, limit), total_size - offset));
+	TWILI_BRIDGE_CHECK(report->Read(offset, buffer.data(), buffer.size()));
+	
+	opener.RespondOk(std::move(buffer));
+}
+
+void ITwibCoreDumpAccessor::GetSize(bridge::ResponseOpener opener) {
+	size_t size = report->GetSize();
+	opener.RespondOk(std::move(size));
+}
+
+} // namespace bridge
+} // namespace twili
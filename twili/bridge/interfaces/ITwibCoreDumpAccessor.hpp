@@ -0,0 +1,59 @@
+//
+// Twili - Homebrew debug monitor for the Nintendo Switch
+// Copyright (C) 2019 misson20000 <xenotoad@xenotoad.net>
+//
+// This file is part of Twili.
+//
+// Twili is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Twili is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Twili.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include "../Object.hpp"
+#include "../ResponseOpener.hpp"
+#include "../RequestHandler.hpp"
+
+#include<memory>
+
+namespace twili {
+
+class ELFCrashReport;
+
+namespace bridge {
+
+// Read-only view of a core dump that speaks ITwibFileAccessor's protocol, so
+// the host can pull it in pieces instead of receiving it as one response.
+class ITwibCoreDumpAccessor : public ObjectDispatcherProxy<ITwibCoreDumpAccessor> {
+ public:
+	ITwibCoreDumpAccessor(uint32_t object_id, std::unique_ptr<ELFCrashReport> &&report);
+	~ITwibCoreDumpAccessor();
+	
+	using CommandID = protocol::ITwibFileAccessor::Command;
+	
+ private:
+	std::unique_ptr<ELFCrashReport> report;
+
+	void Read(bridge::ResponseOpener opener, uint64_t offset, uint64_t size);
+	void GetSize(bridge::ResponseOpener opener);
+
+ public:
+	SmartRequestDispatcher<
+		ITwibCoreDumpAccessor,
+		SmartCommand<CommandID::READ, &ITwibCoreDumpAccessor::Read>,
+		SmartCommand<CommandID::GET_SIZE, &ITwibCoreDumpAccessor::GetSize>
+	 > dispatcher;
+};
+
+} // namespace bridge
+} // namespace twili
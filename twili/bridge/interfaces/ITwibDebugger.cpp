@@ -22,8 +22,12 @@
 
 #include<libtransistor/cpp/svc.hpp>
 
+#include<algorithm>
+#include<cstring>
+
 #include "err.hpp"
 #include "title_id.hpp"
+#include "MemoryMap.hpp"
 #include "../../twili.hpp"
 #include "../../Services.hpp"
 #include "../../process/MonitoredProcess.hpp"
@@ -74,6 +78,24 @@ void ITwibDebugger::PumpEvents() {
 			}
 			title_id = e.attach_process.title_id;
 		}
+
+		if(e.event_type == DEBUG_EVENT_EXCEPTION) {
+			// whatever stopped the thread, the step is over
+			ClearStepBreakpoints();
+		} else if(e.event_type == DEBUG_EVENT_EXIT) { // thread exited
+			auto i = std::find(stepping_thread_ids.begin(), stepping_thread_ids.end(), e.thread_id);
+			if(i != stepping_thread_ids.end()) {
+				stepping_thread_ids.erase(i);
+				if(stepping_thread_ids.empty()) {
+					// the host goes back to continuing every thread once none
+					// are stepping, so the patches can't stay behind
+					ClearStepBreakpoints();
+				}
+			}
+		} else if(e.event_type == DEBUG_EVENT_UNKNOWN) { // process exited
+			step_breakpoints.clear();
+			stepping_thread_ids.clear();
+		}
 		
 		r = trn::svc::GetDebugEvent(debug);
 	}
@@ -132,8 +154,34 @@ void ITwibDebugger::WriteMemory(bridge::ResponseOpener opener, uint64_t addr, In
 		};
 }
 
-void ITwibDebugger::ListThreads(bridge::ResponseOpener opener) {
-	opener.RespondError(LIBTRANSISTOR_ERR_UNIMPLEMENTED);
+void ITwibDebugger::ListThreads(bridge::ResponseOpener opener, bool with_contexts) {
+	uint64_t thread_ids[256];
+	uint32_t num_threads;
+	TWILI_BRIDGE_CHECK(svcGetThreadList(&num_threads, thread_ids, ARRAY_LENGTH(thread_ids), debug.handle));
+
+	// if contexts were requested, results and contexts line up with thread
+	// ids. contexts for threads that failed are left zeroed.
+	std::vector<uint32_t> results;
+	std::vector<thread_context_t> contexts;
+	if(with_contexts) {
+		results.reserve(num_threads);
+		contexts.reserve(num_threads);
+		for(uint32_t i = 0; i < num_threads; i++) {
+			auto r = trn::svc::GetDebugThreadContext(debug, thread_ids[i], 15);
+			if(r) {
+				results.push_back(RESULT_OK);
+				contexts.push_back(*r);
+			} else {
+				results.push_back(r.error().code);
+				contexts.push_back(thread_context_t {});
+			}
+		}
+	}
+	
+	opener.RespondOk(
+		std::vector<uint64_t>(thread_ids, thread_ids + num_threads),
+		std::move(results),
+		std::move(contexts));
 }
 
 void ITwibDebugger::GetDebugEvent(bridge::ResponseOpener opener) {
@@ -147,6 +195,33 @@ void ITwibDebugger::GetDebugEvent(bridge::ResponseOpener opener) {
 	}
 }
 
+void ITwibDebugger::GetDebugEvents(bridge::ResponseOpener opener, bool wait) {
+	PumpEvents();
+
+	if(event_queue.empty() && wait) {
+		TWILI_BRIDGE_CHECK(
+			wait_handle ? TWILI_ERR_ALREADY_WAITING : RESULT_OK);
+
+		wait_handle = twili.event_waiter.Add(
+			debug,
+			[this, opener]() mutable -> bool {
+				PumpEvents();
+				RespondEvents(opener);
+				wait_handle.reset();
+				return false;
+			});
+		return;
+	}
+
+	RespondEvents(opener);
+}
+
+void ITwibDebugger::RespondEvents(bridge::ResponseOpener &opener) {
+	std::vector<debug_event_info_t> events(event_queue.begin(), event_queue.end());
+	event_queue.clear();
+	opener.RespondOk(std::move(events));
+}
+
 void ITwibDebugger::GetThreadContext(bridge::ResponseOpener opener, uint64_t thread_id) {
 	auto r = trn::svc::GetDebugThreadContext(debug, thread_id, 15);
 	if(!r) {
@@ -265,5 +340,188 @@ void ITwibDebugger::GetNroInfos(bridge::ResponseOpener opener) {
 	opener.RespondOk(std::move(nro_info));
 }
 
+void ITwibDebugger::QueryMemoryMap(bridge::ResponseOpener opener) {
+	std::vector<memory_map::Region> regions;
+	std::vector<uint32_t> page_infos;
+
+	uint64_t addr = 0;
+	memory_info_t mi;
+	do {
+		auto r = trn::svc::QueryDebugProcessMemory(debug, addr);
+		if(!r) {
+			TWILI_BRIDGE_CHECK(r.error());
+		}
+
+		mi = std::get<0>(*r);
+		regions.push_back({
+				(uint64_t) mi.base_addr, mi.size,
+				mi.memory_type, mi.memory_attribute, mi.permission,
+				mi.device_ref_count, mi.ipc_ref_count, 0});
+		page_infos.push_back(std::get<1>(*r));
+		addr = (uint64_t) mi.base_addr + mi.size;
+	} while(addr > (uint64_t) mi.base_addr);
+
+	util::Buffer payload;
+	memory_map::Encode(regions, page_infos, payload);
+	bridge::ResponseWriter w = opener.BeginOk(payload.ReadAvailable());
+	w.Write(payload.Read(), payload.ReadAvailable());
+	w.Finalize();
+}
+
+void ITwibDebugger::ReadMemoryMulti(bridge::ResponseOpener opener, std::vector<uint64_t> addresses, std::vector<uint64_t> sizes) {
+	if(addresses.size() != sizes.size()) {
+		opener.RespondError(TWILI_ERR_PROTOCOL_BAD_REQUEST);
+		return;
+	}
+
+	// response is all ranges concatenated, followed by a result code for each
+	// range. ranges that fail partway through are padded out with zeroes.
+	uint64_t data_size = 0;
+	for(uint64_t size : sizes) {
+		data_size+= size;
+	}
+
+	bridge::ResponseWriter w = opener.BeginOk(
+		sizeof(uint64_t) + data_size +
+		sizeof(uint64_t) + sizes.size() * sizeof(uint32_t));
+
+	std::vector<uint8_t> buffer(std::min(data_size, (uint64_t) w.GetMaxTransferSize()), 0);
+	std::vector<uint32_t> results;
+	results.reserve(sizes.size());
+	
+	w.Write<uint64_t>(data_size);
+	for(size_t i = 0; i < addresses.size(); i++) {
+		trn::ResultCode r = RESULT_OK;
+		for(uint64_t offset = 0; offset < sizes[i]; offset+= buffer.size()) {
+			size_t chunk = std::min((uint64_t) buffer.size(), sizes[i] - offset);
+			if(r == RESULT_OK) {
+				r = twili::Unwrap(trn::svc::ReadDebugProcessMemory(buffer.data(), debug, addresses[i] + offset, chunk));
+				if(r != RESULT_OK) {
+					std::fill(buffer.begin(), buffer.end(), 0);
+				}
+			}
+			w.Write(buffer.data(), chunk);
+		}
+		results.push_back(r.code);
+	}
+	
+	w.Write<uint64_t>(results.size());
+	w.Write(results);
+	w.Finalize();
+}
+
+void ITwibDebugger::WriteMemoryMulti(bridge::ResponseOpener opener, std::vector<uint64_t> addresses, std::vector<uint64_t> sizes, std::vector<uint8_t> data) {
+	if(addresses.size() != sizes.size()) {
+		opener.RespondError(TWILI_ERR_PROTOCOL_BAD_REQUEST);
+		return;
+	}
+
+	// data is every range's bytes concatenated. each range gets its own
+	// result code, so one bad address doesn't fail the rest.
+	uint64_t offset = 0;
+	for(uint64_t size : sizes) {
+		if(size > data.size() - offset) {
+			opener.RespondError(TWILI_ERR_PROTOCOL_BAD_REQUEST);
+			return;
+		}
+		offset+= size;
+	}
+	if(offset != data.size()) {
+		opener.RespondError(TWILI_ERR_PROTOCOL_BAD_REQUEST);
+		return;
+	}
+
+	std::vector<uint32_t> results;
+	results.reserve(addresses.size());
+	offset = 0;
+	for(size_t i = 0; i < addresses.size(); i++) {
+		results.push_back(twili::Unwrap(trn::svc::WriteDebugProcessMemory(debug, data.data() + offset, addresses[i], sizes[i])).code);
+		offset+= sizes[i];
+	}
+
+	opener.RespondOk(std::move(results));
+}
+
+void ITwibDebugger::StepThread(bridge::ResponseOpener opener, uint64_t thread_id) {
+	// the kernel has no single-step, so put breakpoints on every instruction
+	// that could execute next. they're removed by PumpEvents as soon as any
+	// thread stops, or once every stepping thread has exited. other threads
+	// could run into them too, so the host only continues the stepping
+	// thread until then.
+	static const uint32_t brk = 0xd4200000; // brk #0
+	
+	auto r = trn::svc::GetDebugThreadContext(debug, thread_id, 15);
+	if(!r) {
+		TWILI_BRIDGE_CHECK(r.error());
+	}
+
+	// same layout as the host's ThreadContext
+	struct {
+		uint64_t x[31];
+		uint64_t sp, pc;
+		uint32_t psr;
+	} regs;
+	thread_context_t context = *r;
+	memcpy(&regs, &context, sizeof(regs));
+
+	TWILI_BRIDGE_CHECK((regs.psr & 0x10) ? LIBTRANSISTOR_ERR_UNIMPLEMENTED : RESULT_OK); // aarch32
+	
+	uint32_t insn;
+	TWILI_BRIDGE_CHECK(twili::Unwrap(trn::svc::ReadDebugProcessMemory((uint8_t*) &insn, debug, regs.pc, sizeof(insn))));
+
+	auto sign_extend = [](uint64_t value, int bits) -> int64_t {
+		return (int64_t) (value << (64 - bits)) >> (64 - bits);
+	};
+
+	std::vector<uint64_t> targets;
+	if((insn & 0x7c000000) == 0x14000000) { // B, BL
+		targets.push_back(regs.pc + sign_extend(insn & 0x3ffffff, 26) * 4);
+	} else if((insn & 0xff000010) == 0x54000000 || // B.cond
+						(insn & 0x7e000000) == 0x34000000) { // CBZ, CBNZ
+		targets.push_back(regs.pc + 4);
+		targets.push_back(regs.pc + sign_extend((insn >> 5) & 0x7ffff, 19) * 4);
+	} else if((insn & 0x7e000000) == 0x36000000) { // TBZ, TBNZ
+		targets.push_back(regs.pc + 4);
+		targets.push_back(regs.pc + sign_extend((insn >> 5) & 0x3fff, 14) * 4);
+	} else if((insn & 0xff9ffc1f) == 0xd61f0000) { // BR, BLR, RET
+		uint32_t rn = (insn >> 5) & 0x1f;
+		targets.push_back(rn == 31 ? 0 : regs.x[rn]);
+	} else {
+		targets.push_back(regs.pc + 4);
+	}
+
+	for(uint64_t target : targets) {
+		if(step_breakpoints.find(target) != step_breakpoints.end()) {
+			continue;
+		}
+		uint32_t original;
+		if(!trn::svc::ReadDebugProcessMemory((uint8_t*) &original, debug, target, sizeof(original))) {
+			continue; // can't land there anyway
+		}
+		uint32_t patch = brk;
+		if(!trn::svc::WriteDebugProcessMemory(debug, (uint8_t*) &patch, target, sizeof(patch))) {
+			continue;
+		}
+		step_breakpoints[target] = original;
+	}
+
+	TWILI_BRIDGE_CHECK(step_breakpoints.empty() ? TWILI_ERR_INVALID_DEBUGGER_STATE : RESULT_OK);
+	if(std::find(stepping_thread_ids.begin(), stepping_thread_ids.end(), thread_id) == stepping_thread_ids.end()) {
+		stepping_thread_ids.push_back(thread_id);
+	}
+	opener.RespondOk();
+}
+
+void ITwibDebugger::ClearStepBreakpoints() {
+	for(auto &bp : step_breakpoints) {
+		uint32_t original = bp.second;
+		if(!trn::svc::WriteDebugProcessMemory(debug, (uint8_t*) &original, bp.first, sizeof(original))) {
+			printf("failed to restore instruction at 0x%lx after single step\n", bp.first);
+		}
+	}
+	step_breakpoints.clear();
+	stepping_thread_ids.clear();
+}
+
 } // namespace bridge
 } // namespace twili
@@ -28,6 +28,8 @@
 #include "../RequestHandler.hpp"
 
 #include<deque>
+#include<map>
+#include<vector>
 
 namespace twili {
 
@@ -55,13 +57,19 @@ class ITwibDebugger : public ObjectDispatcherProxy<ITwibDebugger> {
 	std::shared_ptr<process::MonitoredProcess> proc;
 	std::shared_ptr<trn::WaitHandle> wait_handle;
 	std::deque<debug_event_info_t> event_queue;
+	// original instructions under temporary single-step breakpoints
+	std::map<uint64_t, uint32_t> step_breakpoints;
+	// threads that were stepped onto them and haven't stopped or exited yet
+	std::vector<uint64_t> stepping_thread_ids;
 
 	void PumpEvents();
+	void ClearStepBreakpoints();
+	void RespondEvents(bridge::ResponseOpener &opener);
 	
 	void QueryMemory(bridge::ResponseOpener opener, uint64_t address);
 	void ReadMemory(bridge::ResponseOpener opener, uint64_t address, uint64_t size);
 	void WriteMemory(bridge::ResponseOpener opener, uint64_t address, InputStream &data);
-	void ListThreads(bridge::ResponseOpener opener);
+	void ListThreads(bridge::ResponseOpener opener, bool with_contexts);
 	void GetDebugEvent(bridge::ResponseOpener opener);
 	void GetThreadContext(bridge::ResponseOpener opener, uint64_t thread_id);
 	void BreakProcess(bridge::ResponseOpener opener);
@@ -72,6 +80,11 @@ class ITwibDebugger : public ObjectDispatcherProxy<ITwibDebugger> {
 	void GetTargetEntry(bridge::ResponseOpener opener);
 	void LaunchDebugProcess(bridge::ResponseOpener opener);
 	void GetNroInfos(bridge::ResponseOpener opener);
+	void QueryMemoryMap(bridge::ResponseOpener opener);
+	void ReadMemoryMulti(bridge::ResponseOpener opener, std::vector<uint64_t> addresses, std::vector<uint64_t> sizes);
+	void GetDebugEvents(bridge::ResponseOpener opener, bool wait);
+	void StepThread(bridge::ResponseOpener opener, uint64_t thread_id);
+	void WriteMemoryMulti(bridge::ResponseOpener opener, std::vector<uint64_t> addresses, std::vector<uint64_t> sizes, std::vector<uint8_t> data);
 
  public:
 	SmartRequestDispatcher<
@@ -89,7 +102,12 @@ class ITwibDebugger : public ObjectDispatcherProxy<ITwibDebugger> {
 		SmartCommand<CommandID::WAIT_EVENT, &ITwibDebugger::WaitEvent>,
 		SmartCommand<CommandID::GET_TARGET_ENTRY, &ITwibDebugger::GetTargetEntry>,
 		SmartCommand<CommandID::LAUNCH_DEBUG_PROCESS, &ITwibDebugger::LaunchDebugProcess>,
-		SmartCommand<CommandID::GET_NRO_INFOS, &ITwibDebugger::GetNroInfos>
+		SmartCommand<CommandID::GET_NRO_INFOS, &ITwibDebugger::GetNroInfos>,
+		SmartCommand<CommandID::QUERY_MEMORY_MAP, &ITwibDebugger::QueryMemoryMap>,
+		SmartCommand<CommandID::READ_MEMORY_MULTI, &ITwibDebugger::ReadMemoryMulti>,
+		SmartCommand<CommandID::GET_DEBUG_EVENTS, &ITwibDebugger::GetDebugEvents>,
+		SmartCommand<CommandID::STEP_THREAD, &ITwibDebugger::StepThread>,
+		SmartCommand<CommandID::WRITE_MEMORY_MULTI, &ITwibDebugger::WriteMemoryMulti>
 		> dispatcher;
 };
 
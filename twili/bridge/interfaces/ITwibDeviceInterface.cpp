@@ -43,8 +43,10 @@
 #include "ITwibDebugger.hpp"
 #include "ITwibProcessMonitor.hpp"
 #include "ITwibFilesystemAccessor.hpp"
+#include "ITwibCoreDumpAccessor.hpp"
 
 #include "err.hpp"
+#include "Hello.hpp"
 
 using namespace trn;
 
@@ -85,6 +87,13 @@ void ITwibDeviceInterface::CoreDump(bridge::ResponseOpener opener, uint64_t pid)
 	report.Generate(*proc, opener);
 }
 
+void ITwibDeviceInterface::OpenCoreDump(bridge::ResponseOpener opener, uint64_t pid) {
+	std::shared_ptr<process::Process> proc = twili.FindProcess(pid);
+	std::unique_ptr<ELFCrashReport> report = std::make_unique<ELFCrashReport>();
+	TWILI_BRIDGE_CHECK(report->Prepare(*proc));
+	opener.RespondOk(opener.MakeObject<ITwibCoreDumpAccessor>(std::move(report)));
+}
+
 void ITwibDeviceInterface::Terminate(bridge::ResponseOpener opener, uint64_t pid) {
 	twili.FindProcess(pid)->Terminate();
 
@@ -154,6 +163,15 @@ void ITwibDeviceInterface::UpgradeTwili(bridge::ResponseOpener opener) {
 
 void ITwibDeviceInterface::Identify(bridge::ResponseOpener opener) {
 	printf("identifying...\n");
+	if(opener.GetClientId() == protocol::META_CLIENT_ID) {
+		bridge::detail::LinkSettings &link = opener.GetLinkSettings();
+		if(!link.said_hello) {
+			// a new twibd that didn't say hello; forget what the last one agreed to
+			printf("twibd identified without hello, resetting link settings\n");
+			link = bridge::detail::LinkSettings();
+		}
+		link.said_hello = false;
+	}
 	trn::service::SM sm = twili::Assert(trn::service::SM::Initialize());
 	trn::ipc::client::Object set_sys = twili::Assert(
 		sm.GetService("set:sys"));
@@ -351,5 +369,38 @@ void ITwibDeviceInterface::RebootUnsafe(bridge::ResponseOpener opener) {
 			ipc::Buffer<uint8_t, 0x15>(context, sizeof(context))));
 }
 
+void ITwibDeviceInterface::Hello(bridge::ResponseOpener opener, std::string hello) {
+	std::string err;
+	msgpack11::MsgPack obj = msgpack11::MsgPack::parse(hello, err);
+	if(!err.empty()) {
+		printf("bad hello: %s\n", err.c_str());
+		opener.RespondError(TWILI_ERR_PROTOCOL_BAD_REQUEST);
+		return;
+	}
+
+	hello::Agreement agreement = hello::Negotiate(
+		obj["features"].uint32_value(),
+		obj["max_transfer_size"].uint32_value(),
+		opener.GetTransferSizeLimit());
+	
+	printf("twibd said hello (version %d), using features 0x%x, max transfer size 0x%lx\n", obj["version"].uint32_value(), agreement.features, agreement.max_transfer_size);
+
+	bridge::detail::LinkSettings &link = opener.GetLinkSettings();
+	link.compression = false; // whatever a previous twibd agreed to is void
+	link.max_transfer_size = agreement.max_transfer_size;
+	link.said_hello = true;
+	
+	msgpack11::MsgPack response = msgpack11::MsgPack::object {
+		{"version", protocol::HELLO_VERSION},
+		{"features", agreement.features},
+		{"max_transfer_size", (uint32_t) opener.GetMaxTransferSize()},
+		{"max_outstanding_requests", bridge::detail::LinkSettings::MaxOutstandingRequests},
+	};
+	opener.RespondOk(std::move(response));
+
+	// takes effect starting with the next response on this connection
+	link.compression = agreement.features & protocol::FEATURE_COMPRESSION;
+}
+
 } // namespace bridge
 } // namespace twili
@@ -42,7 +42,7 @@ ITwibFileAccessor::~ITwibFileAccessor() {
 void ITwibFileAccessor::Read(bridge::ResponseOpener opener, uint64_t offset, uint64_t size) {
 	const size_t limit = 0x40000;
 
-	std::vector<uint8_t> buffer(std::max(size, limit));
+	std::vector<uint8_t> buffer(std::min(size, limit));
 	size_t actual_size;
 
 	TWILI_BRIDGE_CHECK(ifile_read(ifile, &actual_size, buffer.data(), buffer.size(), 0, offset, buffer.size()));
@@ -27,6 +27,7 @@
 #include "../../Threading.hpp"
 #include "../Object.hpp"
 
+#include "Compression.hpp"
 #include "err.hpp"
 
 namespace twili {
@@ -58,9 +59,15 @@ void TCPBridge::Connection::Process() {
 				payload_size = 0;
 				payload_buffer.Clear();
 				has_current_payload = false;
+
+				payload_compressed = current_mh.payload_size & protocol::PAYLOAD_COMPRESSED;
+				current_mh.payload_size&= ~protocol::PAYLOAD_COMPRESSED;
 				
-				// pick command handler
-				Synchronize(Task::BeginProcessingCommand);
+				// pick command handler. compressed requests have to wait
+				// until we can decompress the whole payload.
+				if(!payload_compressed) {
+					Synchronize(Task::BeginProcessingCommand);
+				}
 			} else {
 				in_buffer.Reserve(sizeof(protocol::MessageHeader));
 			}
@@ -74,6 +81,18 @@ void TCPBridge::Connection::Process() {
 			in_buffer.Read(payload_buffer, payload_avail);
 			payload_size+= payload_avail;
 
+			if(payload_compressed) {
+				if(payload_size < current_mh.payload_size) {
+					return;
+				}
+				if(!DecompressPayload()) {
+					printf("TCPConnection: bad compressed payload\n");
+					Panic();
+					return;
+				}
+				Synchronize(Task::BeginProcessingCommand);
+			}
+
 			Synchronize(Task::FlushReceiveBuffer);
 			
 			if(payload_size == current_mh.payload_size) {
@@ -87,6 +106,17 @@ void TCPBridge::Connection::Process() {
 	}
 }
 
+bool TCPBridge::Connection::DecompressPayload() {
+	std::vector<uint8_t> decompressed;
+	if(!compression::DecompressPayload(payload_buffer.Read(), payload_buffer.ReadAvailable(), decompressed)) {
+		return false;
+	}
+	current_mh.payload_size = decompressed.size();
+	payload_size = decompressed.size();
+	payload_buffer = util::Buffer(std::move(decompressed));
+	return true;
+}
+
 void TCPBridge::Connection::Synchronize(Task task) {
 	std::unique_lock<thread::Mutex> lock(bridge.request_processing_mutex);
 	
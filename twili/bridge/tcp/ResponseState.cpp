@@ -34,13 +34,18 @@ namespace tcp {
 using trn::ResultError;
 
 TCPBridge::Connection::ResponseState::ResponseState(std::shared_ptr<Connection> connection, uint32_t client_id, uint32_t tag) :
-	detail::ResponseState(client_id, tag),
+	detail::ResponseState(client_id, tag, connection->link),
 	connection(connection) {
 	
 }
 
 size_t TCPBridge::Connection::ResponseState::GetMaxTransferSize() {
-	return 16384;
+	return link.max_transfer_size ? link.max_transfer_size : 16384;
+}
+
+size_t TCPBridge::Connection::ResponseState::GetTransferSizeLimit() {
+	// the socket doesn't care, but responses allocate transfer-sized buffers
+	return 256 * 1024;
 }
 
 void TCPBridge::Connection::ResponseState::SendHeader(protocol::MessageHeader &hdr) {
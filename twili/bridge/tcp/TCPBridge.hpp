@@ -124,11 +124,13 @@ class TCPBridge::Connection : public std::enable_shared_from_this<TCPBridge::Con
 	void Synchronize(Task task);
 	
 	void BeginProcessingCommandImpl(); // should run on main thread
+	bool DecompressPayload();
 	
 	util::Buffer in_buffer;
 
 	bool has_current_mh = false;
 	bool has_current_payload = false;
+	bool payload_compressed = false;
 	protocol::MessageHeader current_mh;
 	size_t payload_size;
 	util::Buffer payload_buffer;
@@ -140,6 +142,7 @@ class TCPBridge::Connection : public std::enable_shared_from_this<TCPBridge::Con
 	
 	uint32_t next_object_id = 1;
 	std::map<uint32_t, std::shared_ptr<bridge::Object>> objects;
+	detail::LinkSettings link;
 };
 
 class TCPBridge::Connection::ResponseState : public bridge::detail::ResponseState {
@@ -147,6 +150,7 @@ class TCPBridge::Connection::ResponseState : public bridge::detail::ResponseStat
 	ResponseState(std::shared_ptr<Connection> connection, uint32_t client_id, uint32_t tag);
 	
 	virtual size_t GetMaxTransferSize() override;
+	virtual size_t GetTransferSizeLimit() override;
 	virtual void SendHeader(protocol::MessageHeader &hdr) override;
 	virtual void SendData(uint8_t *data, size_t size) override;
 	virtual void Finalize() override;
@@ -33,6 +33,7 @@ typedef bool _Bool;
 #include "../ResponseOpener.hpp"
 #include "USBBridge.hpp"
 
+#include "Compression.hpp"
 #include "err.hpp"
 
 namespace twili {
@@ -140,6 +141,8 @@ void USBBridge::RequestReader::MetadataTransactionCompleted() {
 		return;
 	}
 	memcpy(&current_header, bridge->request_meta_buffer.data, sizeof(protocol::MessageHeader));
+	payload_compressed = current_header.payload_size & protocol::PAYLOAD_COMPRESSED;
+	current_header.payload_size&= ~protocol::PAYLOAD_COMPRESSED;
 	if(bridge->twili->config.logging_verbosity >= 1) {
 		printf("got header, object 0x%x, command %u, payload size 0x%lx\n", current_header.object_id, current_header.command_id, current_header.payload_size);
 	}
@@ -149,8 +152,11 @@ void USBBridge::RequestReader::MetadataTransactionCompleted() {
 	payload_buffer.Clear();
 	ResetHandler();
 	
-	// pick command handler
-	BeginProcessingCommand();
+	// pick command handler. compressed requests have to wait until we can
+	// decompress the whole payload.
+	if(!payload_compressed) {
+		BeginProcessingCommand();
+	}
 	
 	if(current_header.payload_size > 0) {
 		PostDataBuffer();
@@ -205,13 +211,26 @@ void USBBridge::RequestReader::DataTransactionCompleted() {
 		// fill input buffer with data from USB
 		payload_buffer.Write(bridge->request_data_buffer.data, entry->transferred_size);
 
+		if(payload_compressed) {
+			if(payload_size < current_header.payload_size) {
+				PostDataBuffer();
+				return;
+			}
+			if(!DecompressPayload()) {
+				printf("USBRequestReader: bad compressed payload\n");
+				bridge->ResetInterface();
+				return;
+			}
+			BeginProcessingCommand();
+		}
+
 		// pass to request handler
 		current_handler->FlushReceiveBuffer(payload_buffer);
 	} catch(trn::ResultError &e) {
 		printf("USBRequestReader: Somebody is still throwing exceptions!\n");
 		twili::Abort(e);
 	} catch(std::bad_alloc &e) {
-		if(!current_state->has_begun) {
+		if(current_state && !current_state->has_begun) {
 			printf("USBRequestReader: ran out of memory. trying to signal this to user...\n");
 			ResponseOpener opener(current_state);
 			opener.RespondError(LIBTRANSISTOR_ERR_OUT_OF_MEMORY);
@@ -274,6 +293,17 @@ void USBBridge::RequestReader::BeginProcessingCommand() {
 	}
 }
 
+bool USBBridge::RequestReader::DecompressPayload() {
+	std::vector<uint8_t> decompressed;
+	if(!compression::DecompressPayload(payload_buffer.Read(), payload_buffer.ReadAvailable(), decompressed)) {
+		return false;
+	}
+	current_header.payload_size = decompressed.size();
+	payload_size = decompressed.size();
+	payload_buffer = util::Buffer(std::move(decompressed));
+	return true;
+}
+
 void USBBridge::RequestReader::FinalizeCommand() {
 	try {
 		current_handler->Finalize(payload_buffer);
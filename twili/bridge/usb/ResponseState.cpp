@@ -31,12 +31,16 @@ namespace usb {
 using trn::ResultError;
 
 USBBridge::ResponseState::ResponseState(USBBridge &bridge, uint32_t client_id, uint32_t tag) :
-	detail::ResponseState(client_id, tag),
+	detail::ResponseState(client_id, tag, bridge.link),
 	bridge(bridge) {
 	
 }
 
 size_t USBBridge::ResponseState::GetMaxTransferSize() {
+	return link.max_transfer_size ? link.max_transfer_size : bridge.response_data_buffer.size;
+}
+
+size_t USBBridge::ResponseState::GetTransferSizeLimit() {
 	return bridge.response_data_buffer.size;
 }
 
@@ -58,7 +62,9 @@ void USBBridge::ResponseState::SendData(uint8_t *data, size_t size) {
 	if(size == 0) {
 		return;
 	}
-	auto max_size = bridge.response_data_buffer.size;
+	// twibd sizes its in transfers to match, so that each one of ours fills
+	// one of its
+	auto max_size = GetMaxTransferSize();
 	while(size > max_size) {
 		SendData(data, max_size);
 		data+= max_size;
@@ -141,6 +141,7 @@ void USBBridge::PostBufferSync(std::shared_ptr<trn::service::usb::ds::Endpoint>
 bool USBBridge::USBStateChangeCallback() {
 	if(twili::Assert(ds.GetState()) == trn::service::usb::ds::State::INITIALIZED) {
 		printf("finished USB bringup\n");
+		link = detail::LinkSettings();
 		try {
 			request_reader.Begin();
 		} catch(ResultError &e) { // until libtransistor 2.0.1, we have to live with ResultError not inheriting publicly from std::runtime_error
@@ -155,6 +156,7 @@ bool USBBridge::USBStateChangeCallback() {
 }
 
 void USBBridge::ResetInterface() {
+	link = detail::LinkSettings(); // whoever connects next has to say hello again
 	interface->Disable();
 	interface->Enable();
 }
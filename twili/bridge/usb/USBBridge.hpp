@@ -81,8 +81,10 @@ class USBBridge {
 		void BeginProcessingCommand();
 		void FinalizeCommand();
 		void CleanupCommand();
+		bool DecompressPayload();
 		
 		protocol::MessageHeader current_header;
+		bool payload_compressed = false;
 		size_t payload_size;
 		util::Buffer payload_buffer;
 		std::vector<uint32_t> object_ids;
@@ -116,6 +118,7 @@ class USBBridge {
 
 	uint32_t object_id = 1;
 	std::map<uint32_t, std::shared_ptr<bridge::Object>> objects;
+	detail::LinkSettings link;
 	
 	RequestReader request_reader;
 	USBBuffer request_meta_buffer;
@@ -134,6 +137,7 @@ class USBBridge::ResponseState : public bridge::detail::ResponseState {
 	ResponseState(USBBridge &bridge, uint32_t client_id, uint32_t tag);
 
 	virtual size_t GetMaxTransferSize() override;
+	virtual size_t GetTransferSizeLimit() override;
 	virtual void SendHeader(protocol::MessageHeader &hdr) override;
 	virtual void SendData(uint8_t *data, size_t size) override;
 	virtual void Finalize() override;